@@ -0,0 +1,158 @@
+#include "gen.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// State of writing a program
+typedef struct Gen {
+	FILE *stream;
+	const GenOpts *o;
+	uint64_t state;
+	int left; // Statements yet to write
+} Gen;
+
+// Forward declarations for static functions
+static uint64_t next(Gen *g);
+static int below(Gen *g, int n);
+static void gen_num(Gen *g);
+static void gen_mono(Gen *g);
+static void gen_poly(Gen *g, int nest);
+static void gen_interval(Gen *g);
+static void gen_stmt(Gen *g, int depth);
+static void gen_seq(Gen *g, int n, int depth);
+
+// splitmix64
+static uint64_t next(Gen *g)
+{
+	uint64_t z = (g->state += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+// Random integer from 0 to `n` - 1
+static int below(Gen *g, int n) { return (int)(next(g) % (uint64_t)n); }
+
+// A small decimal number
+static void gen_num(Gen *g)
+{
+	fprintf(g->stream, "%d.%02d", below(g, 3), below(g, 100));
+}
+
+// A number times powers of `x` and `y` up to the degree
+static void gen_mono(Gen *g)
+{
+	gen_num(g);
+	const int deg = below(g, g->o->degree + 1);
+	const int px = below(g, deg + 1);
+	if (px) {
+		fprintf(g->stream, px > 1 ? " x^%d" : " x", px);
+	}
+	if (deg - px) {
+		fprintf(g->stream, deg - px > 1 ? " y^%d" : " y", deg - px);
+	}
+}
+
+// A sum of monomials, with a product or a power of smaller sums nested in at
+// most `nest` deep
+static void gen_poly(Gen *g, int nest)
+{
+	const int n = 1 + below(g, g->o->terms);
+	for (int i = 0; i < n; ++i) {
+		if (i) {
+			fputs(below(g, 3) ? " + " : " - ", g->stream);
+		}
+		if (!nest || below(g, 4)) {
+			gen_mono(g);
+			continue;
+		}
+		putc('(', g->stream);
+		gen_poly(g, nest - 1);
+		if (below(g, 2)) {
+			fputs(") * (", g->stream);
+			gen_poly(g, nest - 1);
+			putc(')', g->stream);
+		} else {
+			fprintf(g->stream, ")^%d", 2 + below(g, 2));
+		}
+	}
+}
+
+// A constant interval
+static void gen_interval(Gen *g)
+{
+	const int lo = below(g, 20) - 10;
+	fprintf(g->stream, "[%d, %d]", lo, lo + 1 + below(g, 10));
+}
+
+// A statement, with blocks of statements if `depth` > 0
+static void gen_stmt(Gen *g, int depth)
+{
+	--g->left;
+	const int kind = below(g, 20);
+	if (depth > 0 && g->left > 0 && kind < 6) {
+		// `or` or `iter` with blocks of up to 4 statements
+		const int n1 = 1 + below(g, g->left < 4 ? g->left : 4);
+		const int n2 = 1 + below(g, g->left < 4 ? g->left : 4);
+		if (kind < 3) {
+			fputs("iter {\n", g->stream);
+			gen_seq(g, n1, depth - 1);
+			fputs("\n}", g->stream);
+			return;
+		}
+		fputs("{\n", g->stream);
+		gen_seq(g, n1, depth - 1);
+		fputs("\n} or {\n", g->stream);
+		gen_seq(g, n2, depth - 1);
+		fputs("\n}", g->stream);
+		return;
+	}
+	if (kind == 6 || kind == 7) {
+		fputs(kind == 6 ? "assert(" : "reach(", g->stream);
+		gen_interval(g);
+		fputs(" * ", g->stream);
+		gen_interval(g);
+		putc(')', g->stream);
+	} else if (kind < 15) {
+		fputs("translation(", g->stream);
+		gen_poly(g, 2);
+		fputs(", ", g->stream);
+		gen_poly(g, 2);
+		putc(')', g->stream);
+	} else {
+		fputs("rotation(", g->stream);
+		gen_poly(g, 1);
+		fputs(", ", g->stream);
+		gen_poly(g, 1);
+		fputs(", ", g->stream);
+		gen_poly(g, 2);
+		putc(')', g->stream);
+	}
+}
+
+// `n` statements, or fewer if the program is full
+static void gen_seq(Gen *g, int n, int depth)
+{
+	for (int i = 0; i < n && (!i || g->left > 0); ++i) {
+		if (i) {
+			fputs(";\n", g->stream);
+		}
+		gen_stmt(g, depth);
+	}
+}
+
+bool gen_prog(FILE *stream, const GenOpts *o)
+{
+	Gen g = {stream, o, o->seed, o->size};
+	fputs("init(", stream);
+	gen_interval(&g);
+	fputs(" * ", stream);
+	gen_interval(&g);
+	fputs(")", stream);
+	while (g.left > 0) {
+		fputs(";\n", stream);
+		gen_seq(&g, g.left, o->depth);
+	}
+	putc('\n', stream);
+	return !ferror(stream);
+}
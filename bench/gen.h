@@ -0,0 +1,23 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Shape of a random program
+typedef struct GenOpts {
+	int size;   // Number of statements, counting those in blocks
+	int depth;  // Maximum nesting of `or` and `iter` blocks
+	int degree; // Maximum degree of a monomial
+	int terms;  // Maximum number of terms of a polynomial
+	unsigned long long seed;
+} GenOpts;
+
+// Write a syntactically valid program of the shape `o` to `stream`: an
+// `init` followed by translations, rotations, `or`s, `iter`s, `assert`s, and
+// `reach`es. Polynomials are sums of monomials, products, and powers, so
+// that compiling them exercises the polynomial arithmetic. Returns `false`
+// if a write failed.
+bool gen_prog(FILE *stream, const GenOpts *o);
+
+#endif /* ifndef GEN_H */
@@ -0,0 +1,27 @@
+// Write a random program to `stdout`.
+// Usage: generate [SIZE [DEPTH [DEGREE [TERMS [SEED]]]]]
+#include "gen.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[])
+{
+	GenOpts o = {.size = 100, .depth = 2, .degree = 2, .terms = 3,
+		     .seed = 1};
+	int *const fields[] = {&o.size, &o.depth, &o.degree, &o.terms};
+	for (int i = 1; i < argc && i <= 4; ++i) {
+		*fields[i - 1] = (int)strtol(argv[i], NULL, 0);
+	}
+	if (argc > 5) {
+		o.seed = strtoull(argv[5], NULL, 0);
+	}
+	if (o.size < 0 || o.depth < 0 || o.degree < 0 || o.terms < 1) {
+		fprintf(stderr, "%s: invalid shape\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!gen_prog(stdout, &o) || fflush(stdout)) {
+		perror(argv[0]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+// Throughput of the sample writer in each format, compared with formatting
+// every point with `fprintf`, after checking that the text format prints
+// numbers as `fprintf` does, and that `fmt_double` reads back exactly with
+// `strtod`. Usage: output [POINTS]
+#define _POSIX_C_SOURCE 200809L
+#include "output.h"
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Number of points of the check of the text format, enough to fill the buffer
+// of a `Writer` several times over with the longest records
+#define TEXT_POINTS 200000
+// Number of random numbers formatted and read back
+#define ROUND_TRIPS 1000000
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void report(const char *name, long n, long bytes, double secs)
+{
+	printf("%-8s %8.2lf Mpoints/s %8.2lf MB/s\n", name, n / secs * 1E-6,
+	       bytes / secs * 1E-6);
+}
+
+// Next of the SplitMix64 sequence of `state`
+static uint64_t next_bits(uint64_t *state)
+{
+	uint64_t z = *state += 0x9E3779B97F4A7C15;
+	z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9;
+	z = (z ^ z >> 27) * 0x94D049BB133111EB;
+	return z ^ z >> 31;
+}
+
+// The `i`-th number of the check of the text format: one of huge, tiny, and
+// non-finite numbers, a random bit pattern, a random number of a few digits,
+// a multiple of a power of 2, which may lie halfway between millionths, or a
+// number next to halfway.
+static double text_number(uint64_t *state, int i)
+{
+	static const double vs[] = {DBL_MAX, -DBL_MAX, 1E300, -1E300,
+				    DBL_MIN, -0., INFINITY, NAN};
+	const int nvs = sizeof vs / sizeof *vs;
+	const uint64_t bits = next_bits(state);
+	double v;
+	switch (i % 5) {
+	case 0:
+		return vs[i / 5 % nvs];
+	case 1:
+		memcpy(&v, &bits, sizeof v);
+		return v;
+	case 2:
+		return (int64_t)bits / ldexp(1., (int)(bits % 64));
+	case 3:
+		return (int32_t)bits / ldexp(1., 1 + (int)(bits >> 32) % 40);
+	default:
+		v = ((int32_t)bits + .5) / 1E6;
+		return nextafter(v, bits >> 63 ? INFINITY : -INFINITY);
+	}
+}
+
+// Whether the text format writes points as `fprintf` does.
+static bool check_text(void)
+{
+	uint64_t state = 1;
+	char *want = NULL;
+	char *got = NULL;
+	size_t want_len = 0;
+	size_t got_len = 0;
+	FILE *fw = open_memstream(&want, &want_len);
+	FILE *fg = open_memstream(&got, &got_len);
+	Writer w;
+	bool ok = fw && fg && new_writer(&w, fg, FMT_TEXT);
+	if (ok) {
+		for (int i = 0; i < TEXT_POINTS; ++i) {
+			const double x = text_number(&state, i);
+			const double y = text_number(&state, i / 5);
+			fprintf(fw, "(%lf, %lf)\n", x, y);
+			write_point(&w, x, y);
+		}
+		ok = free_writer(&w);
+	}
+	if (fw) {
+		fclose(fw);
+	}
+	if (fg) {
+		fclose(fg);
+	}
+	ok = ok && want_len == got_len && !memcmp(want, got, want_len);
+	free(want);
+	free(got);
+	return ok;
+}
+
+// Whether every random bit pattern formatted by `fmt_double` reads back to
+// itself with `strtod`, and NaNs to NaNs.
+static bool check_round_trip(void)
+{
+	uint64_t state = 2;
+	for (long i = 0; i < ROUND_TRIPS; ++i) {
+		const uint64_t bits = next_bits(&state);
+		double v;
+		memcpy(&v, &bits, sizeof v);
+		char buf[FMT_DOUBLE_MAX + 1];
+		const int len = fmt_double(buf, v);
+		buf[len] = '\0';
+		const double back = strtod(buf, NULL);
+		if (len > FMT_DOUBLE_MAX ||
+		    (isnan(v) ? !isnan(back) : memcmp(&v, &back, sizeof v))) {
+			fprintf(stderr, "%a is formatted as %s\n", v, buf);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!check_text()) {
+		fputs("The text format differs from fprintf.\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (!check_round_trip()) {
+		fputs("A number does not read back.\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	const long n = argc > 1 ? strtol(argv[1], NULL, 0) : 1000000;
+	double *xs = malloc(2 * n * sizeof *xs);
+	if (!xs) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return EXIT_FAILURE;
+	}
+	double *ys = xs + n;
+	srand(1);
+	for (long i = 0; i < n; ++i) {
+		xs[i] = (rand() - RAND_MAX / 2) / 1000.;
+		ys[i] = (double)rand() / RAND_MAX;
+	}
+	FILE *null = fopen("/dev/null", "w");
+	if (!null) {
+		perror("/dev/null");
+		return EXIT_FAILURE;
+	}
+
+	double start = now();
+	long bytes = 0;
+	for (long i = 0; i < n; ++i) {
+		bytes += fprintf(null, "(%lf, %lf)\n", xs[i], ys[i]);
+	}
+	report("fprintf", n, bytes, now() - start);
+
+	static const char *const names[] = {"text", "csv", "ndjson", "bin"};
+	for (Format fmt = FMT_TEXT; fmt <= FMT_BIN; ++fmt) {
+		Writer w;
+		if (!new_writer(&w, null, fmt)) {
+			return EXIT_FAILURE;
+		}
+		bytes = 0;
+		start = now();
+		for (long i = 0; i < n; ++i) {
+			const size_t len = w.len;
+			write_point(&w, xs[i], ys[i]);
+			// The buffer holds only the new record if it has been
+			// flushed.
+			bytes += w.len > len ? w.len - len : w.len;
+		}
+		free_writer(&w);
+		report(names[fmt], n, bytes, now() - start);
+	}
+	fclose(null);
+	free(xs);
+	return EXIT_SUCCESS;
+}
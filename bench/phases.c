@@ -0,0 +1,202 @@
+// Time of each phase of gisa on generated programs, the best of a few runs,
+// compared with a baseline written by an earlier run.
+// Usage: phases [-bBASELINE [-tTHRESHOLD]]
+// Without `-b`, prints a baseline. With it, prints each time against the
+// baseline, and fails if one has grown by more than the fraction THRESHOLD
+// (0.1 by default).
+#define _POSIX_C_SOURCE 200809L
+#include "analyze.h"
+#include "gen.h"
+#include "gisa.h"
+#include "sample.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Runs of each phase, of which the fastest counts
+#define REPS 5
+// Maximum number of phases in a baseline
+#define BASELINE_MAX 32
+
+static const char *progname = "phases";
+
+typedef enum Kind { PARSE, COMPILE, SAMPLE, ANALYZE } Kind;
+
+// A phase timed on a program of the shape `gen`
+typedef struct Bench {
+	const char *name;
+	Kind kind;
+	GenOpts gen;
+} Bench;
+
+static const Bench benches[] = {
+    // Lexing and parsing a long program
+    {"parse", PARSE, {5000, 3, 2, 3, 1}},
+    // `eval_poly` and the arithmetic of term.c on products and powers
+    {"compile", COMPILE, {300, 2, 4, 5, 2}},
+    // Sampling 20000 trajectories on a thread
+    {"sample", SAMPLE, {30, 2, 2, 3, 3}},
+    // Analyzing over boxes
+    {"analyze", ANALYZE, {3000, 3, 2, 3, 4}},
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+// Run `b` once. Returns the seconds its phase took, or a negative number if
+// failed.
+static double run(const Bench *b, const char *text, size_t len)
+{
+	Gisa g;
+	new_gisa(&g, b->name);
+	double start = now();
+	if (!parse_text(&g, text, len)) {
+		free_gisa(&g);
+		return -1.;
+	}
+	if (b->kind == PARSE) {
+		const double secs = now() - start;
+		free_gisa(&g);
+		return secs;
+	}
+
+	start = now();
+	const bool ok = compile_gisa(&g);
+	double secs = now() - start;
+	if (!ok) {
+		free_gisa(&g);
+		return -1.;
+	}
+	const Prog *prog = &g.prog;
+	int ret = 0;
+	if (b->kind == SAMPLE) {
+		Stats stats;
+		new_stats(&stats);
+		const SampleOpts opts = {.n = 20000,
+					 .seed = 1,
+					 .iter_max = 10,
+					 .nthreads = 1,
+					 .stats = &stats};
+		start = now();
+		ret = sample(prog, &opts, NULL);
+		secs = now() - start;
+		free_stats(&stats);
+	} else if (b->kind == ANALYZE) {
+		Analysis a;
+		start = now();
+		ret = analyze(prog, 50, &a);
+		secs = now() - start;
+		free_analysis(&a);
+	}
+	free_gisa(&g);
+	return ret ? -1. : secs;
+}
+
+// Read the baseline at `path` into `names` and `secs`. Returns the number of
+// phases, or -1 if failed.
+static int read_baseline(const char *path, char names[][32], double *secs)
+{
+	FILE *in = fopen(path, "r");
+	if (!in) {
+		return -1;
+	}
+	int n = 0;
+	while (n < BASELINE_MAX &&
+	       fscanf(in, "%31s %lf", names[n], secs + n) == 2) {
+		++n;
+	}
+	fclose(in);
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *baseline = NULL;
+	double threshold = .1;
+	bool ok = true;
+	for (int i = 1; ok && i < argc; ++i) {
+		const char *flag = argv[i];
+		const char *arg =
+		    flag[0] == '-' && flag[1] && flag[2] ? flag + 2 : argv[++i];
+		char *end;
+		if (flag[0] != '-' || !arg) {
+			ok = false;
+		} else if (flag[1] == 'b') {
+			baseline = arg;
+		} else if (flag[1] == 't') {
+			threshold = strtod(arg, &end);
+			ok = end != arg && !*end && threshold >= 0.;
+		} else {
+			ok = false;
+		}
+	}
+	if (!ok) {
+		fprintf(stderr, "usage: %s [-bBASELINE [-tTHRESHOLD]]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char names[BASELINE_MAX][32];
+	double base[BASELINE_MAX];
+	int nbase = 0;
+	if (baseline && (nbase = read_baseline(baseline, names, base)) < 0) {
+		fprintf(stderr,
+			"%s: no baseline '%s'; `make bench-baseline` writes "
+			"one\n",
+			progname, baseline);
+		baseline = NULL;
+	}
+
+	bool regressed = false;
+	for (size_t i = 0; i < sizeof benches / sizeof *benches; ++i) {
+		const Bench *b = benches + i;
+		char *text = NULL;
+		size_t len = 0;
+		FILE *mem = open_memstream(&text, &len);
+		bool written = mem && gen_prog(mem, &b->gen);
+		if (mem && fclose(mem)) {
+			written = false;
+		}
+		if (!written) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return EXIT_FAILURE;
+		}
+		double best = -1.;
+		for (int r = 0; r < REPS; ++r) {
+			const double secs = run(b, text, len);
+			if (secs < 0.) {
+				fprintf(stderr, "%s: %s failed\n", progname,
+					b->name);
+				return EXIT_FAILURE;
+			}
+			best = r && best < secs ? best : secs;
+		}
+		free(text);
+
+		if (!baseline) {
+			printf("%-8s %.6e\n", b->name, best);
+			continue;
+		}
+		int k = 0;
+		while (k < nbase && strcmp(names[k], b->name)) {
+			++k;
+		}
+		if (k == nbase) {
+			printf("%-8s %.6e s (no baseline)\n", b->name, best);
+			continue;
+		}
+		const double change = best / base[k] - 1.;
+		const bool worse = change > threshold;
+		printf("%-8s %.6e s vs %.6e s %+7.1lf%%%s\n", b->name, best,
+		       base[k], 100. * change, worse ? " REGRESSION" : "");
+		regressed = regressed || worse;
+	}
+	return regressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,735 @@
+// Differential test of the analyzer against sampling: generate random
+// programs, sample their trajectories on several threads, and check that every
+// final state, and the state of every query hit, lies in the box `analyze`
+// computes for it. A program with a counterexample is shrunk to a smaller one
+// that still has one, and printed with it. The first trajectories of each
+// program are also recorded and replayed, with ITER_MAX and with 1, and must
+// replay to the same final states, and the power of a random number the
+// analysis computes must hold its value computed in long double.
+// Usage: sound [-nPROGRAMS] [-tTRAJECTORIES] [-jTHREADS] [-sSEED] [-zSIZE]
+//              [-iITER_MAX]
+// PROGRAMS is 1000 by default, and 0 runs until interrupted. Each program is
+// sampled TRAJECTORIES times (10000 by default), and has up to SIZE (30)
+// statements. Exits with failure if a counterexample was found.
+#define _POSIX_C_SOURCE 200809L
+#include "analyze.h"
+#include "check.h"
+#include "eval.h"
+#include "gen.h"
+#include "gisa.h"
+#include "output.h"
+#include "record.h"
+#include "rng.h"
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Seconds between progress reports
+#define PROGRESS_SECS 10.
+// Number of trajectories of a program recorded and replayed
+#define REPLAY_TRAJS 100
+
+static const char *progname = "sound";
+
+typedef struct Opts {
+	unsigned long nprogs; // 0 for no limit
+	unsigned long ntrajs;
+	int nthreads;
+	uint64_t seed;
+	int size;
+	int iter_max;
+} Opts;
+
+// A state outside the box the analysis computes for it
+typedef struct Cex {
+	unsigned long traj;
+	// Query hit in the state, -1 for the final state
+	int query;
+	// The trajectory is uninitialized although the analysis says that
+	// none is.
+	bool uninit;
+	double x, y;
+	Box box;
+} Cex;
+
+static pthread_mutex_t report = PTHREAD_MUTEX_INITIALIZER;
+static const Opts *opts;
+static atomic_ulong next_prog;
+static atomic_ulong nprogs, ntrajs, ncexs;
+static double start, last_progress;
+static volatile sig_atomic_t stop;
+
+// Forward declarations for static functions
+static double now(void);
+static void on_stop(int sig);
+static bool in_box(const Box *b, double x, double y);
+static int find_cex(const Prog *prog, const Analysis *a, uint64_t seed,
+		    Cex *cex);
+static int check_replay(const Prog *prog, uint64_t seed, int iter_max,
+			unsigned long *traj);
+static bool check_power(Rng *rng, double *base, int *power);
+static int test(const ASTNode *ast, uint64_t seed, Cex *cex);
+static int kids(ASTNode *node, ASTNode **kid);
+static bool shrink_node(const ASTNode *ast, ASTNode *node, uint64_t seed,
+			Cex *cex);
+static void p_num(FILE *stream, double v);
+static void p_src(FILE *stream, const ASTNode *ast, int indent);
+static void p_cex(FILE *stream, const Cex *cex);
+static void progress(bool force);
+static bool run_prog(unsigned long k);
+static void *work(void *arg);
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void on_stop(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+// Whether (`x`, `y`) lies in `b`. A NaN coordinate lies only in a box
+// unbounded both ways along it, as `analyze` turns NaN bounds into infinities.
+static bool in_box(const Box *b, double x, double y)
+{
+	const bool in_x = (x >= b->xl && x <= b->xu) ||
+			  (isnan(x) && b->xl == -INFINITY && b->xu == INFINITY);
+	const bool in_y = (y >= b->yl && y <= b->yu) ||
+			  (isnan(y) && b->yl == -INFINITY && b->yu == INFINITY);
+	return in_x && in_y;
+}
+
+// Sample the trajectories of `prog` seeded with `seed`, and check them against
+// `a` until a counterexample is found, which is stored in `cex`. A program
+// with queries is sampled twice, without and with checking them, since a
+// trajectory stops where its queries are decided.
+// Returns 1 if found, 0 if not, -1 if failed.
+static int find_cex(const Prog *prog, const Analysis *a, uint64_t seed,
+		    Cex *cex)
+{
+	Check c;
+	if (prog->nqueries && !new_check(&c, prog)) {
+		return -1;
+	}
+	Sampler s = {.prog = prog, .iter_max = opts->iter_max};
+	int found = 0;
+	unsigned long i = 0;
+	for (; !found && i < opts->ntrajs; ++i) {
+		*cex = (Cex){.traj = i, .query = -1, .box = a->final};
+		Env env = {.init = false, .x = 0., .y = 0.};
+		seed_rng(&s.rng, seed, i);
+		s.check = NULL;
+		if (eval(&s, prog->entry, &env)) {
+			cex->uninit = true;
+			found = 1;
+			break;
+		}
+		if (!in_box(&a->final, env.x, env.y)) {
+			cex->x = env.x;
+			cex->y = env.y;
+			found = 1;
+			break;
+		}
+		if (!prog->nqueries) {
+			continue;
+		}
+		env = (Env){.init = false, .x = 0., .y = 0.};
+		seed_rng(&s.rng, seed, i);
+		s.check = &c;
+		start_check(&c, prog);
+		if (eval(&s, prog->entry, &env) == 1) {
+			cex->uninit = true;
+			found = 1;
+			break;
+		}
+		for (int q = 0; q < prog->nqueries; ++q) {
+			const double x = c.at[2 * q];
+			const double y = c.at[2 * q + 1];
+			if (c.hit[q] && !in_box(a->visits + q, x, y)) {
+				*cex = (Cex){i, q, false, x, y, a->visits[q]};
+				found = 1;
+				break;
+			}
+		}
+	}
+	atomic_fetch_add_explicit(&ntrajs, i, memory_order_relaxed);
+	if (prog->nqueries) {
+		free_check(&c);
+	}
+	return found;
+}
+
+// Record the first trajectories of `prog` seeded with `seed`, with `iter_max`,
+// and replay them as `replay` does, which does not know `iter_max`. Returns 1
+// if one replays to another final state, or leaves bits of its record unread,
+// which is stored in `*traj`; 0 if none does; -1 if failed.
+static int check_replay(const Prog *prog, uint64_t seed, int iter_max,
+			unsigned long *traj)
+{
+	Record r = {0};
+	Sampler s = {.prog = prog, .iter_max = iter_max, .rec = &r};
+	Sampler re = {.prog = prog, .iter_max = 0, .rec = &r, .replay = true};
+	int ret = 0;
+	for (unsigned long i = 0; !ret && i < REPLAY_TRAJS; ++i) {
+		Env env = {.init = false, .x = 0., .y = 0.};
+		Env again = env;
+		r.len = r.pos = 0;
+		seed_rng(&s.rng, seed, i);
+		const int e = eval(&s, prog->entry, &env);
+		if (r.err) {
+			ret = -1;
+			break;
+		}
+		if (eval(&re, prog->entry, &again) != e || r.err ||
+		    r.pos != r.len ||
+		    memcmp(&env.x, &again.x, sizeof env.x) ||
+		    memcmp(&env.y, &again.y, sizeof env.y)) {
+			*traj = i;
+			ret = 1;
+		}
+	}
+	free_record(&r);
+	return ret;
+}
+
+// Check the power the analysis computes of a random `a` in [-2, 2) to a
+// random `e` in [2, 16], drawn from `rng`, against the power computed in long
+// double, well within an ulp of a double. Returns `true` if it holds it, and
+// otherwise stores `a` and `e` in `*base` and `*power`.
+static bool check_power(Rng *rng, double *base, int *power)
+{
+	const double a = (next_rng(rng) >> 11) * 0x1.0p-51 - 2.;
+	const int e = 2 + (int)(next_rng(rng) % 15);
+	double lo, hi;
+	pow_range(a, a, e, &lo, &hi);
+	long double want = 1.L;
+	for (int i = 0; i < e; ++i) {
+		want *= a;
+	}
+	*base = a;
+	*power = e;
+	return lo <= want && want <= hi;
+}
+
+// Compile and analyze `ast`, and look for a counterexample seeded with
+// `seed`. Returns as `find_cex` does, or -1 if `ast` does not compile, or the
+// analysis says that a trajectory may be uninitialized.
+static int test(const ASTNode *ast, uint64_t seed, Cex *cex)
+{
+	Prog prog;
+	if (!compile(ast, &prog)) {
+		return -1;
+	}
+	Analysis a;
+	int ret = analyze(&prog, opts->iter_max, &a) ? -1 : 0;
+	if (!ret) {
+		ret = find_cex(&prog, &a, seed, cex);
+	}
+	free_analysis(&a);
+	free_prog(&prog);
+	return ret;
+}
+
+// Store the children of `node` in `kid`. Returns their number.
+static int kids(ASTNode *node, ASTNode **kid)
+{
+	int n = 0;
+	switch (node->type) {
+	case INIT_T:
+		kid[n++] = node->u.init_region;
+		break;
+	case TRANSLATION_T:
+		kid[n++] = node->u.translation_args.u;
+		kid[n++] = node->u.translation_args.v;
+		break;
+	case ROTATION_T:
+		kid[n++] = node->u.rotation_args.u;
+		kid[n++] = node->u.rotation_args.v;
+		kid[n++] = node->u.rotation_args.theta;
+		break;
+	case SEQUENCE_T:
+		kid[n++] = node->u.sequence_ps.p1;
+		kid[n++] = node->u.sequence_ps.p2;
+		break;
+	case OR_T:
+		kid[n++] = node->u.or_ps.p1;
+		kid[n++] = node->u.or_ps.p2;
+		break;
+	case ITER_T:
+		kid[n++] = node->u.iter_body;
+		break;
+	case ASSERT_T:
+	case REACH_T:
+		kid[n++] = node->u.query.region;
+		break;
+	case REGION_T:
+		kid[n++] = node->u.region_ts.t1;
+		kid[n++] = node->u.region_ts.t2;
+		break;
+	case POLYGON_T:
+		kid[n++] = node->u.vertices;
+		break;
+	case VERTEX_T:
+		kid[n++] = node->u.vertex.x;
+		kid[n++] = node->u.vertex.y;
+		if (node->u.vertex.rest) {
+			kid[n++] = node->u.vertex.rest;
+		}
+		break;
+	case RELATIONS_T:
+		kid[n++] = node->u.relations;
+		break;
+	case RELATION_T:
+		kid[n++] = node->u.relation.lhs;
+		kid[n++] = node->u.relation.rhs;
+		if (node->u.relation.rest) {
+			kid[n++] = node->u.relation.rest;
+		}
+		break;
+	case INTERVAL_T:
+		kid[n++] = node->u.interval_ns.n1;
+		kid[n++] = node->u.interval_ns.n2;
+		break;
+	case OP_T:
+		kid[n++] = node->u.op_dat.larg;
+		if (node->u.op_dat.op != NEG) {
+			kid[n++] = node->u.op_dat.rarg;
+		}
+		break;
+	case NUM_T:
+	case VAR_T:
+		break;
+	}
+	return n;
+}
+
+// Shrink the subtree at `node` of the AST `ast` in place, keeping a
+// counterexample seeded with `seed`, which is updated in `cex`: a sequence,
+// `or`, or `iter` is replaced by one of its statements, an operation by one of
+// its operands, a variable by 0, and a number by 0, 1, or its integer part. A
+// node replaced keeps its link in the node list and its id, and the nodes it
+// drops stay there, so that the AST is freed as usual. A subtree shared by
+// hash-consing shrinks wherever it occurs. Returns `true` if shrunk.
+static bool shrink_node(const ASTNode *ast, ASTNode *node, uint64_t seed,
+			Cex *cex)
+{
+	bool shrunk = false;
+	bool again = true;
+	while (again && !stop) {
+		again = false;
+		ASTNode cand[3];
+		int ncands = 0;
+		ASTNode *kid[3];
+		const int nkids = kids(node, kid);
+		if (node->type == SEQUENCE_T || node->type == OR_T ||
+		    node->type == ITER_T || node->type == OP_T) {
+			for (int i = 0; i < nkids; ++i) {
+				cand[ncands++] = *kid[i];
+			}
+		} else if (node->type == VAR_T) {
+			cand[ncands++] = (ASTNode){NUM_T, .u.num = 0.};
+		} else if (node->type == NUM_T) {
+			// Each replacement is simpler than the number, so
+			// that shrinking ends: 0 is kept, 1 becomes 0, and
+			// others become 0, 1, or their integer parts.
+			const double v = node->u.num;
+			const double to[] = {0., 1., trunc(v)};
+			for (int i = 0; v && v != 1. && i < 3; ++i) {
+				if (i < 2 ||
+				    (to[i] != v && to[i] && to[i] != 1.)) {
+					cand[ncands++] =
+					    (ASTNode){NUM_T, .u.num = to[i]};
+				}
+			}
+			if (v == 1.) {
+				cand[ncands++] = (ASTNode){NUM_T, .u.num = 0.};
+			}
+		}
+		for (int i = 0; i < ncands && !again; ++i) {
+			const ASTNode saved = *node;
+			*node = cand[i];
+			node->next = saved.next;
+			node->id = saved.id;
+			Cex c;
+			if (test(ast, seed, &c) == 1) {
+				*cex = c;
+				again = shrunk = true;
+			} else {
+				*node = saved;
+			}
+		}
+	}
+	ASTNode *kid[3];
+	const int nkids = kids(node, kid);
+	for (int i = 0; i < nkids && !stop; ++i) {
+		shrunk = shrink_node(ast, kid[i], seed, cex) || shrunk;
+	}
+	return shrunk;
+}
+
+// Print `v` so that it reads back exactly, and as an operand of any operator.
+static void p_num(FILE *stream, double v)
+{
+	char buf[FMT_DOUBLE_MAX];
+	const int len = fmt_double(buf, v);
+	fprintf(stream, signbit(v) ? "(%.*s)" : "%.*s", len, buf);
+}
+
+// Print the AST `ast` as the source of a program, with its statements
+// indented by `indent` spaces.
+static void p_src(FILE *stream, const ASTNode *ast, int indent)
+{
+	static const char op_char[] = {'+', '-', '*', '/', '^', '-'};
+	switch (ast->type) {
+	case INIT_T:
+		fprintf(stream, "%*sinit(", indent, "");
+		p_src(stream, ast->u.init_region, 0);
+		putc(')', stream);
+		break;
+	case TRANSLATION_T:
+		fprintf(stream, "%*stranslation(", indent, "");
+		p_src(stream, ast->u.translation_args.u, 0);
+		fputs(", ", stream);
+		p_src(stream, ast->u.translation_args.v, 0);
+		putc(')', stream);
+		break;
+	case ROTATION_T:
+		fprintf(stream, "%*srotation(", indent, "");
+		p_src(stream, ast->u.rotation_args.u, 0);
+		fputs(", ", stream);
+		p_src(stream, ast->u.rotation_args.v, 0);
+		fputs(", ", stream);
+		p_src(stream, ast->u.rotation_args.theta, 0);
+		putc(')', stream);
+		break;
+	case SEQUENCE_T:
+		p_src(stream, ast->u.sequence_ps.p1, indent);
+		fputs(";\n", stream);
+		p_src(stream, ast->u.sequence_ps.p2, indent);
+		break;
+	case OR_T:
+		fprintf(stream, "%*s{\n", indent, "");
+		p_src(stream, ast->u.or_ps.p1, indent + 4);
+		fprintf(stream, "\n%*s} or {\n", indent, "");
+		p_src(stream, ast->u.or_ps.p2, indent + 4);
+		fprintf(stream, "\n%*s}", indent, "");
+		break;
+	case ITER_T:
+		fprintf(stream, "%*siter {\n", indent, "");
+		p_src(stream, ast->u.iter_body, indent + 4);
+		fprintf(stream, "\n%*s}", indent, "");
+		break;
+	case ASSERT_T:
+	case REACH_T:
+		fprintf(stream, "%*s%s(", indent, "",
+			ast->type == ASSERT_T ? "assert" : "reach");
+		p_src(stream, ast->u.query.region, 0);
+		putc(')', stream);
+		break;
+	case REGION_T:
+		p_src(stream, ast->u.region_ts.t1, 0);
+		fputs(" * ", stream);
+		p_src(stream, ast->u.region_ts.t2, 0);
+		break;
+	case POLYGON_T:
+		fputs("polygon(", stream);
+		for (const ASTNode *v = ast->u.vertices; v;
+		     v = v->u.vertex.rest) {
+			fputs(v == ast->u.vertices ? "" : ", ", stream);
+			p_src(stream, v, 0);
+		}
+		putc(')', stream);
+		break;
+	case VERTEX_T:
+		putc('(', stream);
+		p_src(stream, ast->u.vertex.x, 0);
+		fputs(", ", stream);
+		p_src(stream, ast->u.vertex.y, 0);
+		putc(')', stream);
+		break;
+	case RELATIONS_T:
+		for (const ASTNode *r = ast->u.relations; r;
+		     r = r->u.relation.rest) {
+			fputs(r == ast->u.relations ? "" : " && ", stream);
+			p_src(stream, r, 0);
+		}
+		break;
+	case RELATION_T:
+		p_src(stream, ast->u.relation.lhs, 0);
+		fputs(" <= ", stream);
+		p_src(stream, ast->u.relation.rhs, 0);
+		break;
+	case INTERVAL_T:
+		putc('[', stream);
+		p_src(stream, ast->u.interval_ns.n1, 0);
+		fputs(", ", stream);
+		p_src(stream, ast->u.interval_ns.n2, 0);
+		putc(']', stream);
+		break;
+	case OP_T:
+		// Parenthesized, so that it is an operand of any operator
+		if (ast->u.op_dat.op == NEG) {
+			fputs("(-", stream);
+			p_src(stream, ast->u.op_dat.larg, 0);
+		} else {
+			putc('(', stream);
+			p_src(stream, ast->u.op_dat.larg, 0);
+			fprintf(stream, " %c ", op_char[ast->u.op_dat.op]);
+			p_src(stream, ast->u.op_dat.rarg, 0);
+		}
+		putc(')', stream);
+		break;
+	case NUM_T:
+		p_num(stream, ast->u.num);
+		break;
+	case VAR_T:
+		putc(ast->u.var == VX ? 'x' : 'y', stream);
+		break;
+	}
+}
+
+static void p_cex(FILE *stream, const Cex *cex)
+{
+	fprintf(stream, "trajectory %lu ", cex->traj);
+	if (cex->uninit) {
+		fputs("is uninitialized, which the analysis rules out\n",
+		      stream);
+		return;
+	}
+	if (cex->query < 0) {
+		fputs("ends", stream);
+	} else {
+		fprintf(stream, "hits query #%d", cex->query + 1);
+	}
+	fprintf(stream, " at (%.17g, %.17g) outside [%.17g, %.17g] x "
+			"[%.17g, %.17g]\n",
+		cex->x, cex->y, cex->box.xl, cex->box.xu, cex->box.yl,
+		cex->box.yu);
+}
+
+// Report the progress to `stderr` if `PROGRESS_SECS` have passed since the
+// last report, or if `force` is set.
+static void progress(bool force)
+{
+	pthread_mutex_lock(&report);
+	const double t = now();
+	if (force || t - last_progress >= PROGRESS_SECS) {
+		last_progress = t;
+		const unsigned long n = atomic_load(&ntrajs);
+		fprintf(stderr,
+			"%s: %lu programs, %lu trajectories (%.3g/s), %lu "
+			"counterexamples\n",
+			progname, atomic_load(&nprogs), n, n / (t - start),
+			atomic_load(&ncexs));
+	}
+	pthread_mutex_unlock(&report);
+}
+
+// Generate, test, and shrink the `k`-th program. Returns `false` if it could
+// not be tested.
+static bool run_prog(unsigned long k)
+{
+	// The shape of the program is drawn as well, so that the generator
+	// covers deep and shallow nests, and long and short polynomials.
+	// Every fourth program has monomials of degrees up to 16, whose powers
+	// take many multiplies, each rounding.
+	Rng rng;
+	seed_rng(&rng, opts->seed, k);
+	const int degrees = k % 4 == 3 ? 17 : 4;
+	const GenOpts gen = {.size = 1 + (int)(next_rng(&rng) % opts->size),
+			     .depth = (int)(next_rng(&rng) % 4),
+			     .degree = (int)(next_rng(&rng) % degrees),
+			     .terms = 1 + (int)(next_rng(&rng) % 4),
+			     .seed = next_rng(&rng)};
+	char *text = NULL;
+	size_t len = 0;
+	FILE *mem = open_memstream(&text, &len);
+	bool written = mem && gen_prog(mem, &gen);
+	if (mem && fclose(mem)) {
+		written = false;
+	}
+	if (!written) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(text);
+		return false;
+	}
+
+	Gisa g;
+	new_gisa(&g, progname);
+	const bool ok = parse_text(&g, text, len);
+	free(text);
+
+	ASTNode *const ast = g.ast;
+	// Replays are checked before `ast` is shrunk.
+	int replayed = ok ? 0 : -1;
+	const int iter_maxes[] = {opts->iter_max, 1};
+	for (int i = 0; !replayed && i < 2; ++i) {
+		Prog prog;
+		unsigned long traj;
+		if (!compile(ast, &prog)) {
+			replayed = -1;
+			break;
+		}
+		replayed = check_replay(&prog, gen.seed, iter_maxes[i], &traj);
+		free_prog(&prog);
+		if (replayed == 1) {
+			atomic_fetch_add(&ncexs, 1);
+			pthread_mutex_lock(&report);
+			printf("program %lu, `generate %d %d %d %d %llu`: "
+			       "trajectory %lu recorded with an ITER_MAX of "
+			       "%d does not replay\n\n",
+			       k, gen.size, gen.depth, gen.degree, gen.terms,
+			       gen.seed, traj, iter_maxes[i]);
+			fflush(stdout);
+			pthread_mutex_unlock(&report);
+		}
+	}
+	double base;
+	int power;
+	if (!check_power(&rng, &base, &power)) {
+		atomic_fetch_add(&ncexs, 1);
+		pthread_mutex_lock(&report);
+		printf("program %lu: the analysis misses %.17g^%d\n\n", k,
+		       base, power);
+		fflush(stdout);
+		pthread_mutex_unlock(&report);
+	}
+	Cex cex;
+	const int found = replayed >= 0 ? test(ast, gen.seed, &cex) : -1;
+	if (found == 1) {
+		atomic_fetch_add(&ncexs, 1);
+		shrink_node(ast, ast, gen.seed, &cex);
+		pthread_mutex_lock(&report);
+		printf("program %lu, `generate %d %d %d %d %llu`: ", k,
+		       gen.size, gen.depth, gen.degree, gen.terms, gen.seed);
+		p_cex(stdout, &cex);
+		puts("shrunk to:");
+		p_src(stdout, ast, 0);
+		puts("\n");
+		fflush(stdout);
+		pthread_mutex_unlock(&report);
+	} else if (found < 0) {
+		fprintf(stderr, "%s: program %lu could not be tested\n",
+			progname, k);
+	}
+	free_gisa(&g);
+	atomic_fetch_add(&nprogs, 1);
+	return found >= 0;
+}
+
+static void *work(void *arg)
+{
+	bool *ok = arg;
+	while (!stop) {
+		const unsigned long k = atomic_fetch_add(&next_prog, 1);
+		if (opts->nprogs && k >= opts->nprogs) {
+			break;
+		}
+		if (!run_prog(k)) {
+			*ok = false;
+			stop = 1;
+		}
+		progress(false);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	Opts o = {.nprogs = 1000,
+		  .ntrajs = 10000,
+		  .nthreads = ncpus > 0 ? (int)ncpus : 1,
+		  .seed = 1,
+		  .size = 30,
+		  .iter_max = 10};
+	bool ok = true;
+	for (int i = 1; ok && i < argc; ++i) {
+		const char *flag = argv[i];
+		const char *arg =
+		    flag[0] == '-' && flag[1] && flag[2] ? flag + 2 : argv[++i];
+		char *end;
+		if (flag[0] != '-' || !arg) {
+			ok = false;
+			break;
+		}
+		const long long v = strtoll(arg, &end, 0);
+		ok = end != arg && !*end && v >= 0;
+		switch (flag[1]) {
+		case 'n':
+			o.nprogs = v;
+			break;
+		case 't':
+			o.ntrajs = v;
+			break;
+		case 'j':
+			o.nthreads = v;
+			ok = ok && v > 0 && v <= 1024;
+			break;
+		case 's':
+			o.seed = v;
+			break;
+		case 'z':
+			o.size = v;
+			ok = ok && v > 0 && v <= 1000000;
+			break;
+		case 'i':
+			o.iter_max = v;
+			ok = ok && v <= 1000000;
+			break;
+		default:
+			ok = false;
+		}
+	}
+	if (!ok) {
+		fprintf(stderr,
+			"usage: %s [-nPROGRAMS] [-tTRAJECTORIES] [-jTHREADS] "
+			"[-sSEED] [-zSIZE] [-iITER_MAX]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+	opts = &o;
+	signal(SIGINT, on_stop);
+	signal(SIGTERM, on_stop);
+
+	start = last_progress = now();
+	pthread_t *threads = malloc(o.nthreads * sizeof *threads);
+	bool *oks = malloc(o.nthreads * sizeof *oks);
+	if (!threads || !oks) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(threads);
+		free(oks);
+		return EXIT_FAILURE;
+	}
+	int started = 0;
+	for (; started < o.nthreads; ++started) {
+		oks[started] = true;
+		if (pthread_create(threads + started, NULL, work,
+				   oks + started)) {
+			perror(progname);
+			stop = 1;
+			ok = false;
+			break;
+		}
+	}
+	for (int i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+		ok = ok && oks[i];
+	}
+	free(threads);
+	free(oks);
+	progress(true);
+	return ok && !atomic_load(&ncexs) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
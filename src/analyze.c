@@ -0,0 +1,508 @@
+#include "analyze.h"
+#include "ast.h"
+#include "compile.h"
+#include "memo.h"
+#include "util.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef struct Interval {
+	double l, u;
+} Interval;
+
+// Abstract state: the box of the states, and whether every trajectory is
+// initialized. An uninitialized trajectory is at the origin, as in `eval`.
+typedef struct State {
+	Box box;
+	bool init;
+} State;
+
+// What `run` works with besides the state. In an incremental analysis, the
+// `Insn`s outside of any `iter` are run through `visit`, which keeps a summary
+// of each in `memo` unless it continues a sequence, as its sequence does.
+typedef struct Analyzer {
+	const Prog *prog;
+	int iter_max;
+	Analysis *a;
+	Memo *memo; // `NULL` if not incremental
+	// For each `Insn`, the first of the queries below it, their number,
+	// and whether it is summarized
+	int *qfirst;
+	int *nq;
+	bool *summarize;
+	int depth; // Number of `iter`s around the `Insn` being run
+} Analyzer;
+
+// What a subtree does from a state: the state it ends in, and the boxes the
+// queries below it are visited in.
+typedef struct Summary {
+	// The structural hash of the subtree, the bits of the state it is run
+	// from, and `iter_max`
+	uint64_t key[7];
+	State out;
+	Box visits[];
+} Summary;
+
+// Forward declarations for static functions
+static Interval widen(double l, double u);
+static Interval iv_add(Interval a, Interval b);
+static Interval iv_sub(Interval a, Interval b);
+static Interval iv_mul(Interval a, Interval b);
+static double pow_bound(double b, int e, bool up);
+static Interval iv_pow(Interval a, int e);
+static Interval iv_cos(Interval a);
+static Interval poly_iv(const Prog *prog, Poly p, const Box *b);
+static Box join(const Box *a, const Box *b);
+static bool box_eq(const Box *a, const Box *b);
+static int run(Analyzer *an, int pc, State *st);
+static void summary_key(const Analyzer *an, int pc, const State *st,
+			uint64_t *key);
+static int visit(Analyzer *an, int pc, State *st);
+static bool prepare(Analyzer *an);
+
+// The interval [`l`, `u`] rounded outward by an ulp, with a NaN bound
+// replaced by an infinity.
+static Interval widen(double l, double u)
+{
+	return (Interval){isnan(l) ? -INFINITY : nextafter(l, -INFINITY),
+			  isnan(u) ? INFINITY : nextafter(u, INFINITY)};
+}
+
+static Interval iv_add(Interval a, Interval b)
+{
+	return widen(a.l + b.l, a.u + b.u);
+}
+
+static Interval iv_sub(Interval a, Interval b)
+{
+	return widen(a.l - b.u, a.u - b.l);
+}
+
+static Interval iv_mul(Interval a, Interval b)
+{
+	const double p[] = {a.l * b.l, a.l * b.u, a.u * b.l, a.u * b.u};
+	double l = p[0];
+	double u = p[0];
+	for (int i = 0; i < 4; ++i) {
+		if (isnan(p[i])) { // 0 * inf
+			return (Interval){-INFINITY, INFINITY};
+		}
+		l = p[i] < l ? p[i] : l;
+		u = p[i] > u ? p[i] : u;
+	}
+	return widen(l, u);
+}
+
+// `b`^`e` for `b` >= 0, rounded down, or up if `up`: each multiply rounds to
+// nearest, within half an ulp, and is then moved an ulp further, so that the
+// error of a power taking many multiplies is still covered.
+static double pow_bound(double b, int e, bool up)
+{
+	const double to = up ? INFINITY : 0.;
+	double r = 1.;
+	for (; e; e >>= 1) {
+		if (e & 1) {
+			r = nextafter(r * b, to);
+		}
+		if (e > 1) {
+			b = nextafter(b * b, to);
+		}
+	}
+	return isnan(r) ? to : r;
+}
+
+static Interval iv_pow(Interval a, int e)
+{
+	if (!e) {
+		return (Interval){1., 1.};
+	}
+	if (isnan(a.l) || isnan(a.u)) {
+		return (Interval){-INFINITY, INFINITY};
+	}
+	if (e % 2) {
+		return (Interval){a.l >= 0. ? pow_bound(a.l, e, false)
+					    : -pow_bound(-a.l, e, true),
+				  a.u >= 0. ? pow_bound(a.u, e, true)
+					    : -pow_bound(-a.u, e, false)};
+	}
+	if (a.l >= 0.) {
+		return (Interval){pow_bound(a.l, e, false),
+				  pow_bound(a.u, e, true)};
+	}
+	if (a.u <= 0.) {
+		return (Interval){pow_bound(-a.u, e, false),
+				  pow_bound(-a.l, e, true)};
+	}
+	return (Interval){0., pow_bound(-a.l > a.u ? -a.l : a.u, e, true)};
+}
+
+void pow_range(double l, double u, int e, double *lo, double *hi)
+{
+	const Interval r = iv_pow((Interval){l, u}, e);
+	*lo = r.l;
+	*hi = r.u;
+}
+
+// Cosine of `a` in radians. The cosine of an infinity is NaN, which only the
+// unbounded interval covers.
+static Interval iv_cos(Interval a)
+{
+	if (isinf(a.l) || isinf(a.u)) {
+		return (Interval){-INFINITY, INFINITY};
+	}
+	if (!(a.u - a.l < 2. * M_PI)) {
+		return (Interval){-1., 1.};
+	}
+	const double cl = cos(a.l);
+	const double cu = cos(a.u);
+	Interval r = widen(cl < cu ? cl : cu, cl > cu ? cl : cu);
+	// Extrema at multiples of pi inside `a`
+	if (ceil(a.l / (2. * M_PI)) <= floor(a.u / (2. * M_PI))) {
+		r.u = 1.;
+	}
+	if (ceil((a.l - M_PI) / (2. * M_PI)) <=
+	    floor((a.u - M_PI) / (2. * M_PI))) {
+		r.l = -1.;
+	}
+	r.l = r.l < -1. ? -1. : r.l;
+	r.u = r.u > 1. ? 1. : r.u;
+	return r;
+}
+
+// Range of `p` over `b`, summed monomial by monomial.
+static Interval poly_iv(const Prog *prog, Poly p, const Box *b)
+{
+	const Interval x = {b->xl, b->xu};
+	const Interval y = {b->yl, b->yu};
+	Interval acc = {0., 0.};
+	for (int i = 0; i < p.len; ++i) {
+		const Mono *m = prog->monos + p.off + i;
+		const Interval t = iv_mul(iv_pow(x, m->px), iv_pow(y, m->py));
+		acc = iv_add(acc, iv_mul((Interval){m->coeff, m->coeff}, t));
+	}
+	return acc;
+}
+
+static Box join(const Box *a, const Box *b)
+{
+	if (a->xl > a->xu) {
+		return *b;
+	}
+	if (b->xl > b->xu) {
+		return *a;
+	}
+	return (Box){a->xl < b->xl ? a->xl : b->xl,
+		     a->xu > b->xu ? a->xu : b->xu,
+		     a->yl < b->yl ? a->yl : b->yl,
+		     a->yu > b->yu ? a->yu : b->yu};
+}
+
+static bool box_eq(const Box *a, const Box *b)
+{
+	return a->xl == b->xl && a->xu == b->xu && a->yl == b->yl &&
+	       a->yu == b->yu;
+}
+
+// Push `st` through the `Insn` at `pc` of `an->prog`, joining the states the
+// queries are visited in into `an->a->visits`.
+// Returns 0 if successful; 1 if a trajectory may be uninitialized, 2 if out of
+// memory.
+static int run(Analyzer *an, int pc, State *st)
+{
+	const Prog *prog = an->prog;
+	const Insn *insn = prog->insns + pc;
+	Box *b = &st->box;
+	int ret = 0;
+	switch (insn->type) {
+	case I_INIT: {
+		if (insn->u.init.shape >= 0) {
+			const Tris *t = prog->shapes + insn->u.init.shape;
+			*b = (Box){t->xl, t->xu, t->yl, t->yu};
+			st->init = true;
+			break;
+		}
+		const Interval xs = poly_iv(prog, insn->u.init.xs, b);
+		const Interval xe = poly_iv(prog, insn->u.init.xe, b);
+		const Interval ys = poly_iv(prog, insn->u.init.ys, b);
+		const Interval ye = poly_iv(prog, insn->u.init.ye, b);
+		*b = (Box){xs.l < xe.l ? xs.l : xe.l, xs.u > xe.u ? xs.u : xe.u,
+			   ys.l < ye.l ? ys.l : ye.l,
+			   ys.u > ye.u ? ys.u : ye.u};
+		st->init = true;
+		break;
+	}
+	case I_TRANSLATION: {
+		if (!st->init) {
+			return 1;
+		}
+		const Interval u = poly_iv(prog, insn->u.translation.u, b);
+		const Interval v = poly_iv(prog, insn->u.translation.v, b);
+		const Interval x = iv_add((Interval){b->xl, b->xu}, u);
+		const Interval y = iv_add((Interval){b->yl, b->yu}, v);
+		*b = (Box){x.l, x.u, y.l, y.u};
+		break;
+	}
+	case I_ROTATION: {
+		if (!st->init) {
+			return 1;
+		}
+		const Interval u = poly_iv(prog, insn->u.rotation.u, b);
+		const Interval v = poly_iv(prog, insn->u.rotation.v, b);
+		const Interval deg = poly_iv(prog, insn->u.rotation.theta, b);
+		const Interval rad =
+		    iv_mul(deg, widen(M_PI / 180., M_PI / 180.));
+		const Interval c = iv_cos(rad);
+		const Interval s =
+		    iv_cos(iv_sub(rad, widen(M_PI / 2., M_PI / 2.)));
+
+		const Interval dx = iv_sub((Interval){b->xl, b->xu}, u);
+		const Interval dy = iv_sub((Interval){b->yl, b->yu}, v);
+		const Interval x =
+		    iv_add(iv_sub(iv_mul(dx, c), iv_mul(dy, s)), u);
+		const Interval y =
+		    iv_add(iv_add(iv_mul(dx, s), iv_mul(dy, c)), v);
+		*b = (Box){x.l, x.u, y.l, y.u};
+		break;
+	}
+	case I_SEQUENCE:
+		ret = visit(an, insn->u.branch.p1, st);
+		if (ret) {
+			return ret;
+		}
+		ret = visit(an, insn->u.branch.p2, st);
+		break;
+	case I_OR: {
+		if (!st->init) {
+			return 1;
+		}
+		State right = *st;
+		ret = visit(an, insn->u.branch.p1, st);
+		if (ret) {
+			return ret;
+		}
+		ret = visit(an, insn->u.branch.p2, &right);
+		st->box = join(&st->box, &right.box);
+		st->init = st->init && right.init;
+		break;
+	}
+	case I_ASSERT:
+	case I_REACH:
+		if (!st->init) {
+			return 1;
+		}
+		an->a->visits[insn->u.query] =
+		    join(&an->a->visits[insn->u.query], b);
+		break;
+	case I_ITER: {
+		if (!st->init) {
+			return 1;
+		}
+		// A_0 = in, A_k = in join body(A_(k - 1)), which holds the
+		// states after up to k iterations.
+		const State in = *st;
+		++an->depth;
+		for (int k = 0; k < an->iter_max; ++k) {
+			State next = *st;
+			ret = visit(an, insn->u.iter_body, &next);
+			if (ret) {
+				break;
+			}
+			next.box = join(&in.box, &next.box);
+			next.init = next.init && in.init;
+			if (box_eq(&next.box, &st->box) &&
+			    next.init == st->init) {
+				break;
+			}
+			*st = next;
+		}
+		--an->depth;
+		break;
+	}
+	}
+	return ret;
+}
+
+static void summary_key(const Analyzer *an, int pc, const State *st,
+			uint64_t *key)
+{
+	key[0] = an->prog->nodes[pc]->hash;
+	memcpy(key + 1, &st->box, 4 * sizeof *key);
+	key[5] = st->init;
+	key[6] = (uint64_t)an->iter_max;
+}
+
+// Push `st` through the `Insn` at `pc` as `run` does, but if it is summarized,
+// from its summary for `st` if kept, and else keeping its summary.
+static int visit(Analyzer *an, int pc, State *st)
+{
+	if (!an->memo || an->depth || !an->summarize[pc]) {
+		return run(an, pc, st);
+	}
+	uint64_t key[7];
+	summary_key(an, pc, st, key);
+	const uint64_t hash = fnv1a(key, sizeof key);
+	const int nq = an->nq[pc];
+	Box *visits = an->a->visits + an->qfirst[pc];
+	const Summary *s = memo_get(an->memo, hash);
+	if (s && !memcmp(s->key, key, sizeof key)) {
+		*st = s->out;
+		for (int q = 0; q < nq; ++q) {
+			visits[q] = join(&visits[q], &s->visits[q]);
+		}
+		return 0;
+	}
+
+	Summary *next = malloc(sizeof *next + nq * sizeof *next->visits);
+	if (!next) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return 2;
+	}
+	// Tell the visits of this run from those before it.
+	for (int q = 0; q < nq; ++q) {
+		next->visits[q] = visits[q];
+		visits[q] = (Box){1., 0., 1., 0.};
+	}
+	const int ret = run(an, pc, st);
+	for (int q = 0; q < nq; ++q) {
+		const Box b = visits[q];
+		visits[q] = join(&next->visits[q], &b);
+		next->visits[q] = b;
+	}
+	if (ret) {
+		free(next);
+		return ret;
+	}
+	memcpy(next->key, key, sizeof key);
+	next->out = *st;
+	// Failing to keep it is harmless.
+	memo_put(an->memo, hash, next);
+	return 0;
+}
+
+// Find the queries below each `Insn` of `an->prog`, which are numbered in
+// order, and which `Insn`s are summarized. Returns `false` if failed.
+static bool prepare(Analyzer *an)
+{
+	const Prog *prog = an->prog;
+	const int n = prog->ninsns;
+	an->qfirst = malloc(n * sizeof *an->qfirst);
+	an->nq = malloc(n * sizeof *an->nq);
+	an->summarize = malloc(n * sizeof *an->summarize);
+	if (!an->qfirst || !an->nq || !an->summarize) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	// The children of an `Insn` come before it.
+	for (int pc = 0; pc < n; ++pc) {
+		const Insn *insn = prog->insns + pc;
+		an->qfirst[pc] = 0;
+		an->nq[pc] = 0;
+		an->summarize[pc] = true;
+		switch (insn->type) {
+		case I_ASSERT:
+		case I_REACH:
+			an->qfirst[pc] = insn->u.query;
+			an->nq[pc] = 1;
+			break;
+		case I_SEQUENCE:
+		case I_OR: {
+			const int p1 = insn->u.branch.p1;
+			const int p2 = insn->u.branch.p2;
+			an->qfirst[pc] =
+			    an->nq[p1] ? an->qfirst[p1] : an->qfirst[p2];
+			an->nq[pc] = an->nq[p1] + an->nq[p2];
+			// Summaries of the rest of a sequence would hold its
+			// queries again and again.
+			if (insn->type == I_SEQUENCE &&
+			    prog->insns[p2].type == I_SEQUENCE) {
+				an->summarize[p2] = false;
+			}
+			break;
+		}
+		case I_ITER:
+			an->qfirst[pc] = an->qfirst[insn->u.iter_body];
+			an->nq[pc] = an->nq[insn->u.iter_body];
+			break;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+int analyze(const Prog *prog, int iter_max, Analysis *a)
+{
+	return analyze_memo(prog, iter_max, NULL, a);
+}
+
+int analyze_memo(const Prog *prog, int iter_max, Memo *memo, Analysis *a)
+{
+	const int n = prog->nqueries ? prog->nqueries : 1;
+	*a = (Analysis){.nqueries = prog->nqueries};
+	if (!(a->visits = malloc(n * sizeof *a->visits))) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return 2;
+	}
+	for (int q = 0; q < n; ++q) {
+		a->visits[q] = (Box){1., 0., 1., 0.};
+	}
+	Analyzer an = {.prog = prog, .iter_max = iter_max, .a = a};
+	if (memo && prog->nodes) {
+		an.memo = memo;
+		if (!prepare(&an)) {
+			free(an.qfirst);
+			free(an.nq);
+			free(an.summarize);
+			free_analysis(a);
+			return 2;
+		}
+	}
+	State st = {.box = {0., 0., 0., 0.}, .init = false};
+	const int ret = visit(&an, prog->entry, &st);
+	a->final = st.box;
+	free(an.qfirst);
+	free(an.nq);
+	free(an.summarize);
+	return ret;
+}
+
+void free_analysis(Analysis *a)
+{
+	free(a->visits);
+	a->visits = NULL;
+}
+
+void p_analysis(FILE *stream, const Analysis *a, const Prog *prog)
+{
+	fprintf(stream, "x in [%lf, %lf], y in [%lf, %lf]\n", a->final.xl,
+		a->final.xu, a->final.yl, a->final.yu);
+	for (int q = 0; q < a->nqueries; ++q) {
+		const Query *query = prog->queries + q;
+		const Box *b = a->visits + q;
+		const char *verdict;
+		if (b->xl > b->xu) {
+			verdict = "unreachable";
+		} else if (region_covers(&query->region, b->xl, b->xu, b->yl,
+					 b->yu)) {
+			verdict = query->is_assert ? "holds"
+						   : "reached whenever visited";
+		} else if (!region_meets(&query->region, b->xl, b->xu, b->yl,
+					 b->yu)) {
+			verdict = query->is_assert ? "fails whenever visited"
+						   : "never reached";
+		} else {
+			verdict = query->is_assert ? "unknown" : "may be reached";
+		}
+		fprintf(stream, "%s #%d (line %d): %s\n",
+			query->is_assert ? "assert" : "reach", q + 1,
+			query->line, verdict);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#include <stdio.h>
+
+// The box [`xl`, `xu`] x [`yl`, `yu`], which is empty if `xl` > `xu`.
+typedef struct Box {
+	double xl, xu, yl, yu;
+} Box;
+
+// Boxes over-approximating the states a program may end in, and the states
+// each of its queries may be visited in.
+typedef struct Analysis {
+	Box final;
+	int nqueries;
+	Box *visits;
+} Analysis;
+
+struct Prog;
+// Abstractly interpret `prog` over boxes into `a`, with the polynomials
+// evaluated in interval arithmetic rounded outward. `or` joins its branches,
+// and `iter` joins the iterates until they are stable or `iter_max` of them
+// are joined.
+// Returns 0 if successful; 1 if a trajectory may be uninitialized, 2 if out
+// of memory.
+int analyze(const struct Prog *prog, int iter_max, Analysis *a);
+
+struct Memo;
+// Analyze `prog` as `analyze` does, but incrementally: take what each subtree
+// outside of the `iter`s does from its summary in `memo`, where kept there by
+// the structural hash of its AST and the state it is run from, and keep the
+// summaries of those run anew in it. Only a program compiled from an AST is
+// analyzed incrementally.
+int analyze_memo(const struct Prog *prog, int iter_max, struct Memo *memo,
+		 Analysis *a);
+
+void free_analysis(Analysis *a);
+
+// Store in [`*lo`, `*hi`] the range of x^`e` over x in [`l`, `u`], rounded
+// outward as the analysis rounds the powers of its polynomials.
+void pow_range(double l, double u, int e, double *lo, double *hi);
+
+// Print the final box and the verdict on each query of `prog` to `stream`.
+void p_analysis(FILE *stream, const Analysis *a, const struct Prog *prog);
+
+#endif /* ifndef ANALYZE_H */
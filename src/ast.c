@@ -1,148 +1,400 @@
 #include "ast.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <tgmath.h>
 #define EPSILON 1E-6
 
-// Initialize `INIT_T` ASTNode. Returns `NULL` if failed.
-ASTNode *init_node(ASTNode **nlist, ASTNode *region)
+// Initial number of slots of the table of a `NodeList`
+#define NODES_MIN 64
+
+_Thread_local Tally ast_tally = {0};
+
+// Forward declarations for static functions
+static ASTNode *alloc_node(void);
+static uint64_t mix(uint64_t h, uint64_t v);
+static uint64_t child_hash(const ASTNode *n);
+static void set_hash(ASTNode *n);
+static int children(const ASTNode *n, ASTNode **kid);
+static bool same(const ASTNode *a, const ASTNode *b);
+static ASTNode **find_node(const NodeList *nlist, const ASTNode *n);
+static bool grow_table(NodeList *nlist);
+static ASTNode *add_node(NodeList *nlist, ASTNode node, bool share);
+
+// Allocate an ASTNode, tallying it.
+static ASTNode *alloc_node(void)
 {
 	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	if (n) {
+		tally_alloc(&ast_tally, sizeof *n);
 	}
-	*n = (ASTNode){INIT_T, .u.init_region = region,
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
 	return n;
 }
 
-// Initialize `TRANSLATION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *translation_node(ASTNode **nlist, ASTNode *u, ASTNode *v)
+// Fold `v` into the hash `h` with the finalizer of SplitMix64.
+static uint64_t mix(uint64_t h, uint64_t v)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	uint64_t z = (h * 0x100000001b3 ^ v) + 0x9e3779b97f4a7c15;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+static uint64_t child_hash(const ASTNode *n)
+{
+	return n ? n->hash : 0;
+}
+
+// Hash `n` from its type, its data, and the hashes of its children, which
+// are hashed already since the parser builds the tree bottom-up.
+static void set_hash(ASTNode *n)
+{
+	uint64_t h = mix(0, n->type);
+	switch (n->type) {
+	case INIT_T:
+		h = mix(h, child_hash(n->u.init_region));
+		break;
+	case TRANSLATION_T:
+		h = mix(h, child_hash(n->u.translation_args.u));
+		h = mix(h, child_hash(n->u.translation_args.v));
+		break;
+	case ROTATION_T:
+		h = mix(h, child_hash(n->u.rotation_args.u));
+		h = mix(h, child_hash(n->u.rotation_args.v));
+		h = mix(h, child_hash(n->u.rotation_args.theta));
+		break;
+	case SEQUENCE_T:
+	case OR_T:
+		// `sequence_ps` and `or_ps` share the same layout.
+		h = mix(h, child_hash(n->u.sequence_ps.p1));
+		h = mix(h, child_hash(n->u.sequence_ps.p2));
+		break;
+	case ITER_T:
+		h = mix(h, child_hash(n->u.iter_body));
+		break;
+	case ASSERT_T:
+	case REACH_T:
+		h = mix(h, child_hash(n->u.query.region));
+		break;
+	case REGION_T:
+		h = mix(h, child_hash(n->u.region_ts.t1));
+		h = mix(h, child_hash(n->u.region_ts.t2));
+		break;
+	case POLYGON_T:
+		h = mix(h, child_hash(n->u.vertices));
+		break;
+	case VERTEX_T:
+		h = mix(h, child_hash(n->u.vertex.x));
+		h = mix(h, child_hash(n->u.vertex.y));
+		h = mix(h, child_hash(n->u.vertex.rest));
+		break;
+	case RELATIONS_T:
+		h = mix(h, child_hash(n->u.relations));
+		break;
+	case RELATION_T:
+		h = mix(h, child_hash(n->u.relation.lhs));
+		h = mix(h, child_hash(n->u.relation.rhs));
+		h = mix(h, child_hash(n->u.relation.rest));
+		break;
+	case INTERVAL_T:
+		h = mix(h, child_hash(n->u.interval_ns.n1));
+		h = mix(h, child_hash(n->u.interval_ns.n2));
+		break;
+	case OP_T:
+		h = mix(h, n->u.op_dat.op);
+		h = mix(h, child_hash(n->u.op_dat.larg));
+		h = mix(h, child_hash(n->u.op_dat.rarg));
+		break;
+	case NUM_T: {
+		uint64_t bits;
+		memcpy(&bits, &n->u.num, sizeof bits);
+		h = mix(h, bits);
+		break;
 	}
-	*n = (ASTNode){TRANSLATION_T, .u.translation_args = {u, v},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	case VAR_T:
+		h = mix(h, n->u.var);
+		break;
+	}
+	n->hash = h;
 }
 
-// Initialize `ROTATION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *rotation_node(ASTNode **nlist, ASTNode *u, ASTNode *v, ASTNode *theta)
+// Collect the children of `n` into `kid`, `NULL` ones included. Returns their
+// number.
+static int children(const ASTNode *n, ASTNode **kid)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	switch (n->type) {
+	case INIT_T:
+		kid[0] = n->u.init_region;
+		return 1;
+	case TRANSLATION_T:
+		kid[0] = n->u.translation_args.u;
+		kid[1] = n->u.translation_args.v;
+		return 2;
+	case ROTATION_T:
+		kid[0] = n->u.rotation_args.u;
+		kid[1] = n->u.rotation_args.v;
+		kid[2] = n->u.rotation_args.theta;
+		return 3;
+	case SEQUENCE_T:
+	case OR_T:
+		kid[0] = n->u.sequence_ps.p1;
+		kid[1] = n->u.sequence_ps.p2;
+		return 2;
+	case ITER_T:
+		kid[0] = n->u.iter_body;
+		return 1;
+	case ASSERT_T:
+	case REACH_T:
+		kid[0] = n->u.query.region;
+		return 1;
+	case REGION_T:
+		kid[0] = n->u.region_ts.t1;
+		kid[1] = n->u.region_ts.t2;
+		return 2;
+	case POLYGON_T:
+		kid[0] = n->u.vertices;
+		return 1;
+	case VERTEX_T:
+		kid[0] = n->u.vertex.x;
+		kid[1] = n->u.vertex.y;
+		kid[2] = n->u.vertex.rest;
+		return 3;
+	case RELATIONS_T:
+		kid[0] = n->u.relations;
+		return 1;
+	case RELATION_T:
+		kid[0] = n->u.relation.lhs;
+		kid[1] = n->u.relation.rhs;
+		kid[2] = n->u.relation.rest;
+		return 3;
+	case INTERVAL_T:
+		kid[0] = n->u.interval_ns.n1;
+		kid[1] = n->u.interval_ns.n2;
+		return 2;
+	case OP_T:
+		kid[0] = n->u.op_dat.larg;
+		kid[1] = n->u.op_dat.rarg;
+		return 2;
+	case NUM_T:
+	case VAR_T:
+		break;
 	}
-	*n = (ASTNode){ROTATION_T, .u.rotation_args = {u, v, theta},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return 0;
 }
 
-// Initialize `SEQUENCE_T` ASTNode. Returns `NULL` if failed.
-ASTNode *sequence_node(ASTNode **nlist, ASTNode *p1, ASTNode *p2)
+// Whether `a` and `b` have the same type and data, and the same children. The
+// children are compared by address, as they are shared already.
+static bool same(const ASTNode *a, const ASTNode *b)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	if (a->type != b->type) {
+		return false;
 	}
-	*n = (ASTNode){SEQUENCE_T, .u.sequence_ps = {p1, p2},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	switch (a->type) {
+	case OP_T:
+		if (a->u.op_dat.op != b->u.op_dat.op) {
+			return false;
+		}
+		break;
+	case NUM_T:
+		// Tells 0 from -0.
+		return !memcmp(&a->u.num, &b->u.num, sizeof a->u.num);
+	case VAR_T:
+		return a->u.var == b->u.var;
+	default:
+		break;
+	}
+	ASTNode *ka[3];
+	ASTNode *kb[3];
+	const int n = children(a, ka);
+	children(b, kb);
+	return !memcmp(ka, kb, n * sizeof *ka);
 }
 
-// Initialize `OR_T` ASTNode. Returns `NULL` if failed.
-ASTNode *or_node(ASTNode **nlist, ASTNode *p1, ASTNode *p2)
+// The slot of the node equal to `n` in the table of `nlist`, or the free slot
+// it would go in.
+static ASTNode **find_node(const NodeList *nlist, const ASTNode *n)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	ASTNode **t = nlist->table;
+	size_t i = n->hash & (nlist->cap - 1);
+	while (t[i] && (t[i]->hash != n->hash || !same(t[i], n))) {
+		i = (i + 1) & (nlist->cap - 1);
 	}
-	*n = (ASTNode){OR_T, .u.or_ps = {p1, p2},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return t + i;
 }
 
-// Initialize `ITER_T` ASTNode. Returns `NULL` if failed.
-ASTNode *iter_node(ASTNode **nlist, ASTNode *body)
+// Double the table of `nlist`.
+static bool grow_table(NodeList *nlist)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
+	const size_t cap = nlist->cap ? 2 * nlist->cap : NODES_MIN;
+	ASTNode **table = calloc(cap, sizeof *table);
+	if (!table) {
+		return false;
 	}
-	*n = (ASTNode){ITER_T, .u.iter_body = body,
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	const NodeList next = {.table = table, .cap = cap};
+	for (size_t i = 0; i < nlist->cap; ++i) {
+		if (nlist->table[i]) {
+			*find_node(&next, nlist->table[i]) = nlist->table[i];
+		}
+	}
+	free(nlist->table);
+	nlist->table = table;
+	nlist->cap = cap;
+	return true;
 }
 
-// Initialize `REGION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *region_node(ASTNode **nlist, ASTNode *t1, ASTNode *t2)
+// Build `node` into `nlist`, or if `share`, return the equal node built
+// already if any. Returns `NULL` if failed.
+static ASTNode *add_node(NodeList *nlist, ASTNode node, bool share)
 {
-	ASTNode *n = malloc(sizeof *n);
+	set_hash(&node);
+	ASTNode **slot = NULL;
+	if (share) {
+		// Queries are counted too, which only grows the table sooner.
+		if (2 * ((size_t)nlist->len + 1) > nlist->cap &&
+		    !grow_table(nlist)) {
+			return NULL;
+		}
+		slot = find_node(nlist, &node);
+		if (*slot) {
+			return *slot;
+		}
+	}
+	ASTNode *n = alloc_node();
 	if (!n) {
 		return NULL;
 	}
-	*n = (ASTNode){REGION_T, .u.region_ts = {t1, t2},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
+	node.id = nlist->len++;
+	node.nparents = 0;
+	node.next = nlist->head;
+	*n = node;
+	ASTNode *kid[3];
+	const int nkids = children(n, kid);
+	for (int i = 0; i < nkids; ++i) {
+		if (kid[i]) {
+			++kid[i]->nparents;
+		}
+	}
+	nlist->head = n;
+	if (slot) {
+		*slot = n;
+	}
 	return n;
 }
 
+// Initialize `INIT_T` ASTNode. Returns `NULL` if failed.
+ASTNode *init_node(NodeList *nlist, ASTNode *region)
+{
+	return add_node(nlist, (ASTNode){INIT_T, .u.init_region = region},
+			true);
+}
+
+// Initialize `TRANSLATION_T` ASTNode. Returns `NULL` if failed.
+ASTNode *translation_node(NodeList *nlist, ASTNode *u, ASTNode *v)
+{
+	return add_node(
+	    nlist, (ASTNode){TRANSLATION_T, .u.translation_args = {u, v}},
+	    true);
+}
+
+// Initialize `ROTATION_T` ASTNode. Returns `NULL` if failed.
+ASTNode *rotation_node(NodeList *nlist, ASTNode *u, ASTNode *v, ASTNode *theta)
+{
+	return add_node(
+	    nlist, (ASTNode){ROTATION_T, .u.rotation_args = {u, v, theta}},
+	    true);
+}
+
+// Initialize `SEQUENCE_T` ASTNode. Returns `NULL` if failed.
+ASTNode *sequence_node(NodeList *nlist, ASTNode *p1, ASTNode *p2)
+{
+	return add_node(nlist, (ASTNode){SEQUENCE_T, .u.sequence_ps = {p1, p2}},
+			true);
+}
+
+// Initialize `OR_T` ASTNode. Returns `NULL` if failed.
+ASTNode *or_node(NodeList *nlist, ASTNode *p1, ASTNode *p2)
+{
+	return add_node(nlist, (ASTNode){OR_T, .u.or_ps = {p1, p2}}, true);
+}
+
+// Initialize `ITER_T` ASTNode. Returns `NULL` if failed.
+ASTNode *iter_node(NodeList *nlist, ASTNode *body)
+{
+	return add_node(nlist, (ASTNode){ITER_T, .u.iter_body = body}, true);
+}
+
+// Initialize `ASSERT_T` or `REACH_T` ASTNode of `region` on line `line`.
+// Returns `NULL` if failed.
+ASTNode *query_node(NodeList *nlist, int type, ASTNode *region, int line)
+{
+	return add_node(nlist, (ASTNode){type, .u.query = {region, line}},
+			false);
+}
+
+// Initialize `REGION_T` ASTNode. Returns `NULL` if failed.
+ASTNode *region_node(NodeList *nlist, ASTNode *t1, ASTNode *t2)
+{
+	return add_node(nlist, (ASTNode){REGION_T, .u.region_ts = {t1, t2}},
+			true);
+}
+
+// Initialize `POLYGON_T` ASTNode. Returns `NULL` if failed.
+ASTNode *polygon_node(NodeList *nlist, ASTNode *vertices)
+{
+	return add_node(nlist, (ASTNode){POLYGON_T, .u.vertices = vertices},
+			true);
+}
+
+// Initialize `VERTEX_T` ASTNode followed by `rest`. Returns `NULL` if failed.
+ASTNode *vertex_node(NodeList *nlist, ASTNode *x, ASTNode *y, ASTNode *rest)
+{
+	return add_node(nlist, (ASTNode){VERTEX_T, .u.vertex = {x, y, rest}},
+			true);
+}
+
+// Initialize `RELATIONS_T` ASTNode. Returns `NULL` if failed.
+ASTNode *relations_node(NodeList *nlist, ASTNode *relations)
+{
+	return add_node(nlist,
+			(ASTNode){RELATIONS_T, .u.relations = relations}, true);
+}
+
+// Initialize `RELATION_T` ASTNode followed by `rest`. Returns `NULL` if failed.
+ASTNode *relation_node(NodeList *nlist, ASTNode *lhs, ASTNode *rhs,
+		       ASTNode *rest)
+{
+	return add_node(
+	    nlist, (ASTNode){RELATION_T, .u.relation = {lhs, rhs, rest}},
+	    true);
+}
+
 // Initialize `INTERVAL_T` ASTNode. Returns `NULL` if failed.
-ASTNode *interval_node(ASTNode **nlist, ASTNode *n1, ASTNode *n2)
+ASTNode *interval_node(NodeList *nlist, ASTNode *n1, ASTNode *n2)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
-	}
-	*n = (ASTNode){INTERVAL_T, .u.interval_ns = {n1, n2},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return add_node(nlist, (ASTNode){INTERVAL_T, .u.interval_ns = {n1, n2}},
+			true);
 }
 
 // Initialize `OP_T` ASTNode. Returns `NULL` if failed.
-ASTNode *op_node(ASTNode **nlist, enum Op op, ASTNode *larg, ASTNode *rarg)
+ASTNode *op_node(NodeList *nlist, enum Op op, ASTNode *larg, ASTNode *rarg)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
-	}
-	*n = (ASTNode){OP_T, .u.op_dat = {op, larg, rarg},
-		       .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return add_node(nlist, (ASTNode){OP_T, .u.op_dat = {op, larg, rarg}},
+			true);
 }
 
 // Initialize `NUM_T` ASTNode. Returns `NULL` if failed.
-ASTNode *num_node(ASTNode **nlist, double num)
+ASTNode *num_node(NodeList *nlist, double num)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
-	}
-	*n = (ASTNode){NUM_T, .u.num = num, .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return add_node(nlist, (ASTNode){NUM_T, .u.num = num}, true);
 }
 
 // Initialize `VAR_T` ASTNode. Returns `NULL` if failed.
-ASTNode *var_node(ASTNode **nlist, Var var)
+ASTNode *var_node(NodeList *nlist, Var var)
 {
-	ASTNode *n = malloc(sizeof *n);
-	if (!n) {
-		return NULL;
-	}
-	*n = (ASTNode){VAR_T, .u.var = var, .next = *nlist ? *nlist : NULL};
-	*nlist = n;
-	return n;
+	return add_node(nlist, (ASTNode){VAR_T, .u.var = var}, true);
 }
 
 // Print the S-expression of the AST `ast`.
@@ -184,6 +436,39 @@ void p_sexp_ast(FILE *stream, const ASTNode *ast)
 		fputs("iter ", stream);
 		p_sexp_ast(stream, ast->u.iter_body);
 		break;
+	case ASSERT_T:
+	case REACH_T:
+		fputs(ast->type == ASSERT_T ? "assert " : "reach ", stream);
+		p_sexp_ast(stream, ast->u.query.region);
+		break;
+	case POLYGON_T:
+		fputs("polygon", stream);
+		for (const ASTNode *v = ast->u.vertices; v;
+		     v = v->u.vertex.rest) {
+			putc(' ', stream);
+			p_sexp_ast(stream, v);
+		}
+		break;
+	case VERTEX_T:
+		fputs("vertex ", stream);
+		p_sexp_ast(stream, ast->u.vertex.x);
+		putc(' ', stream);
+		p_sexp_ast(stream, ast->u.vertex.y);
+		break;
+	case RELATIONS_T:
+		fputs("and", stream);
+		for (const ASTNode *r = ast->u.relations; r;
+		     r = r->u.relation.rest) {
+			putc(' ', stream);
+			p_sexp_ast(stream, r);
+		}
+		break;
+	case RELATION_T:
+		fputs("<= ", stream);
+		p_sexp_ast(stream, ast->u.relation.lhs);
+		putc(' ', stream);
+		p_sexp_ast(stream, ast->u.relation.rhs);
+		break;
 	case REGION_T:
 		fputs("region ", stream);
 		p_sexp_ast(stream, ast->u.region_ts.t1);
@@ -224,11 +509,14 @@ void p_sexp_ast(FILE *stream, const ASTNode *ast)
 	putc(')', stream);
 }
 
-void free_nodes(ASTNode *nlist)
+void free_nodes(NodeList *nlist)
 {
-	if (!nlist) {
-		return;
+	while (nlist->head) {
+		ASTNode *n = nlist->head;
+		nlist->head = n->next;
+		tally_free(&ast_tally, sizeof *n);
+		free(n);
 	}
-	free_nodes(nlist->next);
-	free(nlist);
+	free(nlist->table);
+	*nlist = (NodeList){0};
 }
@@ -1,5 +1,7 @@
 #ifndef AST_H
 #define AST_H
+#include "util.h"
+#include <stdint.h>
 #include <stdio.h>
 
 typedef enum Var { VX = 'X', VY = 'Y' } Var;
@@ -11,13 +13,19 @@ typedef struct ASTNode {
 	       SEQUENCE_T,
 	       OR_T,
 	       ITER_T,
+	       ASSERT_T,
+	       REACH_T,
 	       REGION_T,
+	       POLYGON_T,
+	       VERTEX_T,
+	       RELATIONS_T,
+	       RELATION_T,
 	       INTERVAL_T,
 	       OP_T,
 	       NUM_T,
 	       VAR_T } type;
 	union {
-		// INIT_T
+		// INIT_T: `REGION_T`, `POLYGON_T`, or `RELATIONS_T`
 		struct ASTNode *init_region;
 		// TRANSLATION_T
 		struct {
@@ -42,11 +50,32 @@ typedef struct ASTNode {
 		} or_ps;
 		// ITER_T
 		struct ASTNode *iter_body;
+		// ASSERT_T, REACH_T
+		struct {
+			struct ASTNode *region; // As for `INIT_T`
+			int line;
+		} query;
 		// REGION_T,
 		struct {
 			struct ASTNode *t1;
 			struct ASTNode *t2;
 		} region_ts;
+		// POLYGON_T
+		struct ASTNode *vertices;
+		// VERTEX_T, linked in order through `rest`
+		struct {
+			struct ASTNode *x;
+			struct ASTNode *y;
+			struct ASTNode *rest;
+		} vertex;
+		// RELATIONS_T
+		struct ASTNode *relations;
+		// RELATION_T, `lhs` <= `rhs`, linked in order through `rest`
+		struct {
+			struct ASTNode *lhs;
+			struct ASTNode *rhs;
+			struct ASTNode *rest;
+		} relation;
 		// INTERVAL_T
 		struct {
 			struct ASTNode *n1;
@@ -62,44 +91,85 @@ typedef struct ASTNode {
 		// VAR_T
 		Var var;
 	} u;
+	// Structural hash of the subtree, which leaves out the lines of
+	// queries: equal subtrees have equal hashes wherever they are.
+	uint64_t hash;
+	// Index of the node in its `NodeList`, greater than those of its
+	// children, so that passes may keep a result per node in an array
+	int id;
+	// Number of times it is a child, counting a node built once: a subtree
+	// with more than one is shared.
+	int nparents;
 	struct ASTNode *next;
 } ASTNode;
 
+// The nodes of an AST, hash-consed: building a node equal to one built
+// already, with the same data and the very same children, returns that one,
+// so that repeated statements and subexpressions are kept once. Queries are
+// never shared, as each is numbered on its own.
+typedef struct NodeList {
+	ASTNode *head;	 // Owns all the nodes, linked through `next`
+	ASTNode **table; // Open addressing by hash, at most half full
+	size_t cap;	 // A power of 2, or 0
+	int len;	 // Number of nodes
+} NodeList;
+
+// Allocations of ASTNodes so far on the calling thread, for profiling
+extern _Thread_local Tally ast_tally;
+
 // Initialize `INIT_T` ASTNode. Returns `NULL` if failed.
-ASTNode *init_node(ASTNode **nlist, ASTNode *region);
+ASTNode *init_node(NodeList *nlist, ASTNode *region);
 
 // Initialize `TRANSLATION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *translation_node(ASTNode **nlist, ASTNode *u, ASTNode *v);
+ASTNode *translation_node(NodeList *nlist, ASTNode *u, ASTNode *v);
 
 // Initialize `ROTATION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *rotation_node(ASTNode **nlist, ASTNode *u, ASTNode *v, ASTNode *theta);
+ASTNode *rotation_node(NodeList *nlist, ASTNode *u, ASTNode *v, ASTNode *theta);
 
 // Initialize `SEQUENCE_T` ASTNode. Returns `NULL` if failed.
-ASTNode *sequence_node(ASTNode **nlist, ASTNode *p1, ASTNode *p2);
+ASTNode *sequence_node(NodeList *nlist, ASTNode *p1, ASTNode *p2);
 
 // Initialize `OR_T` ASTNode. Returns `NULL` if failed.
-ASTNode *or_node(ASTNode **nlist, ASTNode *p1, ASTNode *p2);
+ASTNode *or_node(NodeList *nlist, ASTNode *p1, ASTNode *p2);
 
 // Initialize `ITER_T` ASTNode. Returns `NULL` if failed.
-ASTNode *iter_node(ASTNode **nlist, ASTNode *body);
+ASTNode *iter_node(NodeList *nlist, ASTNode *body);
+
+// Initialize `ASSERT_T` or `REACH_T` ASTNode of `region` on line `line`.
+// Returns `NULL` if failed.
+ASTNode *query_node(NodeList *nlist, int type, ASTNode *region, int line);
 
 // Initialize `REGION_T` ASTNode. Returns `NULL` if failed.
-ASTNode *region_node(ASTNode **nlist, ASTNode *t1, ASTNode *t2);
+ASTNode *region_node(NodeList *nlist, ASTNode *t1, ASTNode *t2);
+
+// Initialize `POLYGON_T` ASTNode. Returns `NULL` if failed.
+ASTNode *polygon_node(NodeList *nlist, ASTNode *vertices);
+
+// Initialize `VERTEX_T` ASTNode followed by `rest`. Returns `NULL` if failed.
+ASTNode *vertex_node(NodeList *nlist, ASTNode *x, ASTNode *y, ASTNode *rest);
+
+// Initialize `RELATIONS_T` ASTNode. Returns `NULL` if failed.
+ASTNode *relations_node(NodeList *nlist, ASTNode *relations);
+
+// Initialize `RELATION_T` ASTNode of `lhs` <= `rhs` followed by `rest`.
+// Returns `NULL` if failed.
+ASTNode *relation_node(NodeList *nlist, ASTNode *lhs, ASTNode *rhs,
+		       ASTNode *rest);
 
 // Initialize `INTERVAL_T` ASTNode. Returns `NULL` if failed.
-ASTNode *interval_node(ASTNode **nlist, ASTNode *n1, ASTNode *n2);
+ASTNode *interval_node(NodeList *nlist, ASTNode *n1, ASTNode *n2);
 
 // Initialize `OP_T` ASTNode. Returns `NULL` if failed.
-ASTNode *op_node(ASTNode **nlist, enum Op op, ASTNode *larg, ASTNode *rarg);
+ASTNode *op_node(NodeList *nlist, enum Op op, ASTNode *larg, ASTNode *rarg);
 
 // Initialize `INUM_T` ASTNode. Returns `NULL` if failed.
-ASTNode *inum_node(ASTNode **nlist, long inum);
+ASTNode *inum_node(NodeList *nlist, long inum);
 
 // Initialize `NUM_T` ASTNode. Returns `NULL` if failed.
-ASTNode *num_node(ASTNode **nlist, double num);
+ASTNode *num_node(NodeList *nlist, double num);
 
 // Initialize `VAR_T` ASTNode. Returns `NULL` if failed.
-ASTNode *var_node(ASTNode **nlist, Var var);
+ASTNode *var_node(NodeList *nlist, Var var);
 
 // Print the S-expression of the AST `ast` to `stream`.
 // You can use the output and pipe it into a LISP, e.g., Chicken Scheme. For
@@ -109,6 +179,6 @@ ASTNode *var_node(ASTNode **nlist, Var var);
 // program.
 void p_sexp_ast(FILE *stream, const ASTNode *ast);
 
-void free_nodes(ASTNode *nlist);
+void free_nodes(NodeList *nlist);
 
 #endif /* ifndef AST_H */
@@ -0,0 +1,287 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "gisa.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// A program of the batch
+typedef struct Item {
+	char *path;
+	size_t index; // Among the files of the batch
+	off_t size;   // -1 if unknown
+} Item;
+
+// The programs of a batch, largest first, and the next one to run. Results
+// are printed under the lock, so that their lines do not interleave.
+typedef struct Batch {
+	pthread_mutex_t lock;
+	Item *items;
+	size_t len, cap;
+	size_t next;
+	size_t failed;
+	bool write_err;
+	const BatchOpts *o;
+} Batch;
+
+// Forward declarations for static functions
+static double now(void);
+static bool add_item(Batch *b, const char *path);
+static bool read_manifest(Batch *b, const char *path);
+static int by_size(const void *p, const void *q);
+static void p_json_string(FILE *stream, const char *s, size_t len);
+static const char *run_item(const BatchOpts *o, const Item *it, FILE *out,
+			    char *err, size_t err_len);
+static void *work(void *arg);
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+// Add a copy of `path` to the programs of `b`. Returns `false` if failed.
+static bool add_item(Batch *b, const char *path)
+{
+	if (b->len == b->cap) {
+		const size_t cap = b->cap ? 2 * b->cap : 64;
+		Item *items = realloc(b->items, cap * sizeof *items);
+		if (!items) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		b->items = items;
+		b->cap = cap;
+	}
+	char *copy = malloc(strlen(path) + 1);
+	if (!copy) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	strcpy(copy, path);
+	struct stat st;
+	b->items[b->len] = (Item){.path = copy,
+				  .index = b->len,
+				  .size = stat(path, &st) ? -1 : st.st_size};
+	++b->len;
+	return true;
+}
+
+// Add the files listed in the manifest at `path` to `b`. Returns `false` if
+// failed, which has been reported.
+static bool read_manifest(Batch *b, const char *path)
+{
+	const bool std = !strcmp(path, "-");
+	errno = 0;
+	FILE *in = std ? stdin : fopen(path, "r");
+	if (!in) {
+		fprintf(stderr, "%s: cannot access '%s': %s\n", b->o->name,
+			path, strerror(errno));
+		return false;
+	}
+	bool ok = true;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	while (ok && (len = getline(&line, &cap, in)) >= 0) {
+		while (len && strchr("\r\n", line[len - 1])) {
+			line[--len] = '\0';
+		}
+		if (len && line[0] != '#') {
+			ok = add_item(b, line);
+		}
+	}
+	if (ok && ferror(in)) {
+		fprintf(stderr, "%s: read error '%s': %s\n", b->o->name, path,
+			strerror(errno));
+		ok = false;
+	}
+	free(line);
+	if (!std) {
+		fclose(in);
+	}
+	return ok;
+}
+
+// Order items by decreasing size, and then by index.
+static int by_size(const void *p, const void *q)
+{
+	const Item *a = p, *b = q;
+	if (a->size != b->size) {
+		return a->size < b->size ? 1 : -1;
+	}
+	return (a->index > b->index) - (a->index < b->index);
+}
+
+// Print the `len` bytes of `s` as a JSON string.
+static void p_json_string(FILE *stream, const char *s, size_t len)
+{
+	putc('"', stream);
+	for (size_t i = 0; i < len; ++i) {
+		const unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			putc('\\', stream);
+			putc(c, stream);
+		} else if (c == '\n') {
+			fputs("\\n", stream);
+		} else if (c < 0x20) {
+			fprintf(stream, "\\u%04x", c);
+		} else {
+			putc(c, stream);
+		}
+	}
+	putc('"', stream);
+}
+
+// Run the job of `o` on the program `it`, and print its output to `out`.
+// Returns `NULL` if successful, or what failed, possibly written into `err` of
+// `err_len` bytes.
+static const char *run_item(const BatchOpts *o, const Item *it, FILE *out,
+			    char *err, size_t err_len)
+{
+	errno = 0;
+	FILE *in = fopen(it->path, "r");
+	struct stat st;
+	if (!in || fstat(fileno(in), &st)) {
+		snprintf(err, err_len, "cannot access: ");
+		strerror_r(errno, err + strlen(err), err_len - strlen(err));
+		if (in) {
+			fclose(in);
+		}
+		return err;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		// The scanner would exit on failing to read.
+		fclose(in);
+		return "not a regular file";
+	}
+	const char *msg = NULL;
+	Gisa g;
+	new_gisa(&g, it->path);
+	if (!(o->cache ? load_gisa(&g, in, o->cache) : parse_file(&g, in))) {
+		msg = "cannot parse the program";
+	} else if (!g.compiled && !compile_gisa(&g)) {
+		msg = "polynomial evaluation failed";
+	} else {
+		msg = job_error(run_job(&o->job, &g.prog, out));
+	}
+	free_gisa(&g);
+	fclose(in);
+	return msg;
+}
+
+static void *work(void *arg)
+{
+	Batch *b = arg;
+	char err[256];
+	for (;;) {
+		pthread_mutex_lock(&b->lock);
+		const Item *it = b->next < b->len ? b->items + b->next++ : NULL;
+		pthread_mutex_unlock(&b->lock);
+		if (!it) {
+			break;
+		}
+
+		char *buf = NULL;
+		size_t size = 0;
+		FILE *out = open_memstream(&buf, &size);
+		const double start = now();
+		const char *msg = "out of memory";
+		if (out) {
+			msg = run_item(b->o, it, out, err, sizeof err);
+			if (fflush(out) && !msg) {
+				msg = "out of memory";
+			}
+		}
+		const double secs = now() - start;
+
+		pthread_mutex_lock(&b->lock);
+		fputs("{\"file\":", stdout);
+		p_json_string(stdout, it->path, strlen(it->path));
+		printf(",\"index\":%zu,\"ok\":%s", it->index,
+		       msg ? "false" : "true");
+		if (msg) {
+			fputs(",\"error\":", stdout);
+			p_json_string(stdout, msg, strlen(msg));
+			fprintf(stderr, "%s: %s: %s\n", b->o->name, it->path,
+				msg);
+			++b->failed;
+		} else {
+			printf(",\"seconds\":%le,\"output\":", secs);
+			p_json_string(stdout, buf, size);
+		}
+		fputs("}\n", stdout);
+		b->write_err = b->write_err || fflush(stdout);
+		pthread_mutex_unlock(&b->lock);
+
+		if (out) {
+			fclose(out);
+		}
+		free(buf);
+	}
+	return NULL;
+}
+
+bool batch(const BatchOpts *o)
+{
+	Batch b = {.lock = PTHREAD_MUTEX_INITIALIZER, .o = o};
+	bool ok = true;
+	for (size_t i = 0; ok && i < o->nfiles; ++i) {
+		ok = add_item(&b, o->files[i]);
+	}
+	if (ok && o->manifest) {
+		ok = read_manifest(&b, o->manifest);
+	}
+	if (!ok) {
+		goto cleanup;
+	}
+	qsort(b.items, b.len, sizeof *b.items, by_size);
+
+	const int nthreads =
+	    (size_t)o->nthreads < b.len ? o->nthreads : (int)b.len;
+	pthread_t *threads = malloc((nthreads ? nthreads : 1) *
+				    sizeof *threads);
+	if (!threads) {
+		fputs("Failed to allocate memory.\n", stderr);
+		ok = false;
+		goto cleanup;
+	}
+	int started = 0;
+	for (; started < nthreads; ++started) {
+		if (pthread_create(threads + started, NULL, work, &b)) {
+			break;
+		}
+	}
+	if (!started && nthreads) {
+		fprintf(stderr, "%s: failed to start threads\n", o->name);
+		ok = false;
+	}
+	for (int i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	if (b.write_err) {
+		fprintf(stderr, "%s: write error: %s\n", o->name,
+			strerror(errno));
+		ok = false;
+	}
+	if (b.failed) {
+		fprintf(stderr, "%s: %zu of %zu programs failed\n", o->name,
+			b.failed, b.len);
+		ok = false;
+	}
+
+cleanup:
+	for (size_t i = 0; i < b.len; ++i) {
+		free(b.items[i].path);
+	}
+	free(b.items);
+	return ok;
+}
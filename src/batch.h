@@ -0,0 +1,41 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Batch mode: many programs run on a pool of threads, each program on a thread
+ * of its own.
+ *
+ * The programs are taken from files named on the command line and in a
+ * manifest, which lists a file per line; blank lines and lines starting with
+ * `#` are skipped. The largest files are run first, so that a long program
+ * does not start last and hold up the end of the batch. Each program yields a
+ * line of JSON on `stdout` once it is done, in the order they finish:
+ *
+ *   {"file":FILE,"index":INDEX,"ok":true,"seconds":SECS,"output":OUTPUT}
+ *   {"file":FILE,"index":INDEX,"ok":false,"error":MESSAGE}
+ *
+ * where INDEX is the position of FILE among the files, those on the command
+ * line first, and OUTPUT is what `gisa` would print for it alone. A program
+ * which cannot be read, parsed, compiled, or run fails alone, and the others
+ * run on.
+ */
+
+#include "job.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Options of a batch
+typedef struct BatchOpts {
+	char **files; // Of the programs, and their number
+	size_t nfiles;
+	const char *manifest; // Listing more files, if any; "-" for `stdin`
+	const char *cache;    // Directory of images of programs, if any
+	Job job;	      // Run on each program
+	int nthreads;	      // Size of the pool
+	const char *name;     // Prefix of messages to `stderr`
+} BatchOpts;
+
+// Run `o->job` on each program of `o`. Returns `false` if any has failed, or
+// the batch could not start, which has been reported.
+bool batch(const BatchOpts *o);
+
+#endif /* ifndef BATCH_H */
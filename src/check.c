@@ -0,0 +1,94 @@
+#include "check.h"
+#include "compile.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool new_check(Check *c, const Prog *prog)
+{
+	const int n = prog->nqueries ? prog->nqueries : 1;
+	*c = (Check){.nqueries = prog->nqueries};
+	c->hits = calloc(n, sizeof *c->hits);
+	c->first = malloc(n * sizeof *c->first);
+	c->where = calloc(2 * n, sizeof *c->where);
+	c->hit = calloc(n, sizeof *c->hit);
+	c->at = calloc(2 * n, sizeof *c->at);
+	if (!c->hits || !c->first || !c->where || !c->hit || !c->at) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_check(c);
+		return false;
+	}
+	for (int q = 0; q < n; ++q) {
+		c->first[q] = ULONG_MAX;
+	}
+	return true;
+}
+
+void free_check(Check *c)
+{
+	free(c->hits);
+	free(c->first);
+	free(c->where);
+	free(c->hit);
+	free(c->at);
+	c->hits = c->first = NULL;
+	c->where = c->at = NULL;
+	c->hit = NULL;
+}
+
+void start_check(Check *c, const Prog *prog)
+{
+	memset(c->hit, 0, c->nqueries * sizeof *c->hit);
+	c->pending = prog->nqueries - prog->nasserts;
+}
+
+void end_check(Check *c, unsigned long i)
+{
+	++c->n;
+	for (int q = 0; q < c->nqueries; ++q) {
+		if (!c->hit[q]) {
+			continue;
+		}
+		++c->hits[q];
+		if (i < c->first[q]) {
+			c->first[q] = i;
+			c->where[2 * q] = c->at[2 * q];
+			c->where[2 * q + 1] = c->at[2 * q + 1];
+		}
+	}
+}
+
+void merge_check(Check *dest, const Check *src)
+{
+	dest->n += src->n;
+	for (int q = 0; q < dest->nqueries; ++q) {
+		dest->hits[q] += src->hits[q];
+		if (src->first[q] < dest->first[q]) {
+			dest->first[q] = src->first[q];
+			dest->where[2 * q] = src->where[2 * q];
+			dest->where[2 * q + 1] = src->where[2 * q + 1];
+		}
+	}
+}
+
+bool p_check(FILE *stream, const Check *c, const Prog *prog)
+{
+	bool ok = true;
+	for (int q = 0; q < c->nqueries; ++q) {
+		const Query *query = prog->queries + q;
+		fprintf(stream, "%s #%d (line %d): %s by %lu of %lu trajectories",
+			query->is_assert ? "assert" : "reach", q + 1,
+			query->line, query->is_assert ? "violated" : "reached",
+			c->hits[q], c->n);
+		if (c->hits[q]) {
+			fprintf(stream, ", first by #%lu at (%lf, %lf)",
+				c->first[q], c->where[2 * q],
+				c->where[2 * q + 1]);
+		}
+		putc('\n', stream);
+		ok = ok && !(query->is_assert && c->hits[q]);
+	}
+	return ok;
+}
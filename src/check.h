@@ -0,0 +1,44 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct Prog;
+
+// Outcomes of the queries of a program over sampled trajectories. For an
+// `assert`, a hit is a trajectory violating it; for a `reach`, a trajectory
+// reaching its region.
+typedef struct Check {
+	int nqueries;
+	unsigned long n; // Number of trajectories checked
+	unsigned long *hits;
+	// Index of the first trajectory hitting each query, and its state there
+	unsigned long *first;
+	double *where;
+	// State of the trajectory in progress: hits, their states, and the
+	// number of `reach`es yet to hit
+	bool *hit;
+	double *at;
+	int pending;
+} Check;
+
+// Initialize `c` for the queries of `prog`. Returns `false` if failed.
+bool new_check(Check *c, const struct Prog *prog);
+
+void free_check(Check *c);
+
+// Start a trajectory.
+void start_check(Check *c, const struct Prog *prog);
+
+// Tally the trajectory `i` in progress.
+void end_check(Check *c, unsigned long i);
+
+// Add the tallies of `src` to `dest`.
+void merge_check(Check *dest, const Check *src);
+
+// Print the outcome of each query of `prog` to `stream`. Returns `false` if
+// an `assert` was violated.
+bool p_check(FILE *stream, const Check *c, const struct Prog *prog);
+
+#endif /* ifndef CHECK_H */
@@ -0,0 +1,705 @@
+#include "compile.h"
+#include "ast.h"
+#include "memo.h"
+#include "term.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Number of points `poly_eval_batch` processes at a time.
+#define BATCH 64
+
+// Monomials of a polynomial kept in a `Memo`
+typedef struct MonoRun {
+	int len;
+	Mono monos[];
+} MonoRun;
+
+// Vertices of a region kept in a `Memo`
+typedef struct Vertices {
+	int n;
+	double xy[];
+} Vertices;
+
+// State of compiling an AST into `prog`: what has been compiled of each of
+// its nodes, by id, so that a node shared by hash-consing is compiled once
+typedef struct Compiler {
+	Prog *prog;
+	Memo *memo;
+	Poly *polys; // `len` -1 if not compiled yet
+	int *leaves; // First `Insn` of an `init`, a `translation`, or a
+		     // `rotation`, or -1
+	TermNode **terms; // Value of a shared operation, once evaluated
+} Compiler;
+
+// Forward declarations for static functions
+static TermNode *eval_poly(Compiler *c, const ASTNode *ast);
+static void poly_err_msg(const ASTNode *ast);
+static int mono_cmp(const void *m1, const void *m2);
+static bool compile_poly(Compiler *c, const ASTNode *ast, Poly *p);
+static int compile_node(Compiler *c, const ASTNode *ast);
+static int push_insn(Prog *prog, Insn insn, const ASTNode *ast,
+		     unsigned long nallocs);
+static bool const_arg(const ASTNode *ast, double *num);
+static bool linear_arg(const ASTNode *ast, double *abc);
+static bool eval_vertices(const ASTNode *ast, double **xy, int *n);
+static bool region_vertices(const ASTNode *ast, Memo *memo, double **xy,
+			    int *n);
+static bool compile_region(const ASTNode *ast, Memo *memo, Region *r);
+static int push_query(Prog *prog, Memo *memo, const ASTNode *ast);
+static int push_shape(Prog *prog, Memo *memo, const ASTNode *ast);
+
+// Evaluate the polynomial `ast`. If `c` is set, an operation shared by
+// several parents is evaluated once, and copied after that.
+static TermNode *eval_poly(Compiler *c, const ASTNode *ast)
+{
+	if (!ast) { // for NEG op
+		return NULL;
+	}
+	switch (ast->type) {
+	case OP_T: {
+		TermNode **kept = c && ast->nparents > 1 ? c->terms + ast->id
+							 : NULL;
+		if (kept && *kept) {
+			TermNode *p = poly_dup(*kept);
+			if (!p) {
+				goto mem_err;
+			}
+			return p;
+		}
+		enum Op op = ast->u.op_dat.op;
+		TermNode *lt = eval_poly(c, ast->u.op_dat.larg);
+		TermNode *rt = eval_poly(c, ast->u.op_dat.rarg);
+
+		// Result of `eval_poly` being `NULL` indicates an invalid
+		// syntax or an operation, except for the result of evaluating
+		// the right child of the `NEG` op.
+		if (!lt || (!rt && op != NEG)) {
+			free_poly(lt);
+			free_poly(rt);
+			return NULL;
+		}
+
+		bool success;
+		switch (op) {
+		case ADD:
+			success = add_poly(&lt, rt);
+			break;
+		case SUB:
+			success = sub_poly(&lt, rt);
+			break;
+		case MUL:
+			success = mul_poly(&lt, rt);
+			break;
+		case DIV:
+			success = div_poly(&lt, rt);
+			break;
+		case POW:
+			success = pow_poly(&lt, rt);
+			break;
+		case NEG:
+			success = neg_poly(lt);
+			break;
+		default:
+			assert(false && "Unknown op type");
+		}
+		if (!success) {
+			free_poly(lt);
+			return NULL;
+		}
+		if (kept) {
+			// Failing to keep it is harmless.
+			*kept = poly_dup(lt);
+		}
+		return lt;
+	}
+	case NUM_T: {
+		TermNode *t = coeff_term(ast->u.num);
+		if (!t) {
+			goto mem_err;
+		}
+		return t;
+	}
+	case VAR_T: {
+		TermNode *p = coeff_term(1.);
+		if (!p) {
+			goto mem_err;
+		}
+		TermNode *vt = var_term(ast->u.var, 1);
+		if (!vt) {
+			free_poly(p);
+			goto mem_err;
+		}
+		p->u.vars = vt;
+		return p;
+	}
+	default:
+		assert(false && "Unexpected node type");
+	}
+mem_err:
+	fputs("Failed to allocate memory.\n", stderr);
+	return NULL;
+}
+
+static void poly_err_msg(const ASTNode *ast)
+{
+	fputs("Evaluation of '", stderr);
+	p_sexp_ast(stderr, ast);
+	fputs("' failed\n", stderr);
+}
+
+// Descending `px`, and then descending `py`.
+static int mono_cmp(const void *m1, const void *m2)
+{
+	const Mono *a = m1;
+	const Mono *b = m2;
+	if (a->px != b->px) {
+		return (a->px < b->px) - (a->px > b->px);
+	}
+	return (a->py < b->py) - (a->py > b->py);
+}
+
+// Evaluate `ast` into a `TermNode` polynomial, and append its monomials to
+// `prog->monos`, unless compiled already, in which case its run is reused. If
+// `c->memo` is set, the monomials are taken from it if kept, and else kept in
+// it.
+static bool compile_poly(Compiler *c, const ASTNode *ast, Poly *p)
+{
+	Poly *done = c->polys + ast->id;
+	if (done->len >= 0) {
+		*p = *done;
+		return true;
+	}
+	Prog *prog = c->prog;
+	Memo *memo = c->memo;
+	const MonoRun *run = memo ? memo_get(memo, ast->hash) : NULL;
+	if (run) {
+		const size_t n = prog->nmonos + run->len;
+		Mono *monos = realloc(prog->monos, n * sizeof *monos);
+		if (!monos) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		prog->monos = monos;
+		memcpy(monos + prog->nmonos, run->monos,
+		       run->len * sizeof *monos);
+		*done = *p = (Poly){prog->nmonos, run->len};
+		prog->nmonos += run->len;
+		return true;
+	}
+
+	TermNode *poly = eval_poly(c, ast);
+	if (!poly) {
+		poly_err_msg(ast);
+		return false;
+	}
+
+	int len = 0;
+	for (const TermNode *t = poly; t; t = t->next) {
+		++len;
+	}
+	Mono *monos = realloc(prog->monos, (prog->nmonos + len) * sizeof *monos);
+	if (!monos) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_poly(poly);
+		return false;
+	}
+	prog->monos = monos;
+
+	*p = (Poly){prog->nmonos, 0};
+	for (const TermNode *t = poly; t; t = t->next) {
+		if (t->hd.val == 0.) {
+			// Only a polynomial equivalent to 0 has a zero term.
+			continue;
+		}
+		Mono m = {t->hd.val, 0, 0};
+		for (const TermNode *v = t->u.vars; v; v = v->next) {
+			if (v->u.pow > INT_MAX) {
+				fputs("Exponent out of range.\n", stderr);
+				poly_err_msg(ast);
+				free_poly(poly);
+				return false;
+			}
+			if (v->hd.name == VX) {
+				m.px = v->u.pow;
+			} else {
+				m.py = v->u.pow;
+			}
+		}
+		monos[p->off + p->len++] = m;
+	}
+	qsort(monos + p->off, p->len, sizeof *monos, mono_cmp);
+	prog->nmonos += p->len;
+	free_poly(poly);
+	if (memo) {
+		// Failing to keep them is harmless.
+		MonoRun *kept = malloc(sizeof *kept + p->len * sizeof *monos);
+		if (kept) {
+			kept->len = p->len;
+			memcpy(kept->monos, monos + p->off,
+			       p->len * sizeof *monos);
+			memo_put(memo, ast->hash, kept);
+		}
+	}
+	*done = *p;
+	return true;
+}
+
+static int push_insn(Prog *prog, Insn insn, const ASTNode *ast,
+		     unsigned long nallocs)
+{
+	const size_t n = prog->ninsns + 1;
+	Insn *insns = realloc(prog->insns, n * sizeof *insns);
+	if (insns) {
+		prog->insns = insns;
+	}
+	const ASTNode **nodes = realloc(prog->nodes, n * sizeof *nodes);
+	if (nodes) {
+		prog->nodes = nodes;
+	}
+	unsigned long *counts = realloc(prog->nallocs, n * sizeof *counts);
+	if (counts) {
+		prog->nallocs = counts;
+	}
+	if (!insns || !nodes || !counts) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return -1;
+	}
+	insns[prog->ninsns] = insn;
+	nodes[prog->ninsns] = ast;
+	counts[prog->ninsns] = nallocs;
+	return prog->ninsns++;
+}
+
+// Evaluate the constant polynomial `ast` into `*num`.
+static bool const_arg(const ASTNode *ast, double *num)
+{
+	TermNode *poly = eval_poly(NULL, ast);
+	if (!poly) {
+		poly_err_msg(ast);
+		return false;
+	}
+	bool ok = true;
+	*num = 0.;
+	for (const TermNode *t = poly; t; t = t->next) {
+		if (t->u.vars && t->hd.val != 0.) {
+			ok = false;
+		} else {
+			*num += t->hd.val;
+		}
+	}
+	free_poly(poly);
+	if (!ok) {
+		fputs("Bounds of a query region must be constant.\n", stderr);
+		poly_err_msg(ast);
+	}
+	return ok;
+}
+
+// Bring the relation `ast` into the form `abc[0]` x + `abc[1]` y <= `abc[2]`.
+static bool linear_arg(const ASTNode *ast, double *abc)
+{
+	TermNode *poly = eval_poly(NULL, ast->u.relation.lhs);
+	TermNode *rhs = poly ? eval_poly(NULL, ast->u.relation.rhs) : NULL;
+	if (!poly || !rhs || !sub_poly(&poly, rhs)) {
+		free_poly(poly);
+		poly_err_msg(ast);
+		return false;
+	}
+	bool ok = true;
+	abc[0] = abc[1] = abc[2] = 0.;
+	for (const TermNode *t = poly; t; t = t->next) {
+		const TermNode *v = t->u.vars;
+		if (!v) {
+			abc[2] -= t->hd.val;
+		} else if (!v->next && v->u.pow == 1) {
+			abc[v->hd.name == VX ? 0 : 1] += t->hd.val;
+		} else if (t->hd.val != 0.) {
+			ok = false;
+		}
+	}
+	free_poly(poly);
+	if (!ok) {
+		fputs("Constraints of a region must be linear.\n", stderr);
+		poly_err_msg(ast);
+	}
+	return ok;
+}
+
+// Collect the vertices of the polygon or the constraints `ast` into `*xy`,
+// which is to be freed, and count them in `*n`.
+static bool eval_vertices(const ASTNode *ast, double **xy, int *n)
+{
+	if (ast->type == RELATIONS_T) {
+		int m = 0;
+		for (const ASTNode *r = ast->u.relations; r;
+		     r = r->u.relation.rest) {
+			++m;
+		}
+		double *abc = malloc(3 * m * sizeof *abc);
+		if (!abc) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		int k = 0;
+		bool ok = true;
+		for (const ASTNode *r = ast->u.relations; ok && r;
+		     r = r->u.relation.rest, ++k) {
+			ok = linear_arg(r, abc + 3 * k);
+		}
+		ok = ok && halfplanes_polygon(abc, m, xy, n);
+		free(abc);
+		return ok;
+	}
+
+	*n = 0;
+	for (const ASTNode *v = ast->u.vertices; v; v = v->u.vertex.rest) {
+		++*n;
+	}
+	if (*n < 3) {
+		fputs("A polygon needs at least 3 vertices.\n", stderr);
+		return false;
+	}
+	if (!(*xy = malloc(2 * *n * sizeof **xy))) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	int i = 0;
+	bool ok = true;
+	for (const ASTNode *v = ast->u.vertices; ok && v;
+	     v = v->u.vertex.rest, ++i) {
+		ok = const_arg(v->u.vertex.x, *xy + 2 * i) &&
+		     const_arg(v->u.vertex.y, *xy + 2 * i + 1);
+	}
+	if (!ok) {
+		free(*xy);
+	}
+	return ok;
+}
+
+// As `eval_vertices`, but if `memo` is set, the vertices are taken from it if
+// kept, and else kept in it.
+static bool region_vertices(const ASTNode *ast, Memo *memo, double **xy,
+			    int *n)
+{
+	const Vertices *kept = memo ? memo_get(memo, ast->hash) : NULL;
+	if (kept) {
+		if (!(*xy = malloc(2 * kept->n * sizeof **xy))) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		memcpy(*xy, kept->xy, 2 * kept->n * sizeof **xy);
+		*n = kept->n;
+		return true;
+	}
+	if (!eval_vertices(ast, xy, n)) {
+		return false;
+	}
+	Vertices *v = memo ? malloc(sizeof *v + 2 * *n * sizeof **xy) : NULL;
+	if (v) {
+		v->n = *n;
+		memcpy(v->xy, *xy, 2 * *n * sizeof **xy);
+		memo_put(memo, ast->hash, v);
+	}
+	return true;
+}
+
+// Compile the region `ast` of a query into `r`.
+static bool compile_region(const ASTNode *ast, Memo *memo, Region *r)
+{
+	if (ast->type == REGION_T) {
+		const ASTNode *t1 = ast->u.region_ts.t1;
+		const ASTNode *t2 = ast->u.region_ts.t2;
+		double b[4];
+		if (!const_arg(t1->u.interval_ns.n1, b) ||
+		    !const_arg(t1->u.interval_ns.n2, b + 1) ||
+		    !const_arg(t2->u.interval_ns.n1, b + 2) ||
+		    !const_arg(t2->u.interval_ns.n2, b + 3)) {
+			return false;
+		}
+		new_rect(r, b[0], b[1], b[2], b[3]);
+		return true;
+	}
+
+	double *xy;
+	int n;
+	if (!region_vertices(ast, memo, &xy, &n)) {
+		return false;
+	}
+	const bool ok = new_polygon(r, xy, n);
+	free(xy);
+	return ok;
+}
+
+// Compile the query `ast` into a new `Query` of `prog`. Returns its index, or
+// -1 if failed.
+static int push_query(Prog *prog, Memo *memo, const ASTNode *ast)
+{
+	Query q = {.is_assert = ast->type == ASSERT_T,
+		   .line = ast->u.query.line};
+	if (!compile_region(ast->u.query.region, memo, &q.region)) {
+		return -1;
+	}
+	Query *queries =
+	    realloc(prog->queries, (prog->nqueries + 1) * sizeof *queries);
+	if (!queries) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_region(&q.region);
+		return -1;
+	}
+	prog->queries = queries;
+	queries[prog->nqueries] = q;
+	prog->nasserts += q.is_assert;
+	return prog->nqueries++;
+}
+
+// Triangulate the polygon or the constraints `ast` of an `init` into a new
+// shape of `prog`. Returns its index, or -1 if failed.
+static int push_shape(Prog *prog, Memo *memo, const ASTNode *ast)
+{
+	double *xy;
+	int n;
+	if (!region_vertices(ast, memo, &xy, &n)) {
+		return -1;
+	}
+	Tris t;
+	const bool ok = new_tris(&t, xy, n);
+	free(xy);
+	if (!ok) {
+		return -1;
+	}
+	Tris *shapes =
+	    realloc(prog->shapes, (prog->nshapes + 1) * sizeof *shapes);
+	if (!shapes) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_tris(&t);
+		return -1;
+	}
+	prog->shapes = shapes;
+	shapes[prog->nshapes] = t;
+	return prog->nshapes++;
+}
+
+// Compile `ast` and its children, with the polynomials and the regions kept
+// in `c->memo` if set. A statement compiled already is copied. Returns the
+// index of the `Insn` compiled from `ast`, or -1 if failed.
+static int compile_node(Compiler *c, const ASTNode *ast)
+{
+	Prog *prog = c->prog;
+	Memo *memo = c->memo;
+	if (c->leaves[ast->id] >= 0) {
+		return push_insn(prog, prog->insns[c->leaves[ast->id]], ast, 0);
+	}
+	Insn insn = {0};
+	const unsigned long allocs = term_tally.allocs;
+	switch (ast->type) {
+	case INIT_T: {
+		const ASTNode *region = ast->u.init_region;
+		insn.type = I_INIT;
+		insn.u.init.shape = -1;
+		if (region->type != REGION_T) {
+			insn.u.init.shape = push_shape(prog, memo, region);
+			if (insn.u.init.shape < 0) {
+				return -1;
+			}
+			break;
+		}
+		const ASTNode *t1 = region->u.region_ts.t1;
+		const ASTNode *t2 = region->u.region_ts.t2;
+		if (!compile_poly(c, t1->u.interval_ns.n1, &insn.u.init.xs) ||
+		    !compile_poly(c, t1->u.interval_ns.n2, &insn.u.init.xe) ||
+		    !compile_poly(c, t2->u.interval_ns.n1, &insn.u.init.ys) ||
+		    !compile_poly(c, t2->u.interval_ns.n2, &insn.u.init.ye)) {
+			return -1;
+		}
+		break;
+	}
+	case TRANSLATION_T:
+		insn.type = I_TRANSLATION;
+		if (!compile_poly(c, ast->u.translation_args.u,
+				  &insn.u.translation.u) ||
+		    !compile_poly(c, ast->u.translation_args.v,
+				  &insn.u.translation.v)) {
+			return -1;
+		}
+		break;
+	case ROTATION_T: {
+		insn.type = I_ROTATION;
+		if (!compile_poly(c, ast->u.rotation_args.u,
+				  &insn.u.rotation.u) ||
+		    !compile_poly(c, ast->u.rotation_args.v,
+				  &insn.u.rotation.v) ||
+		    !compile_poly(c, ast->u.rotation_args.theta,
+				  &insn.u.rotation.theta)) {
+			return -1;
+		}
+		insn.u.rotation.fixed = poly_const(prog, insn.u.rotation.theta);
+		if (insn.u.rotation.fixed) {
+			const double theta =
+			    poly_eval(prog, insn.u.rotation.theta, 0., 0.);
+			const double deg = theta / 180. * M_PI;
+			insn.u.rotation.s = sin(deg);
+			insn.u.rotation.c = cos(deg);
+		}
+		break;
+	}
+	case SEQUENCE_T:
+	case OR_T: {
+		// `sequence_ps` and `or_ps` share the same layout.
+		insn.type = ast->type == SEQUENCE_T ? I_SEQUENCE : I_OR;
+		const int p1 = compile_node(c, ast->u.sequence_ps.p1);
+		if (p1 < 0) {
+			return -1;
+		}
+		const int p2 = compile_node(c, ast->u.sequence_ps.p2);
+		if (p2 < 0) {
+			return -1;
+		}
+		insn.u.branch.p1 = p1;
+		insn.u.branch.p2 = p2;
+		break;
+	}
+	case ITER_T:
+		insn.type = I_ITER;
+		insn.u.iter_body = compile_node(c, ast->u.iter_body);
+		if (insn.u.iter_body < 0) {
+			return -1;
+		}
+		break;
+	case ASSERT_T:
+	case REACH_T:
+		insn.type = ast->type == ASSERT_T ? I_ASSERT : I_REACH;
+		insn.u.query = push_query(prog, memo, ast);
+		if (insn.u.query < 0) {
+			return -1;
+		}
+		break;
+	default:
+		assert(false && "Unexpected node type");
+	}
+	// The children of a branch count for themselves.
+	const bool branch = insn.type == I_SEQUENCE || insn.type == I_OR ||
+			    insn.type == I_ITER;
+	const int pc = push_insn(prog, insn, ast,
+				 branch ? 0 : term_tally.allocs - allocs);
+	if (!branch && insn.type != I_ASSERT && insn.type != I_REACH) {
+		c->leaves[ast->id] = pc;
+	}
+	return pc;
+}
+
+// Compile the AST `ast` into `prog`.
+bool compile(const ASTNode *ast, Prog *prog)
+{
+	return compile_memo(ast, prog, NULL);
+}
+
+bool compile_memo(const ASTNode *ast, Prog *prog, Memo *memo)
+{
+	*prog = (Prog){NULL, 0, NULL, 0, NULL, 0, 0, NULL, 0, -1, NULL, NULL};
+	// The nodes of `ast` have ids up to its own.
+	const int n = ast->id + 1;
+	Compiler c = {prog, memo, malloc(n * sizeof *c.polys),
+		      malloc(n * sizeof *c.leaves), calloc(n, sizeof *c.terms)};
+	if (!c.polys || !c.leaves || !c.terms) {
+		fputs("Failed to allocate memory.\n", stderr);
+		goto cleanup;
+	}
+	for (int i = 0; i < n; ++i) {
+		c.polys[i] = (Poly){0, -1};
+		c.leaves[i] = -1;
+	}
+	prog->entry = compile_node(&c, ast);
+
+cleanup:
+	if (c.terms) {
+		for (int i = 0; i < n; ++i) {
+			free_poly(c.terms[i]);
+		}
+	}
+	free(c.polys);
+	free(c.leaves);
+	free(c.terms);
+	if (prog->entry < 0) {
+		free_prog(prog);
+		return false;
+	}
+	return true;
+}
+
+void free_prog(Prog *prog)
+{
+	free(prog->insns);
+	free(prog->nodes);
+	free(prog->nallocs);
+	free(prog->monos);
+	for (int i = 0; i < prog->nqueries; ++i) {
+		free_region(&prog->queries[i].region);
+	}
+	free(prog->queries);
+	for (int i = 0; i < prog->nshapes; ++i) {
+		free_tris(&prog->shapes[i]);
+	}
+	free(prog->shapes);
+	*prog = (Prog){NULL, 0, NULL, 0, NULL, 0, 0, NULL, 0, -1, NULL, NULL};
+}
+
+// Evaluate `p` at `n` points (`x[i]`, `y[i]`) into `out[i]`.
+void poly_eval_batch(const Prog *prog, Poly p, const double *restrict x,
+		     const double *restrict y, double *restrict out, size_t n)
+{
+	const Mono *m = prog->monos + p.off;
+	for (size_t s = 0; s < n; s += BATCH) {
+		const size_t k = n - s < BATCH ? n - s : BATCH;
+		const double *xs = x + s;
+		const double *ys = y + s;
+		double *acc = out + s;
+		double inner[BATCH];
+
+		for (size_t j = 0; j < k; ++j) {
+			acc[j] = 0.;
+		}
+		int i = 0;
+		while (i < p.len) {
+			const int px = m[i].px;
+			int py = m[i].py;
+			for (size_t j = 0; j < k; ++j) {
+				inner[j] = 0.;
+			}
+			for (; i < p.len && m[i].px == px; ++i) {
+				for (int e = m[i].py; e < py; ++e) {
+					for (size_t j = 0; j < k; ++j) {
+						inner[j] *= ys[j];
+					}
+				}
+				const double c = m[i].coeff;
+				for (size_t j = 0; j < k; ++j) {
+					inner[j] += c;
+				}
+				py = m[i].py;
+			}
+			const int dx = px - (i < p.len ? m[i].px : 0);
+			for (int e = 0; e < py; ++e) {
+				for (size_t j = 0; j < k; ++j) {
+					inner[j] *= ys[j];
+				}
+			}
+			for (size_t j = 0; j < k; ++j) {
+				acc[j] += inner[j];
+			}
+			for (int e = 0; e < dx; ++e) {
+				for (size_t j = 0; j < k; ++j) {
+					acc[j] *= xs[j];
+				}
+			}
+		}
+	}
+}
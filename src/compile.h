@@ -0,0 +1,160 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "region.h"
+#include "tri.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A program is compiled once into a flat array of `Insn`s referring to each
+ * other by index, and every polynomial argument is compiled into a run of
+ * `Mono`s in a single coefficient/exponent table.
+ *
+ * For 2xy^2 + 5y + 9, the run of `Mono`s is
+ *
+ *   coeff  px  py
+ * +------+---+---+
+ * |    2 | 1 | 2 |
+ * |    5 | 0 | 1 |
+ * |    9 | 0 | 0 |
+ * +------+---+---+
+ *
+ * sorted by descending `px` and then by descending `py`, which is the order
+ * the multivariate Horner scheme in `poly_eval` consumes them in.
+ */
+typedef struct Mono {
+	double coeff;
+	int px;
+	int py;
+} Mono;
+
+// A run of `len` `Mono`s starting at `Prog::monos[off]`.
+typedef struct Poly {
+	int off;
+	int len;
+} Poly;
+
+typedef struct Insn {
+	enum InsnType {
+		I_INIT,
+		I_TRANSLATION,
+		I_ROTATION,
+		I_SEQUENCE,
+		I_OR,
+		I_ITER,
+		I_ASSERT,
+		I_REACH
+	} type;
+	union {
+		// I_INIT
+		struct {
+			Poly xs, xe, ys, ye;
+			// Index into `Prog::shapes` for a polygon, whose
+			// `Poly`s are unused; -1 for the rectangle
+			int shape;
+		} init;
+		// I_TRANSLATION
+		struct {
+			Poly u, v;
+		} translation;
+		// I_ROTATION
+		struct {
+			Poly u, v, theta;
+			// `s` and `c` are precomputed when `theta` is constant.
+			bool fixed;
+			double s, c;
+		} rotation;
+		// I_SEQUENCE, I_OR
+		struct {
+			int p1, p2;
+		} branch;
+		// I_ITER
+		int iter_body;
+		// I_ASSERT, I_REACH: index into `Prog::queries`
+		int query;
+	} u;
+} Insn;
+
+// An `assert` or a `reach` with its region compiled.
+typedef struct Query {
+	bool is_assert;
+	int line;
+	Region region;
+} Query;
+
+typedef struct Prog {
+	Insn *insns;
+	int ninsns;
+	Mono *monos;
+	int nmonos;
+	Query *queries; // In the order of appearance
+	int nqueries;
+	int nasserts;
+	Tris *shapes; // Polygons of `init`s
+	int nshapes;
+	int entry; // Index of the top-level `Insn`
+	// For each `Insn`, the AST node it is compiled from, and the number of
+	// `TermNode`s allocated evaluating its own polynomials
+	const struct ASTNode **nodes;
+	unsigned long *nallocs;
+} Prog;
+
+struct ASTNode;
+// Compile the AST `ast` into `prog`. Returns `false` if failed, in which case
+// `prog` holds nothing to be released.
+bool compile(const struct ASTNode *ast, Prog *prog);
+
+struct Memo;
+// Compile `ast` into `prog` as `compile` does, but take the monomials of the
+// polynomials and the vertices of the regions from `memo` where kept there by
+// the structural hashes of their ASTs, and keep those evaluated anew in it.
+bool compile_memo(const struct ASTNode *ast, Prog *prog, struct Memo *memo);
+
+void free_prog(Prog *prog);
+
+static inline bool poly_const(const Prog *prog, Poly p)
+{
+	return p.len == 0 ||
+	       (p.len == 1 && !prog->monos[p.off].px && !prog->monos[p.off].py);
+}
+
+static inline double ipow(double b, int e)
+{
+	double r = 1.;
+	for (; e; e >>= 1, b *= b) {
+		if (e & 1) {
+			r *= b;
+		}
+	}
+	return r;
+}
+
+// Evaluate `p` at (`x`, `y`) with the multivariate Horner scheme
+// p = (...(c_0(y) x^(d_0 - d_1) + c_1(y)) x^(d_1 - d_2) + ...) x^(d_k)
+// where each c_i(y) is again evaluated with the Horner scheme in `y`.
+static inline double poly_eval(const Prog *prog, Poly p, double x, double y)
+{
+	const Mono *m = prog->monos + p.off;
+	double acc = 0.;
+	int i = 0;
+	while (i < p.len) {
+		const int px = m[i].px;
+		int py = m[i].py;
+		double inner = 0.;
+		for (; i < p.len && m[i].px == px; ++i) {
+			inner = inner * ipow(y, py - m[i].py) + m[i].coeff;
+			py = m[i].py;
+		}
+		inner *= ipow(y, py);
+		acc = (acc + inner) * ipow(x, px - (i < p.len ? m[i].px : 0));
+	}
+	return acc;
+}
+
+// Evaluate `p` at `n` points (`x[i]`, `y[i]`) into `out[i]`.
+// Same scheme as `poly_eval`, but the loops over points are innermost so that
+// they vectorize. Allocates nothing.
+void poly_eval_batch(const Prog *prog, Poly p, const double *restrict x,
+		     const double *restrict y, double *restrict out, size_t n);
+
+#endif /* ifndef COMPILE_H */
@@ -0,0 +1,535 @@
+#include "density.h"
+#include "compile.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Forward declarations for static functions
+static size_t ncells(const Grid *g);
+static bool dup_grid(Grid *dest, const Grid *src);
+static double total_mass(const Grid *g);
+static double overlap(double a, double b, double o, double d, int n, double *w,
+		      int *lo, int *hi);
+static double deposit_rect(const Grid *g, double *buf, double xs, double xe,
+			   double ys, double ye, double m, double *wx,
+			   double *wy);
+static int clip_axis(const double *in, int n, int axis, double bound,
+		     double sign, double *out);
+static double deposit_tris(const Grid *g, double *buf, const Tris *t,
+			   double m);
+static double splat(const Grid *g, double *buf, double x, double y, double m);
+static bool init_const(const Prog *prog, const Insn *insn);
+static int scatter(const Prog *prog, const Insn *insn, Grid *g);
+
+static size_t ncells(const Grid *g) { return (size_t)g->nx * g->ny; }
+
+bool new_grid(Grid *g, double x0, double x1, double y0, double y1, int nx,
+	      int ny)
+{
+	assert(nx > 0 && ny > 0 && x0 < x1 && y0 < y1);
+	*g = (Grid){.x0 = x0,
+		    .y0 = y0,
+		    .dx = (x1 - x0) / nx,
+		    .dy = (y1 - y0) / ny,
+		    .nx = nx,
+		    .ny = ny};
+	g->mass = calloc(ncells(g), sizeof *g->mass);
+	if (!g->mass) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	return true;
+}
+
+void free_grid(Grid *g)
+{
+	free(g->mass);
+	g->mass = NULL;
+}
+
+static bool dup_grid(Grid *dest, const Grid *src)
+{
+	*dest = *src;
+	dest->mass = malloc(ncells(src) * sizeof *dest->mass);
+	if (!dest->mass) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	memcpy(dest->mass, src->mass, ncells(src) * sizeof *dest->mass);
+	return true;
+}
+
+static double total_mass(const Grid *g)
+{
+	const size_t n = ncells(g);
+	double sum = 0.;
+#pragma omp parallel for simd reduction(+ : sum)
+	for (size_t k = 0; k < n; ++k) {
+		sum += g->mass[k];
+	}
+	return sum;
+}
+
+// Store into `w[lo]`, ..., `w[hi]` the fraction of [a, b] that falls into each
+// of the `n` cells of size `d` starting at `o`. A degenerate interval falls
+// entirely into the cell containing it. Returns the fraction inside the grid.
+static double overlap(double a, double b, double o, double d, int n, double *w,
+		      int *lo, int *hi)
+{
+	if (a > b) {
+		const double tmp = a;
+		a = b;
+		b = tmp;
+	}
+	const double fa = floor((a - o) / d);
+	const double fb = floor((b - o) / d);
+	if (!(fb >= 0. && fa < n)) { // Also catches NaNs.
+		*lo = 0;
+		*hi = -1;
+		return 0.;
+	}
+	*lo = fa < 0. ? 0 : (int)fa;
+	*hi = fb >= n ? n - 1 : (int)fb;
+	if (a == b) {
+		w[*lo] = 1.;
+		return 1.;
+	}
+	double sum = 0.;
+	for (int k = *lo; k <= *hi; ++k) {
+		const double s = fmax(a, o + k * d);
+		const double e = fmin(b, o + (k + 1) * d);
+		w[k] = (e - s) / (b - a);
+		sum += w[k];
+	}
+	return sum;
+}
+
+// Spread the mass `m` uniformly over [xs, xe] x [ys, ye] into `buf`. `wx` and
+// `wy` are scratch spaces of `g->nx` and `g->ny` elements.
+// Returns the mass that falls outside the grid.
+static double deposit_rect(const Grid *g, double *buf, double xs, double xe,
+			   double ys, double ye, double m, double *wx,
+			   double *wy)
+{
+	int ilo, ihi, jlo, jhi;
+	const double fx = overlap(xs, xe, g->x0, g->dx, g->nx, wx, &ilo, &ihi);
+	const double fy = overlap(ys, ye, g->y0, g->dy, g->ny, wy, &jlo, &jhi);
+	for (int j = jlo; j <= jhi; ++j) {
+		double *row = buf + (size_t)j * g->nx;
+		const double mj = m * wy[j];
+#pragma omp simd
+		for (int i = ilo; i <= ihi; ++i) {
+			row[i] += mj * wx[i];
+		}
+	}
+	return m * (1. - fx * fy);
+}
+
+// Clip the polygon of the `n` vertices `in` to where `sign` * (coordinate
+// `axis` - `bound`) <= 0 into `out`. Returns the number of vertices left.
+static int clip_axis(const double *in, int n, int axis, double bound,
+		     double sign, double *out)
+{
+	int len = 0;
+	for (int i = 0; i < n; ++i) {
+		const double *p = in + 2 * i;
+		const double *q = in + 2 * ((i + 1) % n);
+		const double dp = sign * (p[axis] - bound);
+		const double dq = sign * (q[axis] - bound);
+		if (dp <= 0.) {
+			out[2 * len] = p[0];
+			out[2 * len + 1] = p[1];
+			++len;
+		}
+		if ((dp < 0. && dq > 0.) || (dp > 0. && dq < 0.)) {
+			const double f = dp / (dp - dq);
+			out[2 * len] = p[0] + f * (q[0] - p[0]);
+			out[2 * len + 1] = p[1] + f * (q[1] - p[1]);
+			++len;
+		}
+	}
+	return len;
+}
+
+// Spread the mass `m` uniformly over the triangles of `t` into `buf`, each
+// cell getting the mass of its overlap with each triangle. Returns the mass
+// that falls outside the grid.
+static double deposit_tris(const Grid *g, double *buf, const Tris *t,
+			   double m)
+{
+	double placed = 0.;
+	for (int k = 0; k < t->n; ++k) {
+		const double *v = t->v + 6 * k;
+		const double xl = fmin(v[0], fmin(v[2], v[4]));
+		const double xu = fmax(v[0], fmax(v[2], v[4]));
+		const double yl = fmin(v[1], fmin(v[3], v[5]));
+		const double yu = fmax(v[1], fmax(v[3], v[5]));
+		const int ilo = (int)fmax(floor((xl - g->x0) / g->dx), 0.);
+		const int ihi =
+		    (int)fmin(floor((xu - g->x0) / g->dx), g->nx - 1);
+		const int jlo = (int)fmax(floor((yl - g->y0) / g->dy), 0.);
+		const int jhi =
+		    (int)fmin(floor((yu - g->y0) / g->dy), g->ny - 1);
+		for (int j = jlo; j <= jhi; ++j) {
+			for (int i = ilo; i <= ihi; ++i) {
+				// A triangle clipped by 4 sides has at most 7
+				// vertices.
+				double a[14], b[14];
+				const double cx = g->x0 + i * g->dx;
+				const double cy = g->y0 + j * g->dy;
+				int n = clip_axis(v, 3, 0, cx, -1., a);
+				n = clip_axis(a, n, 0, cx + g->dx, 1., b);
+				n = clip_axis(b, n, 1, cy, -1., a);
+				n = clip_axis(a, n, 1, cy + g->dy, 1., b);
+				double area = 0.;
+				for (int p = 0; p < n; ++p) {
+					const int q = (p + 1) % n;
+					area += b[2 * p] * b[2 * q + 1] -
+						b[2 * q] * b[2 * p + 1];
+				}
+				const double dm = m * fabs(area) / 2. / t->area;
+				buf[(size_t)j * g->nx + i] += dm;
+				placed += dm;
+			}
+		}
+	}
+	// Only rounding is left if the grid covers `t`.
+	return m - placed > 1e-12 * m ? m - placed : 0.;
+}
+
+// Resample the mass `m` at (`x`, `y`) onto the four nearest cell centers of
+// `buf` with bilinear weights. Returns the mass that falls outside the grid.
+static double splat(const Grid *g, double *buf, double x, double y, double m)
+{
+	const double fx = (x - g->x0) / g->dx;
+	const double fy = (y - g->y0) / g->dy;
+	if (!(fx >= 0. && fx < g->nx && fy >= 0. && fy < g->ny)) {
+		return m; // Also catches NaNs.
+	}
+	// Offset by half a cell so that the integer parts index the cell
+	// centers to the lower left of (`x`, `y`).
+	const double cx = fx - .5;
+	const double cy = fy - .5;
+	const int i = (int)floor(cx);
+	const int j = (int)floor(cy);
+	const double ax = cx - i;
+	const double ay = cy - j;
+	// A point in the outer half of an edge cell gives the weight of the
+	// missing neighbor back to the edge cell.
+	const int i0 = i < 0 ? 0 : i;
+	const int i1 = i + 1 >= g->nx ? g->nx - 1 : i + 1;
+	const int j0 = j < 0 ? 0 : j;
+	const int j1 = j + 1 >= g->ny ? g->ny - 1 : j + 1;
+	buf[(size_t)j0 * g->nx + i0] += m * (1. - ax) * (1. - ay);
+	buf[(size_t)j0 * g->nx + i1] += m * ax * (1. - ay);
+	buf[(size_t)j1 * g->nx + i0] += m * (1. - ax) * ay;
+	buf[(size_t)j1 * g->nx + i1] += m * ax * ay;
+	return 0.;
+}
+
+static bool init_const(const Prog *prog, const Insn *insn)
+{
+	return insn->u.init.shape >= 0 ||
+	       (poly_const(prog, insn->u.init.xs) &&
+		poly_const(prog, insn->u.init.xe) &&
+		poly_const(prog, insn->u.init.ys) &&
+		poly_const(prog, insn->u.init.ye));
+}
+
+// Move the mass of every cell of `g` by `insn`, which is either a `I_INIT`,
+// `I_TRANSLATION`, or `I_ROTATION`, whose arguments are evaluated at the cell
+// centers. Each thread accumulates into a grid of its own, which are summed
+// up at the end. Returns 0 if successful; 2 if out of memory.
+static int scatter(const Prog *prog, const Insn *insn, Grid *g)
+{
+	const size_t n = ncells(g);
+	const int nx = g->nx;
+#ifdef _OPENMP
+	const int nthreads = omp_get_max_threads();
+#else
+	const int nthreads = 1;
+#endif
+	// Per-thread output grids and scratch spaces of a row.
+	double **bufs = calloc(2 * nthreads, sizeof *bufs);
+	if (!bufs) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return 2;
+	}
+	double **scratches = bufs + nthreads;
+	int ret = 0;
+	for (int t = 0; t < nthreads; ++t) {
+		bufs[t] = calloc(n, sizeof *bufs[t]);
+		scratches[t] = malloc((7 * nx + g->ny) * sizeof *scratches[t]);
+		if (!bufs[t] || !scratches[t]) {
+			fputs("Failed to allocate memory.\n", stderr);
+			ret = 2;
+			goto scatter_cleanup;
+		}
+	}
+
+	double lost = 0.;
+#pragma omp parallel num_threads(nthreads) reduction(+ : lost)
+	{
+#ifdef _OPENMP
+		const int t = omp_get_thread_num();
+#else
+		const int t = 0;
+#endif
+		double *buf = bufs[t];
+		double *xs = scratches[t];
+		double *ys = xs + nx;
+		double *a = ys + nx;
+		double *b = a + nx;
+		double *c = b + nx;
+		double *d = c + nx;
+		double *wx = d + nx;
+		double *wy = wx + nx;
+
+#pragma omp for schedule(dynamic, 16)
+		for (int j = 0; j < g->ny; ++j) {
+			const double *row = g->mass + (size_t)j * nx;
+			const double y = g->y0 + (j + .5) * g->dy;
+#pragma omp simd
+			for (int i = 0; i < nx; ++i) {
+				xs[i] = g->x0 + (i + .5) * g->dx;
+				ys[i] = y;
+			}
+
+			switch (insn->type) {
+			case I_INIT:
+				poly_eval_batch(prog, insn->u.init.xs, xs, ys,
+						a, nx);
+				poly_eval_batch(prog, insn->u.init.xe, xs, ys,
+						b, nx);
+				poly_eval_batch(prog, insn->u.init.ys, xs, ys,
+						c, nx);
+				poly_eval_batch(prog, insn->u.init.ye, xs, ys,
+						d, nx);
+				for (int i = 0; i < nx; ++i) {
+					if (row[i] != 0.) {
+						lost += deposit_rect(
+						    g, buf, a[i], b[i], c[i],
+						    d[i], row[i], wx, wy);
+					}
+				}
+				continue;
+			case I_TRANSLATION:
+				poly_eval_batch(prog, insn->u.translation.u, xs,
+						ys, a, nx);
+				poly_eval_batch(prog, insn->u.translation.v, xs,
+						ys, b, nx);
+#pragma omp simd
+				for (int i = 0; i < nx; ++i) {
+					a[i] += xs[i];
+					b[i] += ys[i];
+				}
+				break;
+			case I_ROTATION: {
+				poly_eval_batch(prog, insn->u.rotation.u, xs,
+						ys, a, nx);
+				poly_eval_batch(prog, insn->u.rotation.v, xs,
+						ys, b, nx);
+				if (insn->u.rotation.fixed) {
+					const double s = insn->u.rotation.s;
+					const double co = insn->u.rotation.c;
+#pragma omp simd
+					for (int i = 0; i < nx; ++i) {
+						const double rx = xs[i] - a[i];
+						const double ry = ys[i] - b[i];
+						a[i] += rx * co - ry * s;
+						b[i] += rx * s + ry * co;
+					}
+					break;
+				}
+				poly_eval_batch(prog, insn->u.rotation.theta,
+						xs, ys, c, nx);
+				for (int i = 0; i < nx; ++i) {
+					const double deg = c[i] / 180. * M_PI;
+					const double s = sin(deg);
+					const double co = cos(deg);
+					const double rx = xs[i] - a[i];
+					const double ry = ys[i] - b[i];
+					a[i] += rx * co - ry * s;
+					b[i] += rx * s + ry * co;
+				}
+				break;
+			}
+			default:
+				assert(false && "Unexpected insn type");
+			}
+			for (int i = 0; i < nx; ++i) {
+				if (row[i] != 0.) {
+					lost += splat(g, buf, a[i], b[i],
+						      row[i]);
+				}
+			}
+		}
+	}
+
+	double *mass = g->mass;
+#pragma omp parallel for simd
+	for (size_t k = 0; k < n; ++k) {
+		double sum = 0.;
+		for (int t = 0; t < nthreads; ++t) {
+			sum += bufs[t][k];
+		}
+		mass[k] = sum;
+	}
+	g->lost += lost;
+scatter_cleanup:
+	for (int t = 0; t < nthreads; ++t) {
+		free(bufs[t]);
+		free(scratches[t]);
+	}
+	free(bufs);
+	return ret;
+}
+
+// Push the probability mass in `g` through the `Insn` at `pc` of `prog`.
+int propagate(const Prog *prog, int pc, Grid *g, int iter_max)
+{
+	// 0: OK, 1: Uninitialized, 2: Out of memory
+	const Insn *insn = prog->insns + pc;
+	const size_t n = ncells(g);
+	int ret = 0;
+	switch (insn->type) {
+	case I_INIT: {
+		if (g->init && !init_const(prog, insn)) {
+			// The region depends on where the mass currently is.
+			// Mass outside the grid stays lost.
+			return scatter(prog, insn, g);
+		}
+		double *wx = malloc((g->nx + g->ny) * sizeof *wx);
+		if (!wx) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return 2;
+		}
+		// Either the region is the same wherever the mass is, or all
+		// the mass is at the origin before the initialization.
+		const double m = g->init ? total_mass(g) + g->lost : 1.;
+		memset(g->mass, 0, n * sizeof *g->mass);
+		if (insn->u.init.shape >= 0) {
+			g->lost = deposit_tris(
+			    g, g->mass, prog->shapes + insn->u.init.shape, m);
+			g->init = true;
+			free(wx);
+			break;
+		}
+		g->lost = deposit_rect(
+		    g, g->mass, poly_eval(prog, insn->u.init.xs, 0., 0.),
+		    poly_eval(prog, insn->u.init.xe, 0., 0.),
+		    poly_eval(prog, insn->u.init.ys, 0., 0.),
+		    poly_eval(prog, insn->u.init.ye, 0., 0.), m, wx,
+		    wx + g->nx);
+		g->init = true;
+		free(wx);
+		break;
+	}
+	case I_TRANSLATION:
+	case I_ROTATION:
+		if (!g->init) {
+			return 1;
+		}
+		ret = scatter(prog, insn, g);
+		break;
+	case I_ASSERT:
+	case I_REACH:
+		if (!g->init) {
+			return 1;
+		}
+		break;
+	case I_SEQUENCE:
+		ret = propagate(prog, insn->u.branch.p1, g, iter_max);
+		if (ret) {
+			return ret;
+		}
+		ret = propagate(prog, insn->u.branch.p2, g, iter_max);
+		break;
+	case I_OR: {
+		if (!g->init) {
+			return 1;
+		}
+		Grid right;
+		if (!dup_grid(&right, g)) {
+			return 2;
+		}
+		ret = propagate(prog, insn->u.branch.p1, g, iter_max);
+		if (!ret) {
+			ret = propagate(prog, insn->u.branch.p2, &right,
+					iter_max);
+		}
+		if (!ret) {
+			double *mass = g->mass;
+			const double *rmass = right.mass;
+#pragma omp parallel for simd
+			for (size_t k = 0; k < n; ++k) {
+				mass[k] = .5 * (mass[k] + rmass[k]);
+			}
+			g->lost = .5 * (g->lost + right.lost);
+		}
+		free_grid(&right);
+		break;
+	}
+	case I_ITER: {
+		if (!g->init) {
+			return 1;
+		}
+		// `acc` sums up the mass after 0, 1, ..., `iter_max` iterations.
+		Grid acc;
+		if (!dup_grid(&acc, g)) {
+			return 2;
+		}
+		for (int i = 0; i < iter_max; ++i) {
+			ret = propagate(prog, insn->u.iter_body, g, iter_max);
+			if (ret) {
+				break;
+			}
+			double *amass = acc.mass;
+			const double *mass = g->mass;
+#pragma omp parallel for simd
+			for (size_t k = 0; k < n; ++k) {
+				amass[k] += mass[k];
+			}
+			acc.lost += g->lost;
+		}
+		if (!ret) {
+			const double w = 1. / (iter_max + 1);
+			double *mass = g->mass;
+			const double *amass = acc.mass;
+#pragma omp parallel for simd
+			for (size_t k = 0; k < n; ++k) {
+				mass[k] = w * amass[k];
+			}
+			g->lost = w * acc.lost;
+		}
+		free_grid(&acc);
+		break;
+	}
+	}
+	return ret;
+}
+
+// Print the center and the mass of every cell with a nonzero mass.
+void p_grid(FILE *stream, const Grid *g)
+{
+	for (int j = 0; j < g->ny; ++j) {
+		const double y = g->y0 + (j + .5) * g->dy;
+		for (int i = 0; i < g->nx; ++i) {
+			const double m = g->mass[(size_t)j * g->nx + i];
+			if (m > 0.) {
+				fprintf(stream, "%lf %lf %le\n",
+					g->x0 + (i + .5) * g->dx, y, m);
+			}
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Probability mass on a regular grid of `nx` by `ny` cells over
+// [x0, x0 + nx * dx) x [y0, y0 + ny * dy). The mass of a cell is concentrated
+// at its center.
+typedef struct Grid {
+	double x0, y0;
+	double dx, dy;
+	int nx, ny;
+	double *mass; // `ny` rows of `nx` cells
+	double lost;  // Mass that has left the grid
+	bool init;
+} Grid;
+
+// Initialize `g` with no mass. Returns `false` if failed.
+bool new_grid(Grid *g, double x0, double x1, double y0, double y1, int nx,
+	      int ny);
+
+void free_grid(Grid *g);
+
+struct Prog;
+// Push the probability mass in `g` through the `Insn` at `pc` of `prog`:
+// `init` spreads the mass uniformly over its region, `translation` and
+// `rotation` move the mass of each cell and resample it onto the grid, `or`
+// takes the half-half mixture of its branches, and `iter` takes the uniform
+// mixture over 0 to `iter_max` iterations.
+// Returns 0 if successful; 1 if uninitialized, 2 if out of memory.
+int propagate(const struct Prog *prog, int pc, Grid *g, int iter_max);
+
+// Print the center and the mass of every cell with a nonzero mass to `stream`.
+void p_grid(FILE *stream, const Grid *g);
+
+#endif /* ifndef DENSITY_H */
@@ -1,6 +1,9 @@
 #include "eval.h"
-#include "ast.h"
-#include "term.h"
+#include "check.h"
+#include "compile.h"
+#include "profile.h"
+#include "record.h"
+#include "trace.h"
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -11,289 +14,272 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-#define CHK_EVAL_POLY(poly, ast, label)                                        \
-	do {                                                                   \
-		poly = eval_poly(ast);                                         \
-		if (!poly) {                                                   \
-			poly_err_msg(ast);                                     \
-			ret = 3;                                               \
-			goto label;                                            \
-		}                                                              \
-		if (!num_poly(poly)) {                                         \
-			non_num_msg(ast, poly);                                \
-			ret = 2;                                               \
-			goto label;                                            \
-		}                                                              \
-	} while (0);
+static int timed(Sampler *s, int pc, Env *env);
+static inline int descend(Sampler *s, int pc, Env *env);
+static int step(Sampler *s, int pc, Env *env);
+static double draw(Sampler *s);
+static double unit(Sampler *s);
+static double randf(Sampler *s, double start, double end);
+static bool coin(Sampler *s);
+static int randi(Sampler *s, int n);
+static void emit(Sampler *s, Event *ev);
 
-static double randf(double s, double e);
-static int randi(int n);
+int eval(Sampler *s, int pc, Env *env) { return descend(s, pc, env); }
 
-static TermNode *eval_poly(const ASTNode *ast)
+// Run the `Insn` at `pc` as `eval` does, and count it into `s->prof`.
+static int timed(Sampler *s, int pc, Env *env)
 {
-	if (!ast) { // for NEG op
-		return NULL;
-	}
-	switch (ast->type) {
-	case OP_T: {
-		enum Op op = ast->u.op_dat.op;
-		TermNode *lt = eval_poly(ast->u.op_dat.larg);
-		TermNode *rt = eval_poly(ast->u.op_dat.rarg);
-
-		// Result of `eval_poly` being `NULL` indicates an invalid
-		// syntax or an operation, except for the result of evaluating
-		// the right child of the `NEG` op.
-		if (!lt || (!rt && op != NEG)) {
-			free_poly(lt);
-			free_poly(rt);
-			return NULL;
-		}
-
-		bool success;
-		switch (op) {
-		case ADD:
-			success = add_poly(&lt, rt);
-			break;
-		case SUB:
-			success = sub_poly(&lt, rt);
-			break;
-		case MUL:
-			success = mul_poly(&lt, rt);
-			break;
-		case DIV:
-			success = div_poly(&lt, rt);
-			break;
-		case POW:
-			success = pow_poly(&lt, rt);
-			break;
-		case NEG:
-			success = neg_poly(lt);
-			break;
-		default:
-			assert(false && "Unknown op type");
-		}
-		if (!success) {
-			free_poly(lt);
-			return NULL;
-		}
-		return lt;
-	}
-	case NUM_T: {
-		TermNode *t = coeff_term(ast->u.num);
-		if (!t) {
-			goto mem_err;
-		}
-		return t;
-	}
-	case VAR_T: {
-		TermNode *p = coeff_term(1.);
-		if (!p) {
-			goto mem_err;
-		}
-		TermNode *vt = var_term(ast->u.var, 1);
-		if (!vt) {
-			goto mem_err;
-		}
-		p->u.vars = vt;
-		return p;
-	}
-	default:
-		assert(false && "Unexpected node type");
-	}
-mem_err:
-	fputs("Failed to allocate memory.\n", stderr);
-	return NULL;
-}
-
-static void poly_err_msg(const ASTNode *ast)
-{
-	fputs("Evaluation of '", stderr);
-	p_sexp_ast(stderr, ast);
-	fputs("' failed\n", stderr);
+	Profile *prof = s->prof;
+	const unsigned long long start = prof_clock();
+	const int ret = step(s, pc, env);
+	prof->ticks[pc] += prof_clock() - start;
+	++prof->visits[pc];
+	return ret;
 }
 
-static void non_num_msg(const ASTNode *ast, const TermNode *poly)
+// Run the `Insn` at `pc`, profiled if asked, so that the usual run of `step`
+// calls itself directly.
+static inline int descend(Sampler *s, int pc, Env *env)
 {
-	fputs("Evaluation of '", stderr);
-	p_sexp_ast(stderr, ast);
-	fputs("' results in a non-number '", stderr);
-	print_poly(poly);
-	fputs("'\n", stderr);
+	return s->prof ? timed(s, pc, env) : step(s, pc, env);
 }
 
-int eval(const ASTNode *ast, Env *env, int iter_max, bool verbose)
+// Run the `Insn` at `pc` for `eval`.
+static int step(Sampler *s, int pc, Env *env)
 {
-	// 0: OK, 1: Uninitialized, 2: Non-number argument, 3: Polynomial error
+	// 0: OK, 1: Uninitialized
+	const Prog *prog = s->prog;
+	// Whether the steps are traced or printed
+	const bool tracing = s->tracer || s->verbose;
+	const Insn *insn = prog->insns + pc;
 	int ret = 0;
-	switch (ast->type) {
-	case INIT_T:
+	switch (insn->type) {
+	case I_INIT: {
+		if (insn->u.init.shape >= 0) {
+			const double u = unit(s);
+			const double v = unit(s);
+			const double w = unit(s);
+			tris_point(prog->shapes + insn->u.init.shape, u, v, w,
+				   &env->x, &env->y);
+			env->init = true;
+			if (tracing) {
+				emit(s, &(Event){.type = EV_POLYGON,
+						 .n = insn->u.init.shape,
+						 .u.v = {env->x, env->y}});
+			}
+			break;
+		}
+		// The bounds are evaluated against the state before
+		// initialization, which is the origin for the first `init`.
+		const double xs = poly_eval(prog, insn->u.init.xs, env->x, env->y);
+		const double xe = poly_eval(prog, insn->u.init.xe, env->x, env->y);
+		const double ys = poly_eval(prog, insn->u.init.ys, env->x, env->y);
+		const double ye = poly_eval(prog, insn->u.init.ye, env->x, env->y);
+
+		const double xr = randf(s, xs, xe);
+		const double yr = randf(s, ys, ye);
 		env->init = true;
-		ret = eval(ast->u.init_region, env, iter_max, verbose);
+		env->x = xr;
+		env->y = yr;
+
+		if (tracing) {
+			emit(s, &(Event){.type = EV_INIT,
+					 .u.v = {xs, xe, ys, ye, xr, yr}});
+		}
 		break;
-	case TRANSLATION_T: {
+	}
+	case I_TRANSLATION: {
 		if (!env->init) {
 			return 1;
 		}
-
-		TermNode *u_poly = NULL;
-		TermNode *v_poly = NULL;
-		CHK_EVAL_POLY(u_poly, ast->u.translation_args.u, trans_cleanup);
-		CHK_EVAL_POLY(v_poly, ast->u.translation_args.v, trans_cleanup);
-
-		const double u = u_poly->hd.val;
-		const double v = v_poly->hd.val;
+		// Both arguments are evaluated against the state before the
+		// translation.
+		const double u =
+		    poly_eval(prog, insn->u.translation.u, env->x, env->y);
+		const double v =
+		    poly_eval(prog, insn->u.translation.v, env->x, env->y);
 		env->x += u;
 		env->y += v;
 
-		if (verbose) {
-			fprintf(stderr, "Translate +(%lf, %lf) -> (%lf, %lf)\n",
-				u, v, env->x, env->y);
+		if (tracing) {
+			emit(s, &(Event){.type = EV_TRANSLATE,
+					 .u.v = {u, v, env->x, env->y}});
 		}
-	trans_cleanup:
-		free_poly(u_poly);
-		free_poly(v_poly);
 		break;
 	}
-	case ROTATION_T: {
+	case I_ROTATION: {
 		if (!env->init) {
 			return 1;
 		}
-		TermNode *u_poly = NULL;
-		TermNode *v_poly = NULL;
-		TermNode *theta_poly = NULL;
-		CHK_EVAL_POLY(u_poly, ast->u.rotation_args.u, rot_cleanup);
-		CHK_EVAL_POLY(v_poly, ast->u.rotation_args.v, rot_cleanup);
-		CHK_EVAL_POLY(theta_poly, ast->u.rotation_args.theta,
-			      rot_cleanup);
-
-		const double u = u_poly->hd.val;
-		const double v = v_poly->hd.val;
-		const double theta = theta_poly->hd.val;
+		const double u =
+		    poly_eval(prog, insn->u.rotation.u, env->x, env->y);
+		const double v =
+		    poly_eval(prog, insn->u.rotation.v, env->x, env->y);
 
-		const double deg = theta / 180. * M_PI;
-		const double s = sin(deg);
-		const double c = cos(deg);
+		double deg, sn, c;
+		if (insn->u.rotation.fixed) {
+			deg = poly_eval(prog, insn->u.rotation.theta, 0., 0.) /
+			      180. * M_PI;
+			sn = insn->u.rotation.s;
+			c = insn->u.rotation.c;
+		} else {
+			deg = poly_eval(prog, insn->u.rotation.theta, env->x,
+					env->y) /
+			      180. * M_PI;
+			sn = sin(deg);
+			c = cos(deg);
+		}
 
 		// Subtract, rotate, and then add again.
 		env->x -= u;
 		env->y -= v;
 
-		const double rx = env->x * c - env->y * s;
-		const double ry = env->x * s + env->y * c;
+		const double rx = env->x * c - env->y * sn;
+		const double ry = env->x * sn + env->y * c;
 		env->x = rx + u;
 		env->y = ry + v;
 
-		if (verbose) {
-			fprintf(stderr,
-				"Rotate @(%lf, %lf, %lfdeg) -> (%lf, %lf)\n", u,
-				v, deg, env->x, env->y);
+		if (tracing) {
+			emit(s, &(Event){.type = EV_ROTATE,
+					 .u.v = {u, v, deg, env->x, env->y}});
 		}
-	rot_cleanup:
-		free_poly(u_poly);
-		free_poly(v_poly);
-		free_poly(theta_poly);
 		break;
 	}
-	case SEQUENCE_T:
-		ret = eval(ast->u.sequence_ps.p1, env, iter_max, verbose);
+	case I_SEQUENCE:
+		ret = descend(s, insn->u.branch.p1, env);
 		if (ret) {
 			return ret;
 		}
-		ret = eval(ast->u.sequence_ps.p2, env, iter_max, verbose);
+		ret = descend(s, insn->u.branch.p2, env);
 		break;
-	case OR_T: {
+	case I_OR: {
 		if (!env->init) {
 			return 1;
 		}
-		int right = randi(2);
-		if (verbose) {
-			fprintf(stderr, "OR selected %s\n",
-				right ? "right" : "left");
+		int right = coin(s);
+		if (tracing) {
+			emit(s, &(Event){.type = EV_OR, .flag = right});
 		}
 		if (right) {
-			ret = eval(ast->u.or_ps.p2, env, iter_max, verbose);
+			ret = descend(s, insn->u.branch.p2, env);
 		} else {
-			ret = eval(ast->u.or_ps.p1, env, iter_max, verbose);
+			ret = descend(s, insn->u.branch.p1, env);
 		}
 		break;
 	}
-	case ITER_T: {
+	case I_ASSERT:
+	case I_REACH: {
 		if (!env->init) {
 			return 1;
 		}
-		int iter = randi(iter_max + 1);
-		if (verbose) {
-			fprintf(stderr, "Iterate %d times\n", iter);
+		Check *c = s->check;
+		if (!c) {
+			break;
+		}
+		const int q = insn->u.query;
+		const bool in = region_contains(&prog->queries[q].region,
+						env->x, env->y);
+		if (tracing) {
+			const int flag =
+			    (insn->type == I_ASSERT ? EV_ASSERT : 0) |
+			    (in ? EV_IN : 0);
+			emit(s, &(Event){.type = EV_QUERY,
+					 .flag = flag,
+					 .n = q,
+					 .u.v = {env->x, env->y}});
+		}
+		if (c->hit[q] || in == (insn->type == I_ASSERT)) {
+			break;
+		}
+		c->hit[q] = true;
+		c->at[2 * q] = env->x;
+		c->at[2 * q + 1] = env->y;
+		if (insn->type == I_ASSERT ||
+		    (!--c->pending && !prog->nasserts)) {
+			return EVAL_DECIDED;
+		}
+		break;
+	}
+	case I_ITER: {
+		if (!env->init) {
+			return 1;
+		}
+		int iter = randi(s, s->iter_max + 1);
+		if (tracing) {
+			emit(s, &(Event){.type = EV_ITER, .n = iter});
 		}
 		for (int i = 0; i < iter; ++i) {
-			ret = eval(ast->u.iter_body, env, iter_max, verbose);
+			ret = descend(s, insn->u.iter_body, env);
 			if (ret) {
 				return ret;
 			}
 		}
 		break;
 	}
-	case REGION_T: {
-		TermNode *xs_poly = NULL;
-		TermNode *xe_poly = NULL;
-		TermNode *ys_poly = NULL;
-		TermNode *ye_poly = NULL;
-		CHK_EVAL_POLY(xs_poly, ast->u.region_ts.t1->u.interval_ns.n1,
-			      region_cleanup);
-		CHK_EVAL_POLY(xe_poly, ast->u.region_ts.t1->u.interval_ns.n2,
-			      region_cleanup);
-		CHK_EVAL_POLY(ys_poly, ast->u.region_ts.t2->u.interval_ns.n1,
-			      region_cleanup);
-		CHK_EVAL_POLY(ye_poly, ast->u.region_ts.t2->u.interval_ns.n2,
-			      region_cleanup);
+	}
+	return ret;
+}
 
-		const double xs = xs_poly->hd.val;
-		const double xe = xe_poly->hd.val;
-		const double ys = ys_poly->hd.val;
-		const double ye = ye_poly->hd.val;
+// Trace `ev` into the tracer of `s`, and print it if verbose.
+static void emit(Sampler *s, Event *ev)
+{
+	if (s->tracer) {
+		trace_event(s->tracer, ev);
+	}
+	if (s->verbose) {
+		p_event(stderr, ev);
+	}
+}
 
-		const double xr = randf(xs, xe);
-		const double yr = randf(ys, ye);
-		env->x = xr;
-		env->y = yr;
+// Uniform number in [0, 1) from the source of `s`.
+static double draw(Sampler *s)
+{
+	return s->qmc ? next_qmc(&s->q) : unit_rng(&s->rng);
+}
 
-		if (verbose) {
-			fprintf(stderr,
-				"Initialize in region [%lf, %lf] x [%lf, %lf]: "
-				"(%lf, %lf)\n",
-				xs, xe, ys, ye, xr, yr);
-		}
-	region_cleanup:
-		free_poly(xs_poly);
-		free_poly(xe_poly);
-		free_poly(ys_poly);
-		free_poly(ye_poly);
-		break;
+// Uniform number in [0, 1) for an `init`, recorded or replayed in full. Both
+// sources give multiples of 2^-53.
+static double unit(Sampler *s)
+{
+	if (s->replay) {
+		return get_bits(s->rec, 53) * 0x1.0p-53;
 	}
-	case INTERVAL_T:
-		assert(false && "Invalid `ast->type`: `INTERVAL_T`");
-		break;
-	case OP_T:
-		assert(false && "Invalid `ast->type`: `OP_T`");
-		break;
-	case NUM_T:
-		assert(false && "Invalid `ast->type`: `NUM_T`");
-		break;
-	case VAR_T:
-		assert(false && "Invalid `ast->type`: `VAR_T`");
-		break;
+	const double u = draw(s);
+	if (s->rec) {
+		put_bits(s->rec, (uint64_t)(u * 0x1.0p53), 53);
 	}
-	return ret;
+	return u;
 }
 
-static double randf(double s, double e)
+static double randf(Sampler *s, double start, double end)
 {
-	return (e - s) * ((double)rand() / (double)RAND_MAX) + s;
+	return (end - start) * unit(s) + start;
 }
 
-// Random integer from 0 to `n` - 1.
-static int randi(int n)
+// Fair coin for an `or`, recorded or replayed as a bit.
+static bool coin(Sampler *s)
+{
+	if (s->replay) {
+		return get_bits(s->rec, 1);
+	}
+	const bool r = draw(s) * 2. >= 1.;
+	if (s->rec) {
+		put_bits(s->rec, r, 1);
+	}
+	return r;
+}
+
+// Random integer from 0 to `n` - 1 for an `iter`, recorded or replayed as a
+// count whatever `n` is, which replaying does not know.
+static int randi(Sampler *s, int n)
 {
 	assert(n > 0);
-	return (int)((double)rand() / ((double)RAND_MAX + 1) * n);
+	if (s->replay) {
+		return (int)get_count(s->rec);
+	}
+	const int r = (int)(draw(s) * n);
+	if (s->rec) {
+		put_count(s->rec, r);
+	}
+	return r;
 }
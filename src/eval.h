@@ -1,16 +1,45 @@
 #ifndef EVAL_H
 #define EVAL_H
+#include "qmc.h"
+#include "rng.h"
 #include <stdbool.h>
 
+// `eval` stopped a trajectory whose queries are decided.
+#define EVAL_DECIDED 3
+
 typedef struct Env {
 	bool init;
 	double x;
 	double y;
 } Env;
 
-struct ASTNode;
-// Returns 0 if successful; 1 if uninitialized, 2 if non-number argument for an
-// argument expecting a number.
-int eval(const struct ASTNode *ast, Env *env, int iter_max, bool verbose);
+// State of a thread sampling trajectories of `prog`.
+typedef struct Sampler {
+	const struct Prog *prog;
+	int iter_max;
+	bool verbose;
+	// Draw from `q` rather than `rng` if set
+	bool qmc;
+	Rng rng;
+	Qmc q;
+	// If set, the queries are checked into `check`; otherwise they are
+	// skipped.
+	struct Check *check;
+	// If set, the choices are appended to `rec`, or read back from it
+	// instead of drawn if `replay` is also set.
+	struct Record *rec;
+	bool replay;
+	// If set, the steps are traced into `tracer`.
+	struct Tracer *tracer;
+	// If set, the visits and ticks of each `Insn` are counted into `prof`.
+	struct Profile *prof;
+} Sampler;
+
+// Evaluate the `Insn` at `pc` of `s->prog`. Arguments of `translation` and
+// `rotation` are evaluated against the current `env`.
+// Returns 0 if successful; 1 if uninitialized; `EVAL_DECIDED` if a query has
+// decided the trajectory: an `assert` is violated, or every `reach` is reached
+// and there is no `assert`.
+int eval(Sampler *s, int pc, Env *env);
 
 #endif /* ifndef EVAL_H */
@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gisa.h"
+#include "image.h"
+#include "parser.tab.h"
+#include "util.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Forward declarations for static functions
+static bool read_all(FILE *in, char **text, size_t *len);
+static char *image_path(const char *cache, const char *text, size_t len);
+static void save_image(Gisa *g);
+static void release_prog(Gisa *g);
+
+void new_gisa(Gisa *g, const char *name)
+{
+	*g = (Gisa){.name = name};
+}
+
+bool parse_file(Gisa *g, FILE *in)
+{
+	free_nodes(&g->nlist);
+	g->ast = NULL;
+	Scan scan = {.name = g->name, .line = 1};
+	yyscan_t scanner;
+	if (yylex_init_extra(&scan, &scanner)) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	yyset_in(in, scanner);
+	const bool ok = !yyparse(scanner, &g->nlist, &g->ast);
+	yylex_destroy(scanner);
+	if (!ok) {
+		g->ast = NULL;
+	}
+	return ok;
+}
+
+bool parse_text(Gisa *g, const char *text, size_t len)
+{
+	// The scanner only reads `text`.
+	FILE *in = fmemopen((char *)text, len, "r");
+	if (!in) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	const bool ok = parse_file(g, in);
+	fclose(in);
+	return ok;
+}
+
+// Read the rest of `in` into `*text` of `*len` bytes, which is to be freed.
+// Returns `false` if failed, in which case `errno` tells why.
+static bool read_all(FILE *in, char **text, size_t *len)
+{
+	size_t cap = 4096;
+	char *buf = malloc(cap);
+	size_t n = 0;
+	while (buf) {
+		n += fread(buf + n, 1, cap - n, in);
+		if (n < cap) {
+			break;
+		}
+		char *more = realloc(buf, cap *= 2);
+		if (!more) {
+			free(buf);
+		}
+		buf = more;
+	}
+	if (!buf) {
+		errno = ENOMEM;
+		return false;
+	}
+	if (ferror(in)) {
+		free(buf);
+		return false;
+	}
+	*text = buf;
+	*len = n;
+	return true;
+}
+
+// The path of the image of the `len` bytes of `text` in `cache`, to be freed,
+// or `NULL` if failed.
+static char *image_path(const char *cache, const char *text, size_t len)
+{
+	const size_t size = strlen(cache) + 32;
+	char *path = malloc(size);
+	if (!path) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return NULL;
+	}
+	snprintf(path, size, "%s/%016llx.gisai", cache,
+		 (unsigned long long)fnv1a(text, len));
+	return path;
+}
+
+bool load_gisa(Gisa *g, FILE *in, const char *cache)
+{
+	free(g->text);
+	g->text = NULL;
+	char *text;
+	size_t len;
+	if (!read_all(in, &text, &len)) {
+		fprintf(stderr, "%s: read error: %s\n", g->name,
+			strerror(errno));
+		return false;
+	}
+	char *path = image_path(cache, text, len);
+	if (!path) {
+		free(text);
+		return false;
+	}
+	free_nodes(&g->nlist);
+	g->ast = NULL;
+	release_prog(g);
+	const bool mapped = map_image(path, text, len, &g->prog, &g->image,
+				      &g->image_len);
+	free(path);
+	if (mapped) {
+		g->compiled = true;
+		free(text);
+		return true;
+	}
+	const bool ok = parse_text(g, text, len);
+	if (ok) {
+		g->cache = cache;
+		g->text = text;
+		g->len = len;
+	} else {
+		free(text);
+	}
+	return ok;
+}
+
+// Write the image of the program compiled into `g` to its cache, if loaded so,
+// and forget its source. Failing to is reported but harmless.
+static void save_image(Gisa *g)
+{
+	if (!g->text) {
+		return;
+	}
+	char *path = image_path(g->cache, g->text, g->len);
+	char *tmp = path ? malloc(strlen(path) + 8) : NULL;
+	if (path && !tmp) {
+		fputs("Failed to allocate memory.\n", stderr);
+	}
+	if (!tmp) {
+		goto cleanup;
+	}
+	// Written whole under a temporary name, so that no other run can map
+	// a partial image.
+	sprintf(tmp, "%s.XXXXXX", path);
+	mkdir(g->cache, 0777);
+	errno = 0;
+	const int fd = mkstemp(tmp);
+	FILE *out = fd >= 0 && !fchmod(fd, 0644) ? fdopen(fd, "wb") : NULL;
+	bool ok = out && write_image(out, &g->prog, g->text, g->len);
+	if (out) {
+		ok = !fclose(out) && ok;
+	} else if (fd >= 0) {
+		close(fd);
+	}
+	if (ok && !rename(tmp, path)) {
+		goto cleanup;
+	}
+	fprintf(stderr, "%s: cannot write '%s': %s\n", g->name, path,
+		strerror(errno ? errno : EIO));
+	if (fd >= 0) {
+		unlink(tmp);
+	}
+
+cleanup:
+	free(tmp);
+	free(path);
+	free(g->text);
+	g->text = NULL;
+}
+
+// Release the compiled or mapped program of `g`, if any.
+static void release_prog(Gisa *g)
+{
+	if (g->image) {
+		unmap_image(&g->prog, g->image, g->image_len);
+		g->image = NULL;
+	} else if (g->compiled) {
+		free_prog(&g->prog);
+	}
+	g->compiled = false;
+}
+
+bool compile_gisa(Gisa *g)
+{
+	release_prog(g);
+	if (!g->ast ||
+	    !(g->compiled = compile_memo(g->ast, &g->prog, g->memo))) {
+		return false;
+	}
+	save_image(g);
+	return true;
+}
+
+void free_gisa(Gisa *g)
+{
+	release_prog(g);
+	free_nodes(&g->nlist);
+	free(g->text);
+	*g = (Gisa){.name = g->name};
+}
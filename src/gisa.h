@@ -0,0 +1,70 @@
+#ifndef GISA_H
+#define GISA_H
+
+/* libgisa: the interpreter without its command line, for embedding.
+ *
+ * A program is parsed and compiled into a `Gisa` of its own, and then sampled
+ * with `sample` or analyzed with `analyze` on its `prog`. None of these keep
+ * state outside their arguments: the parser and the scanner are reentrant,
+ * and the random numbers of a trajectory are drawn from a generator of the
+ * `Sampler` seeded by its index. Threads may therefore work on different
+ * programs at once, and sample or analyze the same compiled program at once.
+ * Only a `Gisa` itself must not be shared while it is parsed, compiled, or
+ * freed.
+ *
+ * Errors are reported to `stderr`, prefixed with the name of the program.
+ */
+
+#include "analyze.h"
+#include "ast.h"
+#include "compile.h"
+#include "sample.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// A program, its AST, and its compiled `Insn`s.
+typedef struct Gisa {
+	const char *name; // Name of the program in messages
+	NodeList nlist;	  // Owns all the `ASTNode`s
+	ASTNode *ast;	  // Set once parsed
+	Prog prog;	  // Set once compiled or mapped
+	bool compiled;
+	// Loaded by `load_gisa`: the directory of images, and the source
+	// until its image is written
+	const char *cache;
+	char *text;
+	size_t len;
+	// Mapping of the image `prog` is mapped from, if any
+	void *image;
+	size_t image_len;
+	// Polynomials and regions kept from the programs compiled before, to
+	// compile with and to keep those of the next in, if set
+	struct Memo *memo;
+} Gisa;
+
+// Initialize `g` for a program named `name`, which must outlive `g`.
+void new_gisa(Gisa *g, const char *name);
+
+// Parse the program read from `in` into `g`. Returns `false` if failed, which
+// has been reported.
+bool parse_file(Gisa *g, FILE *in);
+
+// Parse the program of the `len` bytes of `text` into `g`. Returns `false` if
+// failed, which has been reported.
+bool parse_text(Gisa *g, const char *text, size_t len);
+
+// Map the program read from `in` into `g` from its image in the directory
+// `cache`, named by the hash of its source, or else parse it as `parse_file`
+// does and have `compile_gisa` write its image there. A mapped program is
+// compiled already but has no AST. Returns `false` if failed, which has been
+// reported.
+bool load_gisa(Gisa *g, FILE *in, const char *cache);
+
+// Compile the program parsed into `g` into `g->prog`, with `g->memo` if set.
+// Returns `false` if failed, which has been reported.
+bool compile_gisa(Gisa *g);
+
+void free_gisa(Gisa *g);
+
+#endif /* ifndef GISA_H */
@@ -0,0 +1,151 @@
+#include "hist.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tgmath.h>
+
+// Size of a cache line
+#define CACHE_LINE 64
+
+// Forward declarations for static functions
+static size_t nbins(const Hist *h);
+static uint64_t max_count(const Hist *h);
+static double level(uint64_t count, double log_max);
+static void colormap(double t, unsigned char *rgb);
+
+bool parse_raster(const char *name, Raster *raster)
+{
+	static const char *const names[] = {"pgm", "ppm", "counts"};
+	for (size_t i = 0; i < sizeof names / sizeof *names; ++i) {
+		if (!strcmp(name, names[i])) {
+			*raster = (Raster)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static size_t nbins(const Hist *h) { return (size_t)h->nx * h->ny; }
+
+bool new_hist(Hist *h, double x0, double x1, double y0, double y1, int nx,
+	      int ny)
+{
+	*h = (Hist){.x0 = x0,
+		    .y0 = y0,
+		    .dx = (x1 - x0) / nx,
+		    .dy = (y1 - y0) / ny,
+		    .nx = nx,
+		    .ny = ny};
+	size_t size = nbins(h) * sizeof *h->counts;
+	size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+	h->counts = aligned_alloc(CACHE_LINE, size);
+	if (!h->counts) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	memset(h->counts, 0, size);
+	return true;
+}
+
+bool new_hist_like(Hist *dest, const Hist *src)
+{
+	return new_hist(dest, src->x0, src->x0 + src->nx * src->dx, src->y0,
+			src->y0 + src->ny * src->dy, src->nx, src->ny);
+}
+
+void free_hist(Hist *h)
+{
+	free(h->counts);
+	h->counts = NULL;
+}
+
+void merge_hist(Hist *dest, const Hist *src)
+{
+	const size_t n = nbins(dest);
+	uint64_t *restrict d = dest->counts;
+	const uint64_t *restrict s = src->counts;
+	for (size_t k = 0; k < n; ++k) {
+		d[k] += s[k];
+	}
+	dest->outside += src->outside;
+}
+
+static uint64_t max_count(const Hist *h)
+{
+	const size_t n = nbins(h);
+	uint64_t max = 0;
+	for (size_t k = 0; k < n; ++k) {
+		max = h->counts[k] > max ? h->counts[k] : max;
+	}
+	return max;
+}
+
+// Log-scaled intensity of `count` in [0, 1], where `log_max` is log(1 + max).
+static double level(uint64_t count, double log_max)
+{
+	return log_max > 0. ? log1p((double)count) / log_max : 0.;
+}
+
+// Map `t` in [0, 1] to black, purple, red, orange, and then pale yellow.
+static void colormap(double t, unsigned char *rgb)
+{
+	static const double stops[][3] = {{0., 0., 4.},
+					  {87., 16., 110.},
+					  {188., 55., 84.},
+					  {249., 142., 9.},
+					  {252., 255., 164.}};
+	const int last = sizeof stops / sizeof *stops - 1;
+	const double f = t * last;
+	int i = (int)f;
+	i = i >= last ? last - 1 : i;
+	const double a = f - i;
+	for (int c = 0; c < 3; ++c) {
+		rgb[c] = (unsigned char)lround((1. - a) * stops[i][c] +
+					       a * stops[i + 1][c]);
+	}
+}
+
+bool write_hist(FILE *stream, const Hist *h, Raster raster)
+{
+	const double log_max = log1p((double)max_count(h));
+	switch (raster) {
+	case RASTER_PGM:
+	case RASTER_PPM: {
+		const int channels = raster == RASTER_PGM ? 1 : 3;
+		unsigned char *row = malloc((size_t)h->nx * channels);
+		if (!row) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		fprintf(stream, "%s\n%d %d\n255\n",
+			raster == RASTER_PGM ? "P5" : "P6", h->nx, h->ny);
+		for (int j = h->ny - 1; j >= 0; --j) {
+			const uint64_t *counts = h->counts + (size_t)j * h->nx;
+			for (int i = 0; i < h->nx; ++i) {
+				const double t = level(counts[i], log_max);
+				if (channels == 1) {
+					row[i] = (unsigned char)lround(255. * t);
+				} else {
+					colormap(t, row + 3 * i);
+				}
+			}
+			fwrite(row, channels, h->nx, stream);
+		}
+		free(row);
+		break;
+	}
+	case RASTER_COUNTS:
+		for (int j = h->ny - 1; j >= 0; --j) {
+			const uint64_t *counts = h->counts + (size_t)j * h->nx;
+			for (int i = 0; i < h->nx; ++i) {
+				fprintf(stream, i ? " %llu" : "%llu",
+					(unsigned long long)counts[i]);
+			}
+			putc('\n', stream);
+		}
+		break;
+	}
+	return !ferror(stream);
+}
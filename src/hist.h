@@ -0,0 +1,58 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum Raster {
+	RASTER_PGM,   // Binary grayscale PGM of log-scaled counts
+	RASTER_PPM,   // Binary color PPM of log-scaled counts
+	RASTER_COUNTS // Counts as text, a row per line
+} Raster;
+
+// 2D histogram of points over a regular grid of `nx` by `ny` bins over
+// [x0, x0 + nx * dx) x [y0, y0 + ny * dy). `counts` is aligned to a cache
+// line and padded to a whole number of them, so that the histograms of
+// different threads never share a line.
+typedef struct Hist {
+	double x0, y0;
+	double dx, dy;
+	int nx, ny;
+	uint64_t *counts; // `ny` rows of `nx` bins
+	uint64_t outside; // Points outside the grid
+} Hist;
+
+// Parse a raster format name, i.e., "pgm", "ppm", or "counts". Returns `false`
+// if `name` is unknown.
+bool parse_raster(const char *name, Raster *raster);
+
+// Initialize `h` with no points. Returns `false` if failed.
+bool new_hist(Hist *h, double x0, double x1, double y0, double y1, int nx,
+	      int ny);
+
+// Initialize `dest` with no points over the same grid as `src`. Returns
+// `false` if failed.
+bool new_hist_like(Hist *dest, const Hist *src);
+
+void free_hist(Hist *h);
+
+static inline void hist_add(Hist *h, double x, double y)
+{
+	const double fx = (x - h->x0) / h->dx;
+	const double fy = (y - h->y0) / h->dy;
+	if (fx >= 0. && fx < h->nx && fy >= 0. && fy < h->ny) {
+		++h->counts[(size_t)fy * h->nx + (size_t)fx];
+	} else {
+		++h->outside; // Also catches NaNs.
+	}
+}
+
+// Add the counts of `src` to `dest` over the same grid.
+void merge_hist(Hist *dest, const Hist *src);
+
+// Write `h` to `stream` in `raster`, with the highest `y` at the top.
+// Returns `false` if failed.
+bool write_hist(FILE *stream, const Hist *h, Raster raster);
+
+#endif /* ifndef HIST_H */
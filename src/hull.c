@@ -0,0 +1,243 @@
+#include "hull.h"
+#include "output.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Forward declarations for static functions
+static double cross(HullPoint o, HullPoint a, HullPoint b);
+static bool less(HullPoint a, HullPoint b);
+static int point_cmp(const void *a, const void *b);
+static bool inside(const Hull *h, HullPoint p);
+static bool grow(Hull *h, size_t cap);
+static bool add(Hull *h, HullPoint p);
+static size_t merge_sorted(Hull *h);
+
+void new_hull(Hull *h)
+{
+	*h = (Hull){0};
+}
+
+void free_hull(Hull *h)
+{
+	free(h->pts);
+	free(h->chain);
+	*h = (Hull){0};
+}
+
+// Twice the signed area of the triangle `o`, `a`, `b`: positive if it turns
+// counterclockwise.
+static double cross(HullPoint o, HullPoint a, HullPoint b)
+{
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Whether `a` comes before `b` by `x`, then by `y`.
+static bool less(HullPoint a, HullPoint b)
+{
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+static int point_cmp(const void *a, const void *b)
+{
+	const HullPoint *p = a;
+	const HullPoint *q = b;
+	return less(*p, *q) ? -1 : less(*q, *p);
+}
+
+// Whether `p` lies in the hull of the vertices of `h`, boundary included.
+static bool inside(const Hull *h, HullPoint p)
+{
+	const HullPoint *v = h->pts;
+	const size_t n = h->n;
+	if (n < 3 || cross(v[0], v[1], p) < 0. ||
+	    cross(v[0], v[n - 1], p) > 0.) {
+		return false;
+	}
+	// Find the triangle `v[0]`, `v[lo]`, `v[lo + 1]` of the fan whose
+	// wedge holds `p`.
+	size_t lo = 1;
+	size_t hi = n - 1;
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (cross(v[0], v[mid], p) >= 0.) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return cross(v[lo], v[lo + 1], p) >= 0.;
+}
+
+static bool grow(Hull *h, size_t cap)
+{
+	HullPoint *pts = realloc(h->pts, cap * sizeof *pts);
+	if (!pts) {
+		fputs("Failed to allocate memory.\n", stderr);
+		h->err = true;
+		return false;
+	}
+	h->pts = pts;
+	HullPoint *chain = realloc(h->chain, cap * sizeof *chain);
+	if (!chain) {
+		fputs("Failed to allocate memory.\n", stderr);
+		h->err = true;
+		return false;
+	}
+	h->chain = chain;
+	h->cap = cap;
+	return true;
+}
+
+// Add the finite point `p` to `h` unless it is inside.
+static bool add(Hull *h, HullPoint p)
+{
+	if (h->err) {
+		return false;
+	}
+	if (inside(h, p)) {
+		return true;
+	}
+	if (h->len == h->cap && !settle_hull(h)) {
+		return false;
+	}
+	h->pts[h->len++] = p;
+	return true;
+}
+
+bool hull_add(Hull *h, double x, double y)
+{
+	++h->count;
+	if (!isfinite(x) || !isfinite(y)) {
+		++h->nonfinite;
+		return !h->err;
+	}
+	return add(h, (HullPoint){x, y});
+}
+
+void merge_hull(Hull *dest, const Hull *src)
+{
+	dest->count += src->count;
+	dest->nonfinite += src->nonfinite;
+	dest->err |= src->err;
+	for (size_t i = 0; i < src->len; ++i) {
+		add(dest, src->pts[i]);
+	}
+}
+
+// Merge the vertices and the pending points of `h` into `h->chain` in order,
+// without duplicates, and return their number. The vertices are in order from
+// the first to the last of them, the rightmost, and then backwards from the
+// end; the pending points are sorted.
+static size_t merge_sorted(Hull *h)
+{
+	const HullPoint *v = h->pts;
+	size_t right = 0;
+	while (right + 1 < h->n && less(v[right], v[right + 1])) {
+		++right;
+	}
+	const size_t lower = h->n ? right + 1 : 0;
+	qsort(h->pts + h->n, h->len - h->n, sizeof *h->pts, point_cmp);
+
+	// Heads of the lower chain, the upper chain, and the pending points
+	size_t a = 0;
+	size_t b = h->n;
+	size_t c = h->n;
+	size_t len = 0;
+	while (a < lower || b > lower || c < h->len) {
+		size_t *from = NULL;
+		HullPoint p;
+		if (a < lower) {
+			from = &a;
+			p = v[a];
+		}
+		if (b > lower && (!from || less(v[b - 1], p))) {
+			from = &b;
+			p = v[b - 1];
+		}
+		if (c < h->len && (!from || less(v[c], p))) {
+			from = &c;
+			p = v[c];
+		}
+		if (from == &b) {
+			--b;
+		} else {
+			++*from;
+		}
+		if (!len || less(h->chain[len - 1], p)) {
+			h->chain[len++] = p;
+		}
+	}
+	return len;
+}
+
+// Andrew's monotone chain over the points merged in order: the lower chain is
+// built into `h->pts`, and the upper one in place at the end of `h->chain`,
+// both dropping the points which do not turn counterclockwise.
+bool settle_hull(Hull *h)
+{
+	if (h->err) {
+		return false;
+	}
+	if (h->len > h->n) {
+		const size_t len = merge_sorted(h);
+		const HullPoint *s = h->chain;
+		size_t n = 0;
+		for (size_t i = 0; i < len; ++i) {
+			while (n >= 2 && cross(h->pts[n - 2], h->pts[n - 1],
+					       s[i]) <= 0.) {
+				--n;
+			}
+			h->pts[n++] = s[i];
+		}
+		// The upper chain from the rightmost point back, its top at
+		// `h->chain[top]`, never passes the point being read.
+		size_t top = len;
+		for (size_t i = len; i-- > 0;) {
+			while (len - top >= 2 &&
+			       cross(h->chain[top + 1], h->chain[top], s[i]) <=
+				   0.) {
+				++top;
+			}
+			h->chain[--top] = s[i];
+		}
+		for (size_t i = len - 1; i-- > top + 1;) {
+			h->pts[n++] = h->chain[i];
+		}
+		h->n = h->len = n;
+	}
+	// Leave room for at least as many pending points as vertices, so that
+	// merging takes amortized constant time per point.
+	const size_t cap = 2 * h->n + HULL_PENDING;
+	return h->cap >= cap || grow(h, cap);
+}
+
+bool write_hull(FILE *stream, const Hull *h, Format fmt)
+{
+	if (fmt != FMT_TEXT) {
+		Writer w;
+		if (!new_writer(&w, stream, fmt)) {
+			return false;
+		}
+		for (size_t i = 0; i < h->n; ++i) {
+			write_point(&w, h->pts[i].x, h->pts[i].y);
+		}
+		return free_writer(&w);
+	}
+	if (!h->n) {
+		return true;
+	}
+	fputs("polygon(", stream);
+	for (size_t i = 0; i < h->n; ++i) {
+		char x[FMT_DOUBLE_MAX + 1];
+		char y[FMT_DOUBLE_MAX + 1];
+		x[fmt_double(x, h->pts[i].x)] = '\0';
+		y[fmt_double(y, h->pts[i].y)] = '\0';
+		fprintf(stream, "%s(%s, %s)", i ? ", " : "", x, y);
+	}
+	fputs(")\n", stream);
+	return !ferror(stream);
+}
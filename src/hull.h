@@ -0,0 +1,60 @@
+#ifndef HULL_H
+#define HULL_H
+
+/* Convex hulls of streams of points, maintained as the points come.
+ *
+ * A point inside the hull so far, or on its boundary, is dropped at once,
+ * found by a binary search of the fan of triangles from the first vertex. The
+ * points outside are kept pending until `HULL_PENDING` of them have piled up,
+ * and then merged into the hull with Andrew's monotone chain, which drops the
+ * vertices they have made interior. The memory used thus depends only on the
+ * number of vertices of the hull.
+ */
+
+#include "output.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Number of points outside the hull kept before they are merged into it
+#define HULL_PENDING 256
+
+typedef struct HullPoint {
+	double x, y;
+} HullPoint;
+
+// Convex hull of the finite points added so far: the vertices
+// counterclockwise from the lowest of the leftmost points, with no three on a
+// line, and after them the pending points.
+typedef struct Hull {
+	HullPoint *pts;
+	size_t n;   // Number of vertices
+	size_t len; // Number of vertices and pending points
+	size_t cap;
+	HullPoint *chain; // Scratch for merging, of `cap` points
+	uint64_t count;	  // Number of points added
+	uint64_t nonfinite; // Of which not finite, left out of the hull
+	bool err;	    // Failed to grow
+} Hull;
+
+void new_hull(Hull *h);
+
+void free_hull(Hull *h);
+
+// Add the point (`x`, `y`) to `h`. Returns `false` if `h` has failed.
+bool hull_add(Hull *h, double x, double y);
+
+// Add the points of `src` to `dest`.
+void merge_hull(Hull *dest, const Hull *src);
+
+// Merge the pending points of `h` into its vertices. Returns `false` if `h`
+// has failed.
+bool settle_hull(Hull *h);
+
+// Write the vertices of `h`, settled, to `stream` in `fmt`: as a polygon of
+// the language in `FMT_TEXT`, and otherwise as points, one per vertex.
+// Returns `false` if failed.
+bool write_hull(FILE *stream, const Hull *h, Format fmt);
+
+#endif /* ifndef HULL_H */
@@ -0,0 +1,390 @@
+#define _POSIX_C_SOURCE 200809L
+#include "image.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Version of the layout, to be bumped whenever it changes
+#define IMAGE_VERSION 1
+// Written in the byte order of the build
+#define IMAGE_ORDER 0x01020304
+
+// The start of an image. Offsets are from the start, and multiples of 8.
+typedef struct Header {
+	char magic[8]; // "GISAIMG"
+	uint32_t version;
+	uint32_t order;
+	// Sizes of `Insn`, `Mono`, `Edge`, and `unsigned long`
+	uint32_t sizes[4];
+	uint64_t size; // Of the whole image
+	uint64_t hash; // Of the source
+	uint64_t text_off, text_len;
+	int32_t ninsns, nmonos, nqueries, nasserts, nshapes, entry;
+	uint64_t insns_off, monos_off, nallocs_off, queries_off, shapes_off;
+} Header;
+
+// A `Query`, its region's arrays by offset; 0 for a rectangle
+typedef struct ImageQuery {
+	int32_t is_assert, line, type, nvertices, nslabs, pad;
+	double xl, xu, yl, yu;
+	uint64_t vertices_off, slab_y_off, slab_off_off, edges_off;
+} ImageQuery;
+
+// A `Tris`, its arrays by offset
+typedef struct ImageTris {
+	int32_t n, pad;
+	double area, xl, xu, yl, yu;
+	uint64_t v_off, prob_off, alias_off;
+} ImageTris;
+
+// Forward declarations for static functions
+static uint64_t put(FILE *out, uint64_t *off, const void *p, size_t len);
+static bool within(uint64_t off, int64_t n, size_t size, uint64_t len);
+static bool poly_ok(Poly p, const Prog *prog);
+static bool insn_ok(const Insn *insn, int i, const Prog *prog);
+static bool load_query(const char *base, uint64_t len, const ImageQuery *iq,
+		       Query *q);
+static bool load_tris(const char *base, uint64_t len, const ImageTris *it,
+		      Tris *t);
+static bool load(const char *base, uint64_t len, const char *text,
+		 size_t text_len, Prog *prog);
+
+// Write the `len` bytes of `p` to `out` at the first multiple of 8 from
+// `*off`, which is advanced past them. Returns the offset written at.
+static uint64_t put(FILE *out, uint64_t *off, const void *p, size_t len)
+{
+	static const char zeros[8];
+	const uint64_t at = (*off + 7) & ~(uint64_t)7;
+	fwrite(zeros, 1, at - *off, out);
+	if (len) {
+		fwrite(p, 1, len, out);
+	}
+	*off = at + len;
+	return at;
+}
+
+bool write_image(FILE *out, const Prog *prog, const char *text, size_t len)
+{
+	ImageQuery *iqs = calloc(prog->nqueries + 1, sizeof *iqs);
+	ImageTris *its = calloc(prog->nshapes + 1, sizeof *its);
+	if (!iqs || !its) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(iqs);
+		free(its);
+		return false;
+	}
+	Header h = {.magic = "GISAIMG",
+		    .version = IMAGE_VERSION,
+		    .order = IMAGE_ORDER,
+		    .sizes = {sizeof(Insn), sizeof(Mono), sizeof(Edge),
+			      sizeof(unsigned long)},
+		    .hash = fnv1a(text, len),
+		    .text_len = len,
+		    .ninsns = prog->ninsns,
+		    .nmonos = prog->nmonos,
+		    .nqueries = prog->nqueries,
+		    .nasserts = prog->nasserts,
+		    .nshapes = prog->nshapes,
+		    .entry = prog->entry};
+	uint64_t off = 0;
+	put(out, &off, &h, sizeof h);
+	h.text_off = put(out, &off, text, len);
+	h.insns_off = put(out, &off, prog->insns,
+			  prog->ninsns * sizeof *prog->insns);
+	h.monos_off = put(out, &off, prog->monos,
+			  prog->nmonos * sizeof *prog->monos);
+	h.nallocs_off = put(out, &off, prog->nallocs,
+			    prog->ninsns * sizeof *prog->nallocs);
+	for (int i = 0; i < prog->nqueries; ++i) {
+		const Query *q = prog->queries + i;
+		const Region *r = &q->region;
+		ImageQuery *iq = iqs + i;
+		*iq = (ImageQuery){.is_assert = q->is_assert,
+				   .line = q->line,
+				   .type = r->type,
+				   .xl = r->xl,
+				   .xu = r->xu,
+				   .yl = r->yl,
+				   .yu = r->yu};
+		if (r->type != REGION_POLYGON) {
+			continue;
+		}
+		iq->nvertices = r->nvertices;
+		iq->nslabs = r->nslabs;
+		iq->vertices_off =
+		    put(out, &off, r->vertices,
+			2 * r->nvertices * sizeof *r->vertices);
+		iq->slab_y_off = put(out, &off, r->slab_y,
+				     (r->nslabs + 1) * sizeof *r->slab_y);
+		iq->slab_off_off =
+		    put(out, &off, r->slab_off,
+			(r->nslabs + 1) * sizeof *r->slab_off);
+		const int nedges = r->slab_off[r->nslabs];
+		iq->edges_off =
+		    put(out, &off, r->edges, nedges * sizeof *r->edges);
+	}
+	for (int i = 0; i < prog->nshapes; ++i) {
+		const Tris *t = prog->shapes + i;
+		its[i] = (ImageTris){
+		    .n = t->n,
+		    .area = t->area,
+		    .xl = t->xl,
+		    .xu = t->xu,
+		    .yl = t->yl,
+		    .yu = t->yu,
+		    .v_off = put(out, &off, t->v, 6 * t->n * sizeof *t->v),
+		    .prob_off =
+			put(out, &off, t->prob, t->n * sizeof *t->prob),
+		    .alias_off =
+			put(out, &off, t->alias, t->n * sizeof *t->alias)};
+	}
+	h.queries_off = put(out, &off, iqs, prog->nqueries * sizeof *iqs);
+	h.shapes_off = put(out, &off, its, prog->nshapes * sizeof *its);
+	h.size = off;
+	free(iqs);
+	free(its);
+	return !fseek(out, 0, SEEK_SET) &&
+	       fwrite(&h, sizeof h, 1, out) == 1 && !fflush(out);
+}
+
+// Whether `n` elements of `size` bytes at `off` lie within an image of `len`
+// bytes, aligned.
+static bool within(uint64_t off, int64_t n, size_t size, uint64_t len)
+{
+	return n >= 0 && !(off % 8) && off <= len &&
+	       (uint64_t)n <= (len - off) / size;
+}
+
+// Whether `p` lies within the `Mono`s of `prog` in the order of `poly_eval`,
+// which would not return otherwise.
+static bool poly_ok(Poly p, const Prog *prog)
+{
+	if (p.off < 0 || p.len < 0 || p.off > prog->nmonos - p.len) {
+		return false;
+	}
+	const Mono *m = prog->monos + p.off;
+	for (int i = 0; i < p.len; ++i) {
+		if (m[i].px < 0 || m[i].py < 0) {
+			return false;
+		}
+		if (i && (m[i].px > m[i - 1].px ||
+			  (m[i].px == m[i - 1].px && m[i].py > m[i - 1].py))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Whether the `Insn` `i` of `prog` refers only to what `prog` has. Children
+// come before their parents, so no damaged image can loop.
+static bool insn_ok(const Insn *insn, int i, const Prog *prog)
+{
+	switch (insn->type) {
+	case I_INIT:
+		if (insn->u.init.shape >= 0) {
+			return insn->u.init.shape < prog->nshapes;
+		}
+		return insn->u.init.shape == -1 &&
+		       poly_ok(insn->u.init.xs, prog) &&
+		       poly_ok(insn->u.init.xe, prog) &&
+		       poly_ok(insn->u.init.ys, prog) &&
+		       poly_ok(insn->u.init.ye, prog);
+	case I_TRANSLATION:
+		return poly_ok(insn->u.translation.u, prog) &&
+		       poly_ok(insn->u.translation.v, prog);
+	case I_ROTATION:
+		return poly_ok(insn->u.rotation.u, prog) &&
+		       poly_ok(insn->u.rotation.v, prog) &&
+		       poly_ok(insn->u.rotation.theta, prog);
+	case I_SEQUENCE:
+	case I_OR:
+		return insn->u.branch.p1 >= 0 && insn->u.branch.p1 < i &&
+		       insn->u.branch.p2 >= 0 && insn->u.branch.p2 < i;
+	case I_ITER:
+		return insn->u.iter_body >= 0 && insn->u.iter_body < i;
+	case I_ASSERT:
+	case I_REACH:
+		return insn->u.query >= 0 && insn->u.query < prog->nqueries;
+	}
+	return false;
+}
+
+// Load the query `iq` of the image at `base` of `len` bytes into `q`. Returns
+// `false` if damaged.
+static bool load_query(const char *base, uint64_t len, const ImageQuery *iq,
+		       Query *q)
+{
+	Region *r = &q->region;
+	*q = (Query){.is_assert = iq->is_assert, .line = iq->line};
+	*r = (Region){.type = iq->type,
+		      .xl = iq->xl,
+		      .xu = iq->xu,
+		      .yl = iq->yl,
+		      .yu = iq->yu};
+	if (iq->type == REGION_RECT) {
+		return true;
+	}
+	if (iq->type != REGION_POLYGON || iq->nslabs < 1 ||
+	    !within(iq->vertices_off, 2 * (int64_t)iq->nvertices,
+		    sizeof(double), len) ||
+	    !within(iq->slab_y_off, iq->nslabs + (int64_t)1, sizeof(double),
+		    len) ||
+	    !within(iq->slab_off_off, iq->nslabs + (int64_t)1, sizeof(int),
+		    len)) {
+		return false;
+	}
+	const int *slab_off = (const int *)(base + iq->slab_off_off);
+	for (int i = 0; i < iq->nslabs; ++i) {
+		if (slab_off[i] < 0 || slab_off[i] > slab_off[i + 1]) {
+			return false;
+		}
+	}
+	if (!within(iq->edges_off, slab_off[iq->nslabs], sizeof(Edge), len)) {
+		return false;
+	}
+	r->nvertices = iq->nvertices;
+	r->vertices = (double *)(base + iq->vertices_off);
+	r->nslabs = iq->nslabs;
+	r->slab_y = (double *)(base + iq->slab_y_off);
+	r->slab_off = (int *)slab_off;
+	r->edges = (Edge *)(base + iq->edges_off);
+	return true;
+}
+
+// Load the shape `it` of the image at `base` of `len` bytes into `t`. Returns
+// `false` if damaged.
+static bool load_tris(const char *base, uint64_t len, const ImageTris *it,
+		      Tris *t)
+{
+	if (it->n < 1 ||
+	    !within(it->v_off, 6 * (int64_t)it->n, sizeof(double), len) ||
+	    !within(it->prob_off, it->n, sizeof(double), len) ||
+	    !within(it->alias_off, it->n, sizeof(int), len)) {
+		return false;
+	}
+	const int *alias = (const int *)(base + it->alias_off);
+	for (int i = 0; i < it->n; ++i) {
+		if (alias[i] < 0 || alias[i] >= it->n) {
+			return false;
+		}
+	}
+	*t = (Tris){.n = it->n,
+		    .v = (double *)(base + it->v_off),
+		    .prob = (double *)(base + it->prob_off),
+		    .alias = (int *)alias,
+		    .area = it->area,
+		    .xl = it->xl,
+		    .xu = it->xu,
+		    .yl = it->yl,
+		    .yu = it->yu};
+	return true;
+}
+
+// Load the image at `base` of `len` bytes into `prog` if it is an image of the
+// `text_len` bytes of `text`. Returns `false` if not.
+static bool load(const char *base, uint64_t len, const char *text,
+		 size_t text_len, Prog *prog)
+{
+	const Header *h = (const Header *)base;
+	const uint32_t sizes[4] = {sizeof(Insn), sizeof(Mono), sizeof(Edge),
+				   sizeof(unsigned long)};
+	if (len < sizeof *h || memcmp(h->magic, "GISAIMG", 8) ||
+	    h->version != IMAGE_VERSION || h->order != IMAGE_ORDER ||
+	    memcmp(h->sizes, sizes, sizeof sizes) || h->size != len ||
+	    h->hash != fnv1a(text, text_len) || h->text_len != text_len ||
+	    !within(h->text_off, text_len, 1, len) ||
+	    memcmp(base + h->text_off, text, text_len)) {
+		return false;
+	}
+	if (h->ninsns < 1 || h->entry < 0 || h->entry >= h->ninsns ||
+	    !within(h->insns_off, h->ninsns, sizeof(Insn), len) ||
+	    !within(h->monos_off, h->nmonos, sizeof(Mono), len) ||
+	    !within(h->nallocs_off, h->ninsns, sizeof(unsigned long), len) ||
+	    !within(h->queries_off, h->nqueries, sizeof(ImageQuery), len) ||
+	    !within(h->shapes_off, h->nshapes, sizeof(ImageTris), len)) {
+		return false;
+	}
+	*prog = (Prog){.insns = (Insn *)(base + h->insns_off),
+		       .ninsns = h->ninsns,
+		       .monos = (Mono *)(base + h->monos_off),
+		       .nmonos = h->nmonos,
+		       .nqueries = h->nqueries,
+		       .nasserts = h->nasserts,
+		       .nshapes = h->nshapes,
+		       .entry = h->entry,
+		       .nallocs = (unsigned long *)(base + h->nallocs_off)};
+	for (int i = 0; i < prog->ninsns; ++i) {
+		if (!insn_ok(prog->insns + i, i, prog)) {
+			return false;
+		}
+	}
+
+	prog->queries = malloc((prog->nqueries + 1) * sizeof *prog->queries);
+	prog->shapes = malloc((prog->nshapes + 1) * sizeof *prog->shapes);
+	if (!prog->queries || !prog->shapes) {
+		fputs("Failed to allocate memory.\n", stderr);
+		goto damaged;
+	}
+	const ImageQuery *iqs = (const ImageQuery *)(base + h->queries_off);
+	int nasserts = 0;
+	for (int i = 0; i < prog->nqueries; ++i) {
+		if (!load_query(base, len, iqs + i, prog->queries + i)) {
+			goto damaged;
+		}
+		nasserts += prog->queries[i].is_assert;
+	}
+	const ImageTris *its = (const ImageTris *)(base + h->shapes_off);
+	for (int i = 0; i < prog->nshapes; ++i) {
+		if (!load_tris(base, len, its + i, prog->shapes + i)) {
+			goto damaged;
+		}
+	}
+	if (nasserts == prog->nasserts) {
+		return true;
+	}
+
+damaged:
+	free(prog->queries);
+	free(prog->shapes);
+	return false;
+}
+
+bool map_image(const char *path, const char *text, size_t len, Prog *prog,
+	       void **map, size_t *map_len)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	void *m = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(Header)) {
+		m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (m == MAP_FAILED) {
+		return false;
+	}
+	if (!load(m, st.st_size, text, len, prog)) {
+		munmap(m, st.st_size);
+		return false;
+	}
+	*map = m;
+	*map_len = st.st_size;
+	return true;
+}
+
+void unmap_image(Prog *prog, void *map, size_t map_len)
+{
+	free(prog->queries);
+	free(prog->shapes);
+	munmap(map, map_len);
+	*prog = (Prog){NULL, 0, NULL, 0, NULL, 0, 0, NULL, 0, -1, NULL, NULL};
+}
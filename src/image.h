@@ -0,0 +1,39 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+/* Images of compiled programs, to be mapped rather than parsed and compiled
+ * again.
+ *
+ * An image holds the arrays of a `Prog` as they lie in memory, each aligned,
+ * and refers to them by their offsets from its start, so it is mapped
+ * read-only and used in place, at whatever address: `Insn`s and `Mono`s, with
+ * their indices, folded constants, and the sines and cosines of fixed
+ * rotations, and the compiled regions and triangulations of the queries and
+ * the `init`s. Only the small arrays of `Query`s and `Tris`, whose pointers
+ * point into the mapping, are built on loading. The AST is not kept, so the
+ * `nodes` of a mapped `Prog` are `NULL`.
+ *
+ * An image also holds the source it was compiled from, and the sizes of the
+ * structures and the byte order of the build that wrote it, and is used only
+ * if they all match.
+ */
+
+#include "compile.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Write an image of `prog`, compiled from the `len` bytes of `text`, to
+// `out`, which must be seekable. Returns `false` if failed.
+bool write_image(FILE *out, const Prog *prog, const char *text, size_t len);
+
+// Map the image at `path` into `prog` if it is an image of the `len` bytes of
+// `text`, and set `*map` and `*map_len` to the mapping. Returns `false` if
+// not, including if there is no such file, or if it is damaged.
+bool map_image(const char *path, const char *text, size_t len, Prog *prog,
+	       void **map, size_t *map_len);
+
+// Release `prog` mapped by `map_image`.
+void unmap_image(Prog *prog, void *map, size_t map_len);
+
+#endif /* ifndef IMAGE_H */
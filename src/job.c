@@ -0,0 +1,85 @@
+#include "job.h"
+#include "analyze.h"
+#include "check.h"
+#include "sample.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+bool parse_job_mode(const char *name, enum JobMode *mode)
+{
+	static const char *const names[] = {"sample", "stats", "check",
+					    "analyze"};
+	for (int m = 0; m < 4; ++m) {
+		if (!strcmp(name, names[m])) {
+			*mode = m;
+			return true;
+		}
+	}
+	return false;
+}
+
+int run_job(const Job *j, const Prog *prog, FILE *out)
+{
+	SampleOpts opts = {.n = j->n,
+			   .seed = j->seed,
+			   .iter_max = j->iter_max,
+			   .nthreads = 1};
+	int ret = 0;
+	switch (j->mode) {
+	case JOB_SAMPLE: {
+		Writer w;
+		if (!new_writer(&w, out, j->fmt)) {
+			return 2;
+		}
+		ret = sample(prog, &opts, &w);
+		if (!free_writer(&w) && !ret) {
+			ret = 2;
+		}
+		break;
+	}
+	case JOB_STATS: {
+		Stats stats;
+		new_stats(&stats);
+		opts.stats = &stats;
+		ret = sample(prog, &opts, NULL);
+		if (!ret && !p_stats(out, &stats)) {
+			ret = 2;
+		}
+		free_stats(&stats);
+		break;
+	}
+	case JOB_CHECK: {
+		Check check;
+		if (!new_check(&check, prog)) {
+			return 2;
+		}
+		opts.check = &check;
+		ret = sample(prog, &opts, NULL);
+		if (!ret) {
+			p_check(out, &check, prog);
+		}
+		free_check(&check);
+		break;
+	}
+	case JOB_ANALYZE: {
+		Analysis a;
+		ret = analyze(prog, j->iter_max, &a);
+		if (!ret) {
+			p_analysis(out, &a, prog);
+		}
+		free_analysis(&a);
+		break;
+	}
+	}
+	return ret;
+}
+
+const char *job_error(int ret)
+{
+	static const char *const errs[] = {"failed to start sampling", NULL,
+					   "operation before initialization",
+					   "out of memory"};
+	return ret >= -1 && ret <= 2 ? errs[ret + 1] : "unknown error";
+}
@@ -0,0 +1,34 @@
+#ifndef JOB_H
+#define JOB_H
+
+/* A run of a compiled program on the calling thread, printing what `gisa`
+ * prints in its mode. Both the server and batch mode run programs so, many at
+ * once, each on a thread of their own.
+ */
+
+#include "compile.h"
+#include "output.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Job {
+	enum JobMode { JOB_SAMPLE, JOB_STATS, JOB_CHECK, JOB_ANALYZE } mode;
+	unsigned long n; // Number of samples
+	uint64_t seed;
+	int iter_max;
+	Format fmt; // Of the sampled points
+} Job;
+
+// Parse a mode name, i.e., "sample", "stats", "check", or "analyze". Returns
+// `false` if `name` is unknown.
+bool parse_job_mode(const char *name, enum JobMode *mode);
+
+// Run `j` on `prog`, and print the results to `out`. Returns as `sample`
+// does.
+int run_job(const Job *j, const Prog *prog, FILE *out);
+
+// Message of the error `ret` returned by `run_job`, or `NULL` if none.
+const char *job_error(int ret);
+
+#endif /* ifndef JOB_H */
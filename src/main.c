@@ -1,17 +1,901 @@
+#define _POSIX_C_SOURCE 200809L
+#include "analyze.h"
 #include "ast.h"
+#include "batch.h"
+#include "check.h"
+#include "compile.h"
+#include "density.h"
+#include "hist.h"
+#include "hull.h"
 #include "eval.h"
-#include "parser.tab.h"
+#include "gisa.h"
+#include "memo.h"
+#include "output.h"
+#include "phase.h"
+#include "profile.h"
+#include "record.h"
+#include "sample.h"
+#include "serve.h"
+#include "split.h"
+#include "stats.h"
+#include "store.h"
+#include "trace.h"
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+
+// Maximum resolution of a grid along an axis
+#define GRID_MAX 65536
+// Maximum number of sampling threads
+#define THREADS_MAX 1024
+// Maximum number of levels of multilevel splitting
+#define SPLIT_LEVELS_MAX 64
+// Maximum number of events each thread keeps in flight mode
+#define KEEP_MAX 16777216
 
 char *progname;
-int lineno = 1;
-extern FILE *yyin;
+
+// Options from the command line
+typedef struct Opts {
+	// Parse mode
+	bool show_parse;
+	// Verbose mode
+	bool verbose;
+	// Maximum iteration
+	int iter_max;
+	// Seed for the random number generator
+	unsigned int seed;
+	// Draw from scrambled Sobol points
+	bool qmc;
+	// Number of sampling threads; the number of processors by default
+	int nthreads;
+	// Number of samples; the maximum in adaptive mode
+	unsigned long nsamples;
+	bool has_nsamples;
+	// Adaptive mode: tolerance and confidence level of the estimates
+	bool adaptive;
+	double tol;
+	double conf;
+	// Name of the output format; the default of the mode if `NULL`
+	const char *fmt_name;
+	// File to record the choices of the trajectories into, if any
+	const char *record;
+	// File to store the final states into, indexed, if any
+	const char *store;
+	// Store to query instead of running a program, if any
+	const char *query;
+	// Replay mode: the record file, and the trajectory to replay if
+	// `has_index`
+	const char *replay;
+	unsigned long index;
+	bool has_index;
+	// File to trace the steps of the trajectories into, if any, and the
+	// number of events each thread keeps in flight mode; 0 to stream all
+	const char *trace_file;
+	size_t keep;
+	// Trace to render as text instead of running a program, if any
+	const char *decode;
+	// Socket to serve requests on instead of running a program, if any
+	const char *listen;
+	// Manifest listing programs to run in batch mode, if any
+	const char *manifest;
+	// Directory of the images of compiled programs, if any
+	const char *cache;
+	// Run the program again whenever its file changes
+	bool watch;
+	// Summaries of subtrees kept from the analyses of the versions of the
+	// program so far, when watching
+	Memo *summaries;
+	// Trace of the run, set up once the number of threads is known
+	Trace *trace;
+	// File to write the folded stacks of the profile of the run to, if
+	// any, and what they count
+	const char *profile_file;
+	Metric metric;
+	// Profile of the run, set up once the program is compiled
+	Profile *profile;
+	// Report the time and the hardware counters of each phase
+	bool phases;
+	enum Mode {
+		MODE_SAMPLE,
+		MODE_HIST,
+		MODE_DENSITY,
+		MODE_STATS,
+		MODE_HULL,
+		MODE_SPLIT,
+		MODE_CHECK,
+		MODE_ANALYZE,
+		MODE_REPLAY
+	} mode;
+	// Resolution of the grid for histogram and density modes
+	int grid_nx;
+	int grid_ny;
+	// Bounds of the grid: x-min, x-max, y-min, and y-max
+	double bounds[4];
+	bool has_bounds;
+	// Rare-event mode: the target and the number of levels
+	double target[4];
+	int nlevels;
+} Opts;
+
+// Trace in flight mode for `on_dump`
+static Trace *volatile flight;
+
+// Phases of the run if reported
+static Phases *phases;
+
+// End the current phase of the run, if reported, and start `ph`.
+static void enter(Phase ph)
+{
+	if (phases) {
+		enter_phase(phases, ph);
+	}
+}
+
+// Dump the trace in flight mode on `SIGUSR1`.
+static void on_dump(int sig)
+{
+	(void)sig;
+	Trace *t = flight;
+	if (t) {
+		dump_trace(t);
+	}
+}
+
+// Return the argument of the flag `argv[*optidx]`, which is either attached to
+// the flag, e.g., `-d100`, or separated from it, e.g., `-d 100`.
+static char *flag_arg(char *argv[], int *optidx)
+{
+	const char flag = argv[*optidx][1];
+	char *arg = argv[*optidx] + 2;
+	if (!*arg && !(arg = argv[++*optidx])) {
+		fprintf(stderr, "%s: missing argument for the flag `-%c`\n",
+			progname, flag);
+		exit(EXIT_FAILURE);
+	}
+	return arg;
+}
+
+// Parse at most `n` comma-separated numbers in `arg` into `nums`. Returns the
+// count of the numbers parsed.
+static int parse_nums(const char *arg, double *nums, int n)
+{
+	const char *p = arg;
+	for (int i = 0; i < n; ++i) {
+		errno = 0;
+		char *end;
+		nums[i] = strtod(p, &end);
+		if (end == p || errno == ERANGE || (*end && *end != ',')) {
+			fprintf(stderr, "%s: invalid number -- '%s'\n",
+				progname, arg);
+			exit(EXIT_FAILURE);
+		}
+		if (!*end) {
+			return i + 1;
+		}
+		p = end + 1;
+	}
+	fprintf(stderr, "%s: more than %d numbers -- '%s'\n", progname, n,
+		arg);
+	exit(EXIT_FAILURE);
+}
+
+// Parse a number in [0, `max`] in `num`.
+static unsigned long parse_ulong(const char *num, unsigned long max)
+{
+	errno = 0;
+	char *end;
+	const unsigned long lnum = strtoul(num, &end, 0);
+	if (errno == ERANGE || lnum > max || *num == '-') {
+		fprintf(stderr, "%s: number out of range [0, %lu] -- '%s'\n",
+			progname, max, num);
+		exit(EXIT_FAILURE);
+	}
+	if (*end || end == num) { // Invalid character(s) left.
+		fprintf(stderr, "%s: invalid number -- '%s'\n", progname, num);
+		exit(EXIT_FAILURE);
+	}
+	return lnum;
+}
+
+// Parse the resolution "NX[,NY]" of a grid in `arg`.
+static void parse_res(const char *arg, int *nx, int *ny)
+{
+	double res[2];
+	if (parse_nums(arg, res, 2) == 1) {
+		res[1] = res[0];
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (res[i] != floor(res[i]) || res[i] < 1. || res[i] > GRID_MAX) {
+			fprintf(stderr,
+				"%s: resolution out of range [1, %d] -- '%s'\n",
+				progname, GRID_MAX, arg);
+			exit(EXIT_FAILURE);
+		}
+	}
+	*nx = (int)res[0];
+	*ny = (int)res[1];
+}
+
+// Open the trace of `o` into `t`, and in flight mode, have `SIGUSR1` dump it.
+// Returns `false` if failed, having reported the error.
+static bool start_trace(Trace *t, const Opts *o)
+{
+	errno = 0;
+	FILE *stream = fopen(o->trace_file, "wb");
+	if (!stream || !new_trace(t, stream, o->nthreads, o->keep)) {
+		if (errno) {
+			fprintf(stderr, "%s: cannot write '%s': %s\n",
+				progname, o->trace_file, strerror(errno));
+		}
+		if (stream) {
+			fclose(stream);
+		}
+		return false;
+	}
+	if (t->flight) {
+		flight = t;
+		struct sigaction sa = {.sa_handler = on_dump,
+				       .sa_flags = SA_RESTART};
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGUSR1, &sa, NULL);
+	}
+	return true;
+}
+
+// Close the trace `t` of `o`, dumping it first in flight mode if `dump`.
+// Returns `false` if failed, having reported the error.
+static bool stop_trace(Trace *t, const Opts *o, bool dump)
+{
+	errno = 0;
+	bool ok = true;
+	if (t->flight) {
+		signal(SIGUSR1, SIG_IGN);
+		flight = NULL;
+		ok = !dump || dump_trace(t);
+	}
+	FILE *stream = t->stream;
+	ok = free_trace(t) && ok;
+	ok = !ferror(stream) && ok;
+	if (fclose(stream) || !ok) {
+		fprintf(stderr, "%s: write error '%s': %s\n", progname,
+			o->trace_file, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Write the profile `p` of the run to `o->profile_file`. Returns `false` if
+// failed, having reported the error.
+static bool write_profile(const Profile *p, const Prog *prog, const Opts *o)
+{
+	errno = 0;
+	FILE *out = fopen(o->profile_file, "w");
+	if (!out) {
+		fprintf(stderr, "%s: cannot write '%s': %s\n", progname,
+			o->profile_file, strerror(errno));
+		return false;
+	}
+	bool ok = p_profile(out, p, prog, o->metric);
+	ok = !ferror(out) && ok;
+	if (fclose(out) || !ok) {
+		fprintf(stderr, "%s: write error '%s': %s\n", progname,
+			o->profile_file, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Render the trace `o->decode` as text to `stdout`. Returns `false` if
+// failed, having reported the error.
+static bool run_decode(const Opts *o)
+{
+	errno = 0;
+	FILE *in = fopen(o->decode, "rb");
+	if (!in) {
+		fprintf(stderr, "%s: cannot access '%s': %s\n", progname,
+			o->decode, strerror(errno));
+		return false;
+	}
+	bool ok = decode_trace(in, stdout);
+	fclose(in);
+	if (fflush(stdout)) {
+		fprintf(stderr, "%s: write error: %s\n", progname,
+			strerror(errno));
+		ok = false;
+	}
+	return ok;
+}
+
+// Print the final states of the store `o->query` in the box of `o->bounds`, or
+// all of them if not given, to `stdout`. Returns `false` if failed, having
+// reported the error.
+static bool run_query(const Opts *o)
+{
+	Format fmt = FMT_TEXT;
+	if (o->fmt_name &&
+	    (!parse_format(o->fmt_name, &fmt) || fmt == FMT_BIN)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected text, csv, or "
+			"ndjson)\n",
+			progname, o->fmt_name);
+		return false;
+	}
+	Store store;
+	errno = 0;
+	if (!open_store(&store, o->query)) {
+		fprintf(stderr, "%s: cannot access '%s': %s\n", progname,
+			o->query, errno ? strerror(errno) : "not a store");
+		return false;
+	}
+	const double *b = o->bounds;
+	const uint64_t n =
+	    o->has_bounds
+		? query_store(stdout, &store, fmt, b[0], b[1], b[2], b[3])
+		: query_store(stdout, &store, fmt, -INFINITY, INFINITY,
+			      -INFINITY, INFINITY);
+	fprintf(stderr, "%s: %llu of %llu trajectories\n", progname,
+		(unsigned long long)n, (unsigned long long)store.n);
+	close_store(&store);
+	if (fflush(stdout)) {
+		fprintf(stderr, "%s: write error: %s\n", progname,
+			strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+// Sample trajectories and write their final states to `stdout`.
+static int run_sample(const Prog *prog, const Opts *o)
+{
+	Format fmt = FMT_TEXT;
+	if (o->fmt_name && !parse_format(o->fmt_name, &fmt)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected text, csv, "
+			"ndjson, or bin)\n",
+			progname, o->fmt_name);
+		return -2;
+	}
+	FILE *record = NULL;
+	if (o->record) {
+		errno = 0;
+		if (!(record = fopen(o->record, "wb")) ||
+		    !write_record_header(record)) {
+			fprintf(stderr, "%s: cannot write '%s': %s\n", progname,
+				o->record, strerror(errno));
+			if (record) {
+				fclose(record);
+			}
+			return -2;
+		}
+	}
+	StoreWriter store;
+	if (o->store && !new_store(&store, record ? ftell(record) : -1)) {
+		fprintf(stderr, "%s: cannot write '%s': %s\n", progname,
+			o->store, strerror(errno));
+		if (record) {
+			fclose(record);
+		}
+		return -2;
+	}
+	Writer w;
+	if (!new_writer(&w, stdout, fmt)) {
+		if (record) {
+			fclose(record);
+		}
+		if (o->store) {
+			free_store_writer(&store);
+		}
+		return 2;
+	}
+	const SampleOpts opts = {.n = o->nsamples,
+				 .seed = o->seed,
+				 .iter_max = o->iter_max,
+				 .verbose = o->verbose,
+				 .qmc = o->qmc,
+				 .nthreads = o->nthreads,
+				 .record = record,
+				 .store = o->store ? &store : NULL,
+				 .trace = o->trace,
+				 .profile = o->profile};
+	int ret = sample(prog, &opts, &w);
+	enter(PHASE_OUTPUT);
+	if (record && (ferror(record) | fclose(record))) {
+		fprintf(stderr, "%s: write error '%s': %s\n", progname,
+			o->record, strerror(errno));
+		ret = ret ? ret : -2;
+	}
+	errno = 0;
+	if (o->store && !finish_store(&store, o->store)) {
+		fprintf(stderr, "%s: write error '%s': %s\n", progname,
+			o->store, strerror(errno));
+		ret = ret ? ret : -2;
+	}
+	if (!free_writer(&w)) {
+		fprintf(stderr, "%s: write error: %s\n", progname,
+			strerror(errno));
+		return ret ? ret : -2;
+	}
+	return ret;
+}
+
+// Replay recorded trajectories and write their final states to `stdout`.
+static int run_replay(const Prog *prog, const Opts *o)
+{
+	Format fmt = FMT_TEXT;
+	if (o->fmt_name && !parse_format(o->fmt_name, &fmt)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected text, csv, "
+			"ndjson, or bin)\n",
+			progname, o->fmt_name);
+		return -2;
+	}
+	errno = 0;
+	FILE *in = fopen(o->replay, "rb");
+	if (!in) {
+		fprintf(stderr, "%s: cannot access '%s': %s\n", progname,
+			o->replay, strerror(errno));
+		return -2;
+	}
+	Writer w;
+	if (!new_writer(&w, stdout, fmt)) {
+		fclose(in);
+		return 2;
+	}
+	int ret = replay(prog, in, o->has_index ? &o->index : NULL,
+			 o->verbose, &w);
+	enter(PHASE_OUTPUT);
+	if (ferror(in)) {
+		fprintf(stderr, "%s: read error '%s': %s\n", progname,
+			o->replay, strerror(errno));
+		ret = ret ? ret : -2;
+	}
+	fclose(in);
+	if (!free_writer(&w)) {
+		fprintf(stderr, "%s: write error: %s\n", progname,
+			strerror(errno));
+		return ret ? ret : -2;
+	}
+	return ret;
+}
+
+// Sample trajectories and write the histogram of their final states to
+// `stdout`.
+static int run_hist(const Prog *prog, const Opts *o)
+{
+	Raster raster = RASTER_PGM;
+	if (o->fmt_name && !parse_raster(o->fmt_name, &raster)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected pgm, ppm, or "
+			"counts)\n",
+			progname, o->fmt_name);
+		return -2;
+	}
+	Hist hist;
+	if (!new_hist(&hist, o->bounds[0], o->bounds[1], o->bounds[2],
+		      o->bounds[3], o->grid_nx, o->grid_ny)) {
+		return 2;
+	}
+	const SampleOpts opts = {.n = o->nsamples,
+				 .seed = o->seed,
+				 .iter_max = o->iter_max,
+				 .verbose = o->verbose,
+				 .qmc = o->qmc,
+				 .nthreads = o->nthreads,
+				 .hist = &hist,
+				 .trace = o->trace,
+				 .profile = o->profile};
+	int ret = sample(prog, &opts, NULL);
+	enter(PHASE_OUTPUT);
+	if (!ret) {
+		if (!write_hist(stdout, &hist, raster) || fflush(stdout)) {
+			fprintf(stderr, "%s: write error: %s\n", progname,
+				strerror(errno));
+			ret = -2;
+		} else if (hist.outside) {
+			fprintf(stderr, "%s: %llu points outside the grid\n",
+				progname, (unsigned long long)hist.outside);
+		}
+	}
+	free_hist(&hist);
+	return ret;
+}
+
+// Sample trajectories and print statistics of their final states to
+// `stdout`.
+static int run_stats(const Prog *prog, const Opts *o)
+{
+	Stats stats;
+	new_stats(&stats);
+	SampleOpts opts = {.n = o->nsamples,
+			   .seed = o->seed,
+			   .iter_max = o->iter_max,
+			   .verbose = o->verbose,
+			   .qmc = o->qmc,
+			   .nthreads = o->nthreads,
+			   .stats = &stats,
+			   .trace = o->trace,
+			   .profile = o->profile};
+	int ret;
+	if (o->adaptive) {
+		opts.n = o->has_nsamples ? o->nsamples : ULONG_MAX;
+		unsigned long n;
+		bool converged;
+		ret = sample_adaptive(prog, &opts, o->tol, o->conf, &n,
+				      &converged);
+		if (!ret && converged) {
+			fprintf(stderr, "%s: converged after %lu samples\n",
+				progname, n);
+		} else if (!ret) {
+			fprintf(stderr,
+				"%s: did not converge within %lu samples\n",
+				progname, n);
+		}
+	} else {
+		ret = sample(prog, &opts, NULL);
+	}
+	enter(PHASE_OUTPUT);
+	if (!ret) {
+		if (!p_stats(stdout, &stats)) {
+			ret = 2;
+		} else if (fflush(stdout)) {
+			fprintf(stderr, "%s: write error: %s\n", progname,
+				strerror(errno));
+			ret = -2;
+		}
+	}
+	free_stats(&stats);
+	return ret;
+}
+
+// Sample trajectories into the convex hull of their final states, and print it
+// to `stdout`.
+static int run_hull(const Prog *prog, const Opts *o)
+{
+	Format fmt = FMT_TEXT;
+	if (o->fmt_name && !parse_format(o->fmt_name, &fmt)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected text, csv, "
+			"ndjson, or bin)\n",
+			progname, o->fmt_name);
+		return -2;
+	}
+	Hull hull;
+	new_hull(&hull);
+	const SampleOpts opts = {.n = o->nsamples,
+				 .seed = o->seed,
+				 .iter_max = o->iter_max,
+				 .verbose = o->verbose,
+				 .qmc = o->qmc,
+				 .nthreads = o->nthreads,
+				 .hull = &hull,
+				 .trace = o->trace,
+				 .profile = o->profile};
+	int ret = sample(prog, &opts, NULL);
+	enter(PHASE_OUTPUT);
+	if (!ret && !settle_hull(&hull)) {
+		ret = 2;
+	} else if (!ret) {
+		if (!write_hull(stdout, &hull, fmt) || fflush(stdout)) {
+			fprintf(stderr, "%s: write error: %s\n", progname,
+				strerror(errno));
+			ret = -2;
+		}
+		fprintf(stderr, "%s: %zu vertices of %llu final states\n",
+			progname, hull.n, (unsigned long long)hull.count);
+		if (hull.nonfinite) {
+			fprintf(stderr, "%s: %llu final states not finite\n",
+				progname, (unsigned long long)hull.nonfinite);
+		}
+	}
+	free_hull(&hull);
+	return ret;
+}
+
+// Estimate the probability to end in the target by multilevel splitting, and
+// print it to `stdout`.
+static int run_split(const Prog *prog, const Opts *o)
+{
+	SplitOpts opts = {.n = o->nsamples,
+			  .seed = o->seed,
+			  .iter_max = o->iter_max,
+			  .nthreads = o->nthreads,
+			  .nlevels = o->nlevels};
+	memcpy(opts.target, o->target, sizeof opts.target);
+	SplitResult res;
+	const int ret = split(prog, &opts, &res);
+	enter(PHASE_OUTPUT);
+	if (!ret) {
+		printf("%le +- %le (95%% confidence)\n", res.p, res.halfwidth);
+		fprintf(stderr,
+			"%s: %lu trajectories, %lu steps, %d levels from "
+			"distance %le\n",
+			progname, o->nsamples, res.steps,
+			res.scale > 0. ? o->nlevels : 0, res.scale);
+	}
+	return ret;
+}
+
+// Sample trajectories, checking the queries of `prog`, and print their
+// outcomes to `stdout`.
+static int run_check(const Prog *prog, const Opts *o)
+{
+	Check check;
+	if (!new_check(&check, prog)) {
+		return 2;
+	}
+	const SampleOpts opts = {.n = o->nsamples,
+				 .seed = o->seed,
+				 .iter_max = o->iter_max,
+				 .verbose = o->verbose,
+				 .qmc = o->qmc,
+				 .nthreads = o->nthreads,
+				 .check = &check,
+				 .trace = o->trace,
+				 .profile = o->profile};
+	int ret = sample(prog, &opts, NULL);
+	enter(PHASE_OUTPUT);
+	if (!ret && !p_check(stdout, &check, prog)) {
+		ret = -2; // The violations are the report.
+	}
+	free_check(&check);
+	return ret;
+}
+
+// Analyze `prog` over boxes, and print the verdicts to `stdout`.
+static int run_analyze(const Prog *prog, const Opts *o)
+{
+	Analysis a;
+	const int ret = analyze_memo(prog, o->iter_max, o->summaries, &a);
+	enter(PHASE_OUTPUT);
+	if (!ret) {
+		p_analysis(stdout, &a, prog);
+	}
+	free_analysis(&a);
+	return ret;
+}
+
+// Propagate the probability mass through `prog`, and print it to `stdout`.
+static int run_density(const Prog *prog, const Opts *o)
+{
+	Grid grid;
+	if (!new_grid(&grid, o->bounds[0], o->bounds[1], o->bounds[2],
+		      o->bounds[3], o->grid_nx, o->grid_ny)) {
+		return 2;
+	}
+	const int ret = propagate(prog, prog->entry, &grid, o->iter_max);
+	enter(PHASE_OUTPUT);
+	if (!ret) {
+		p_grid(stdout, &grid);
+		if (grid.lost > 0.) {
+			fprintf(stderr, "%s: mass %le left the grid\n",
+				progname, grid.lost);
+		}
+	}
+	free_grid(&grid);
+	return ret;
+}
+
+// Run `prog` in the mode of `o`.
+static int run_mode(const Prog *prog, const Opts *o)
+{
+	switch (o->mode) {
+	case MODE_SAMPLE:
+		return run_sample(prog, o);
+	case MODE_HIST:
+		return run_hist(prog, o);
+	case MODE_DENSITY:
+		return run_density(prog, o);
+	case MODE_STATS:
+		return run_stats(prog, o);
+	case MODE_HULL:
+		return run_hull(prog, o);
+	case MODE_SPLIT:
+		return run_split(prog, o);
+	case MODE_CHECK:
+		return run_check(prog, o);
+	case MODE_ANALYZE:
+		return run_analyze(prog, o);
+	case MODE_REPLAY:
+		return run_replay(prog, o);
+	}
+	return 0;
+}
+
+// Report the error `ret` returned by `run_mode`, if any. Returns whether
+// there was none.
+static bool report(int ret)
+{
+	switch (ret) {
+	case 0:
+		return true;
+	case 1:
+		fprintf(stderr, "%s: error: operation before initialization\n",
+			progname);
+		break;
+	case 2:
+		fprintf(stderr, "%s: error: out of memory\n", progname);
+		break;
+	case -1:
+		fprintf(stderr, "%s: error: failed to start sampling\n",
+			progname);
+		break;
+	case -2: // Already reported
+		break;
+	default:
+		fprintf(stderr, "%s: unknown error\n", progname);
+		break;
+	}
+	return false;
+}
+
+// Whether the file of `a` has been replaced or written since that of `b`.
+static bool changed(const struct stat *a, const struct stat *b)
+{
+	return a->st_ino != b->st_ino || a->st_dev != b->st_dev ||
+	       a->st_size != b->st_size ||
+	       a->st_mtim.tv_sec != b->st_mtim.tv_sec ||
+	       a->st_mtim.tv_nsec != b->st_mtim.tv_nsec;
+}
+
+// Run the program `file` in the mode of `o`, and again whenever the file
+// changes, until interrupted. Each version is compiled with the polynomials
+// and the regions of the last one, and analyzed with the summaries of its
+// subtrees, by their structural hashes. Returns `false` if failed to start,
+// having reported the error.
+static bool run_watch(const char *file, Opts *o)
+{
+	// Often enough to feel immediate
+	const struct timespec poll = {0, 100000000};
+	Memo compiled;
+	Memo summaries;
+	new_memo(&compiled);
+	new_memo(&summaries);
+	o->summaries = &summaries;
+	Gisa g;
+	new_gisa(&g, progname);
+	g.memo = &compiled;
+	struct stat last;
+	bool first = true;
+	for (;; nanosleep(&poll, NULL)) {
+		struct stat st;
+		errno = 0;
+		if (stat(file, &st)) {
+			if (!first) {
+				continue; // Being replaced, perhaps
+			}
+			fprintf(stderr, "%s: cannot access '%s': %s\n",
+				progname, file, strerror(errno));
+			break;
+		}
+		if (!first && !changed(&st, &last)) {
+			continue;
+		}
+		first = false;
+		last = st;
+		FILE *in = fopen(file, "r");
+		if (!in) {
+			fprintf(stderr, "%s: cannot access '%s': %s\n",
+				progname, file, strerror(errno));
+			continue;
+		}
+		struct timespec start;
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bool ok = parse_file(&g, in);
+		fclose(in);
+		if (ok && o->show_parse) {
+			p_sexp_ast(stderr, g.ast);
+			putc('\n', stderr);
+		}
+		if (ok && !compile_gisa(&g)) {
+			fprintf(stderr,
+				"%s: error: polynomial evaluation failed\n",
+				progname);
+			ok = false;
+		}
+		if (!ok) {
+			// Keep what the last version left for the next one.
+			compiled.hits = compiled.misses = 0;
+			continue;
+		}
+		const unsigned long reused = compiled.hits;
+		const unsigned long evaluated = compiled.misses;
+		sweep_memo(&compiled);
+		const bool ran = report(run_mode(&g.prog, o));
+		if (fflush(stdout)) {
+			fprintf(stderr, "%s: write error: %s\n", progname,
+				strerror(errno));
+			clearerr(stdout);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		fprintf(stderr,
+			"%s: ran '%s' in %.3lf s, reusing %lu of %lu "
+			"polynomials and regions",
+			progname, file,
+			(double)(end.tv_sec - start.tv_sec) +
+			    (end.tv_nsec - start.tv_nsec) / 1e9,
+			reused, reused + evaluated);
+		if (o->mode == MODE_ANALYZE) {
+			fprintf(stderr, " and %lu of %lu summaries",
+				summaries.hits,
+				summaries.hits + summaries.misses);
+		}
+		putc('\n', stderr);
+		if (ran) {
+			sweep_memo(&summaries);
+		} else {
+			summaries.hits = summaries.misses = 0;
+		}
+	}
+	free_gisa(&g);
+	free_memo(&compiled);
+	free_memo(&summaries);
+	return false;
+}
+
+// Run each program of the files `files` and of `o->manifest` on a thread of
+// its own. Returns `false` if failed, having reported the error.
+static bool run_batch(char **files, const Opts *o)
+{
+	BatchOpts bo = {.files = files,
+			.manifest = o->manifest,
+			.cache = o->cache,
+			.job = {.n = o->nsamples,
+				.seed = o->seed,
+				.iter_max = o->iter_max,
+				.fmt = FMT_TEXT},
+			.nthreads = o->nthreads,
+			.name = progname};
+	while (files[bo.nfiles]) {
+		++bo.nfiles;
+	}
+	switch (o->mode) {
+	case MODE_SAMPLE:
+		bo.job.mode = JOB_SAMPLE;
+		break;
+	case MODE_STATS:
+		bo.job.mode = JOB_STATS;
+		break;
+	case MODE_CHECK:
+		bo.job.mode = JOB_CHECK;
+		break;
+	case MODE_ANALYZE:
+		bo.job.mode = JOB_ANALYZE;
+		break;
+	default:
+		fprintf(stderr,
+			"%s: several programs run only when sampling, in "
+			"statistics, check, or analysis mode\n",
+			progname);
+		return false;
+	}
+	if (o->show_parse || o->verbose || o->adaptive || o->record ||
+	    o->store || o->trace_file || o->profile_file || o->phases) {
+		fprintf(stderr,
+			"%s: the flags `-p`, `-v`, `-a`, `-r`, `-w`, `-t`, `-P`, "
+			"and `--stats` apply to a single program\n",
+			progname);
+		return false;
+	}
+	if (o->fmt_name && (!parse_format(o->fmt_name, &bo.job.fmt) ||
+			    bo.job.fmt == FMT_BIN)) {
+		fprintf(stderr,
+			"%s: unknown format -- '%s' (expected text, csv, or "
+			"ndjson in batch mode)\n",
+			progname, o->fmt_name);
+		return false;
+	}
+	return batch(&bo);
+}
 
 int main(int argc, char *argv[])
 {
@@ -21,14 +905,40 @@ int main(int argc, char *argv[])
 	// Parse command line arguments
 	// Input file name
 	char *fin = NULL;
-	// Parse mode
-	bool show_parse = false;
-	// Verbose mode
-	bool verbose = false;
-	// Maximum iteration
-	int iter_max = 300;
-	// Seed for `rand`
-	unsigned int seed = time(NULL);
+	FILE *in = stdin;
+	Opts o = {.show_parse = false,
+		  .verbose = false,
+		  .iter_max = 300,
+		  .seed = time(NULL),
+		  .qmc = false,
+		  .nthreads = 0,
+		  .nsamples = 1,
+		  .has_nsamples = false,
+		  .adaptive = false,
+		  .tol = 0.,
+		  .conf = .95,
+		  .fmt_name = NULL,
+		  .record = NULL,
+		  .store = NULL,
+		  .query = NULL,
+		  .replay = NULL,
+		  .has_index = false,
+		  .trace_file = NULL,
+		  .keep = 0,
+		  .decode = NULL,
+		  .listen = NULL,
+		  .manifest = NULL,
+		  .cache = NULL,
+		  .watch = false,
+		  .summaries = NULL,
+		  .trace = NULL,
+		  .profile_file = NULL,
+		  .metric = METRIC_CYCLES,
+		  .profile = NULL,
+		  .phases = false,
+		  .mode = MODE_SAMPLE,
+		  .has_bounds = false,
+		  .nlevels = 16};
 
 	int optidx;
 	for (optidx = 1; optidx < argc && argv[optidx][0] == '-'; ++optidx) {
@@ -37,13 +947,19 @@ int main(int argc, char *argv[])
 			if (argv[optidx][2]) {
 				goto invalid_option;
 			}
-			show_parse = true;
+			o.show_parse = true;
 			break;
 		case 'v':
 			if (argv[optidx][2]) {
 				goto invalid_option;
 			}
-			verbose = true;
+			o.verbose = true;
+			break;
+		case 'q':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.qmc = true;
 			break;
 		case 'm': {
 			char *num = argv[optidx] + 2;
@@ -79,7 +995,7 @@ int main(int argc, char *argv[])
 				exit(EXIT_FAILURE);
 			}
 			// Now it is safe to convert.
-			iter_max = (int)lnum;
+			o.iter_max = (int)lnum;
 			break;
 		}
 		case 's': {
@@ -116,97 +1032,371 @@ int main(int argc, char *argv[])
 				exit(EXIT_FAILURE);
 			}
 			// Now it is safe to convert.
-			seed = (int)lnum;
+			o.seed = (int)lnum;
+			break;
+		}
+		case 'n':
+			o.nsamples = parse_ulong(flag_arg(argv, &optidx),
+						 ULONG_MAX);
+			o.has_nsamples = true;
+			break;
+		case 'j':
+			o.nthreads = (int)parse_ulong(flag_arg(argv, &optidx),
+						      THREADS_MAX);
+			if (!o.nthreads) {
+				fprintf(stderr,
+					"%s: number out of range [1, %d] -- "
+					"'0'\n",
+					progname, THREADS_MAX);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'f':
+			o.fmt_name = flag_arg(argv, &optidx);
+			break;
+		case 'H':
+			o.mode = MODE_HIST;
+			parse_res(flag_arg(argv, &optidx), &o.grid_nx,
+				  &o.grid_ny);
+			break;
+		case 'd':
+			o.mode = MODE_DENSITY;
+			parse_res(flag_arg(argv, &optidx), &o.grid_nx,
+				  &o.grid_ny);
+			break;
+		case 'S':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.mode = MODE_STATS;
+			break;
+		case 'X':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.mode = MODE_HULL;
+			break;
+		case 'a': {
+			char *arg = flag_arg(argv, &optidx);
+			double nums[2] = {0., o.conf};
+			parse_nums(arg, nums, 2);
+			if (!(nums[0] > 0. && nums[1] > 0. && nums[1] < 1.)) {
+				fprintf(stderr,
+					"%s: invalid tolerance or confidence "
+					"-- '%s'\n",
+					progname, arg);
+				exit(EXIT_FAILURE);
+			}
+			o.mode = MODE_STATS;
+			o.adaptive = true;
+			o.tol = nums[0];
+			o.conf = nums[1];
+			break;
+		}
+		case 'R': {
+			char *arg = flag_arg(argv, &optidx);
+			double nums[5] = {0., 0., 0., 0., o.nlevels};
+			const int n = parse_nums(arg, nums, 5);
+			if (n < 4 || !(nums[0] <= nums[1] && nums[2] <= nums[3]) ||
+			    nums[4] != floor(nums[4]) || nums[4] < 1. ||
+			    nums[4] > SPLIT_LEVELS_MAX) {
+				fprintf(stderr, "%s: invalid target -- '%s'\n",
+					progname, arg);
+				exit(EXIT_FAILURE);
+			}
+			o.mode = MODE_SPLIT;
+			memcpy(o.target, nums, sizeof o.target);
+			o.nlevels = (int)nums[4];
+			break;
+		}
+		case 'r':
+			o.record = flag_arg(argv, &optidx);
+			break;
+		case 'w':
+			o.store = flag_arg(argv, &optidx);
+			break;
+		case 'Q':
+			o.query = flag_arg(argv, &optidx);
+			break;
+		case 'e': {
+			// "FILE[,INDEX]"
+			char *arg = flag_arg(argv, &optidx);
+			char *comma = strrchr(arg, ',');
+			if (comma && comma[1] && strspn(comma + 1, "0123456789") ==
+						     strlen(comma + 1)) {
+				*comma = '\0';
+				o.index = parse_ulong(comma + 1, ULONG_MAX);
+				o.has_index = true;
+			}
+			o.mode = MODE_REPLAY;
+			o.replay = arg;
+			break;
+		}
+		case 't':
+			o.trace_file = flag_arg(argv, &optidx);
+			break;
+		case 'k': {
+			char *arg = flag_arg(argv, &optidx);
+			o.keep = parse_ulong(arg, KEEP_MAX);
+			if (!o.keep) {
+				fprintf(stderr,
+					"%s: number out of range [1, %d] -- "
+					"'%s'\n",
+					progname, KEEP_MAX, arg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		}
+		case 'P': {
+			// "FILE[,METRIC]"
+			char *arg = flag_arg(argv, &optidx);
+			char *comma = strrchr(arg, ',');
+			if (comma && parse_metric(comma + 1, &o.metric)) {
+				*comma = '\0';
+			}
+			o.profile_file = arg;
+			break;
+		}
+		case '-':
+			if (strcmp(argv[optidx], "--stats")) {
+				goto invalid_option;
+			}
+			o.phases = true;
+			break;
+		case 'D':
+			o.decode = flag_arg(argv, &optidx);
+			break;
+		case 'L':
+			o.listen = flag_arg(argv, &optidx);
+			break;
+		case 'M':
+			o.manifest = flag_arg(argv, &optidx);
+			break;
+		case 'C':
+			o.cache = flag_arg(argv, &optidx);
+			break;
+		case 'W':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.watch = true;
+			break;
+		case 'c':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.mode = MODE_CHECK;
+			break;
+		case 'A':
+			if (argv[optidx][2]) {
+				goto invalid_option;
+			}
+			o.mode = MODE_ANALYZE;
+			break;
+		case 'b': {
+			char *arg = flag_arg(argv, &optidx);
+			if (parse_nums(arg, o.bounds, 4) != 4 ||
+			    !(o.bounds[0] < o.bounds[1] &&
+			      o.bounds[2] < o.bounds[3])) {
+				fprintf(stderr,
+					"%s: invalid bounds -- '%s'\n",
+					progname, arg);
+				exit(EXIT_FAILURE);
+			}
+			o.has_bounds = true;
 			break;
 		}
 		default:
 		invalid_option:
 			fprintf(stderr,
 				"%s: invalid option -- '%s'\n"
-				"%s: usage: %s [-p] [-v] [-mITERMAX] [-sSEED] "
-				"[FILE]\n",
+				"%s: usage: %s [-p] [-v] [-q] [-mITERMAX] [-sSEED] "
+				"[-nSAMPLES] [-jTHREADS] [-fFORMAT] "
+				"[-HNX[,NY] | -dNX[,NY] | -S | -aTOL[,CONF] | "
+				"-X | -RXMIN,XMAX,YMIN,YMAX[,LEVELS] | -c | -A | "
+				"-eRECORD[,INDEX]] [-rRECORD] [-wSTORE] "
+				"[-tTRACE [-kN]] "
+				"[-PPROFILE[,METRIC]] [--stats] "
+				"[-bXMIN,XMAX,YMIN,YMAX] [-CCACHE] "
+				"[-MMANIFEST] [-W] "
+				"[FILE... | -DTRACE | -LSOCKET | -QSTORE]\n",
 				progname, argv[optidx], progname, progname);
 			exit(EXIT_FAILURE);
 		}
 	}
 	argv += optidx;
+	if (o.verbose) {
+		// Keep the steps of trajectories from interleaving.
+		o.nthreads = 1;
+	} else if (!o.nthreads) {
+		const long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+		o.nthreads = nprocs < 1 ? 1 : (int)nprocs;
+		if (o.nthreads > THREADS_MAX) {
+			o.nthreads = THREADS_MAX;
+		}
+	}
+	if (o.record && o.mode != MODE_SAMPLE) {
+		fprintf(stderr, "%s: the flag `-r` records only when sampling\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if (o.store && o.mode != MODE_SAMPLE) {
+		fprintf(stderr, "%s: the flag `-w` stores only when sampling\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if (o.decode) {
+		exit(run_decode(&o) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (o.query) {
+		exit(run_query(&o) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (o.listen) {
+		const ServeOpts so = {.path = o.listen,
+				      .nthreads = o.nthreads,
+				      .name = progname};
+		exit(serve(&so) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (o.manifest || (*argv && argv[1])) {
+		exit(run_batch(argv, &o) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (o.trace_file && o.mode != MODE_SAMPLE && o.mode != MODE_HIST &&
+	    o.mode != MODE_STATS && o.mode != MODE_HULL &&
+	    o.mode != MODE_CHECK) {
+		fprintf(stderr,
+			"%s: the flag `-t` traces only when sampling, in "
+			"histogram, statistics, hull, or check mode\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if (o.profile_file && o.mode != MODE_SAMPLE && o.mode != MODE_HIST &&
+	    o.mode != MODE_STATS && o.mode != MODE_HULL &&
+	    o.mode != MODE_CHECK) {
+		fprintf(stderr,
+			"%s: the flag `-P` profiles only when sampling, in "
+			"histogram, statistics, hull, or check mode\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if (o.keep && !o.trace_file) {
+		fprintf(stderr, "%s: the flag `-k` requires a trace `-t`\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if ((o.mode == MODE_HIST || o.mode == MODE_DENSITY) &&
+	    !o.has_bounds) {
+		fprintf(stderr, "%s: the flag `-%c` requires bounds `-b`\n",
+			progname, o.mode == MODE_HIST ? 'H' : 'd');
+		exit(EXIT_FAILURE);
+	}
+	if (o.watch && (!*argv || o.trace_file || o.profile_file)) {
+		fprintf(stderr,
+			"%s: the flag `-W` requires a FILE, and does not "
+			"trace or profile\n",
+			progname);
+		exit(EXIT_FAILURE);
+	}
+	if (o.watch) {
+		exit(run_watch(*argv, &o) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
 
 	// Handle input file.
 	if (*argv) {
 		fin = *argv;
 		errno = 0;
-		if (!(yyin = fopen(*argv, "r"))) {
+		if (!(in = fopen(*argv, "r"))) {
 			fprintf(stderr, "%s: cannot access '%s': %s\n",
 				progname, fin, strerror(errno));
 			exit(EXIT_FAILURE);
 		}
 	}
 
+	Phases ph;
+	if (o.phases) {
+		start_phases(&ph);
+		phases = &ph;
+	}
+
 	// Begin parsing
-	ASTNode *nlist = NULL; // owns all allocated `ASTNode`s.
-	ASTNode *ast = NULL;
+	// Images have no AST to print or to profile by.
+	const char *cache = o.show_parse || o.profile_file ? NULL : o.cache;
+	Gisa g;
+	new_gisa(&g, progname);
 	errno = 0;
-	if (!yyparse(&nlist, &ast)) {
-		if (show_parse) {
+	if (cache ? load_gisa(&g, in, cache) : parse_file(&g, in)) {
+		if (o.show_parse) {
 			// Print the S-expression to `stderr`.
-			p_sexp_ast(stderr, ast);
+			p_sexp_ast(stderr, g.ast);
 			putc('\n', stderr);
 		}
 
-		Env env = {.init = false, .x = 0., .y = 0.};
-		srand(seed);
+		enter(PHASE_COMPILE);
+		if (!g.compiled && !compile_gisa(&g)) {
+			ecode = EXIT_FAILURE;
+			fprintf(stderr,
+				"%s: error: polynomial evaluation failed\n",
+				progname);
+			goto parse_cleanup;
+		}
+
+		const Prog *prog = &g.prog;
+
+		enter(PHASE_RUN);
+		Trace trace;
+		if (o.trace_file) {
+			if (!start_trace(&trace, &o)) {
+				ecode = EXIT_FAILURE;
+				errno = 0;
+				goto parse_cleanup;
+			}
+			o.trace = &trace;
+		}
+		Profile profile;
+		if (o.profile_file) {
+			if (!new_profile(&profile, prog)) {
+				ecode = EXIT_FAILURE;
+				errno = 0;
+				if (o.trace) {
+					stop_trace(&trace, &o, false);
+				}
+				goto parse_cleanup;
+			}
+			o.profile = &profile;
+		}
 
 		errno = 0;
-		const int ret = eval(ast, &env, iter_max, verbose);
-		if (errno) {
-			ecode = false;
-			fprintf(stderr, "%s: error: %s\n", progname,
-				strerror(errno));
-			errno = 0;
-		} else {
-			switch (ret) {
-			case 0:
-				printf("(%lf, %lf)\n", env.x, env.y);
-				break;
-			case 1:
-				ecode = false;
-				fprintf(stderr,
-					"%s: error: operation before "
-					"initialization\n",
-					progname);
-				break;
-			case 2:
-				ecode = false;
-				fprintf(stderr,
-					"%s: error: number argument expected\n",
-					progname);
-				break;
-			case 3:
-				ecode = false;
-				fprintf(
-				    stderr,
-				    "%s: error: polynomial evaluation failed\n",
-				    progname);
-				break;
-			default:
-				ecode = false;
-				fprintf(stderr, "%s: unknown error\n",
-					progname);
-				break;
+		int ret = run_mode(prog, &o);
+		// In flight mode, the last events lead up to the error.
+		if (o.trace && !stop_trace(&trace, &o, ret)) {
+			ret = ret ? ret : -2;
+		}
+		if (o.profile) {
+			if (!write_profile(&profile, prog, &o)) {
+				ret = ret ? ret : -2;
 			}
+			free_profile(&profile);
+		}
+		errno = 0;
+		if (!report(ret)) {
+			ecode = EXIT_FAILURE;
 		}
 	}
 
+parse_cleanup:
 	if (errno) {
-		ecode = false;
+		ecode = EXIT_FAILURE;
 		fprintf(stderr, "%s: error: %s\n", progname, strerror(errno));
 	}
+	if (phases) {
+		stop_phases(phases);
+		p_phases(stderr, phases);
+	}
 
 	// Clean up
-	free_nodes(nlist);
+	free_gisa(&g);
 
 	if (fin) {
-		if (fclose(yyin)) {
+		if (fclose(in)) {
 			fprintf(stderr, "%s: fclose error '%s': %s\n", progname,
 				fin, strerror(errno));
 			exit(EXIT_FAILURE);
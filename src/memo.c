@@ -0,0 +1,114 @@
+#include "memo.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Initial number of slots of a table
+#define MEMO_MIN 64
+
+// Forward declarations for static functions
+static MemoSlot *find(const Memo *m, uint64_t key);
+static bool rehash(Memo *m, size_t cap, bool sweep);
+
+void new_memo(Memo *m)
+{
+	*m = (Memo){0};
+}
+
+void free_memo(Memo *m)
+{
+	for (size_t i = 0; i < m->cap; ++i) {
+		free(m->slots[i].val);
+	}
+	free(m->slots);
+	*m = (Memo){0};
+}
+
+// The slot of `key` in `m`, or the free slot it would go in.
+static MemoSlot *find(const Memo *m, uint64_t key)
+{
+	size_t i = key & (m->cap - 1);
+	while (m->slots[i].val && m->slots[i].key != key) {
+		i = (i + 1) & (m->cap - 1);
+	}
+	return m->slots + i;
+}
+
+// Move the results of `m` into a table of `cap` slots, or if `sweep`, only
+// those kept for this generation, freeing the others.
+static bool rehash(Memo *m, size_t cap, bool sweep)
+{
+	MemoSlot *slots = calloc(cap, sizeof *slots);
+	if (!slots) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	Memo next = {.slots = slots, .cap = cap, .gen = m->gen};
+	for (size_t i = 0; i < m->cap; ++i) {
+		const MemoSlot *s = m->slots + i;
+		if (!s->val) {
+			continue;
+		}
+		if (sweep && s->gen != m->gen) {
+			free(s->val);
+			continue;
+		}
+		*find(&next, s->key) = *s;
+		++next.len;
+	}
+	free(m->slots);
+	m->slots = next.slots;
+	m->cap = next.cap;
+	m->len = next.len;
+	return true;
+}
+
+void *memo_get(Memo *m, uint64_t key)
+{
+	MemoSlot *s = m->cap ? find(m, key) : NULL;
+	if (!s || !s->val) {
+		++m->misses;
+		return NULL;
+	}
+	++m->hits;
+	s->gen = m->gen;
+	return s->val;
+}
+
+bool memo_put(Memo *m, uint64_t key, void *val)
+{
+	if (2 * (m->len + 1) > m->cap &&
+	    !rehash(m, m->cap ? 2 * m->cap : MEMO_MIN, false)) {
+		free(val);
+		return false;
+	}
+	MemoSlot *s = find(m, key);
+	if (s->val) {
+		free(s->val);
+	} else {
+		++m->len;
+	}
+	*s = (MemoSlot){key, val, m->gen};
+	return true;
+}
+
+void sweep_memo(Memo *m)
+{
+	size_t live = 0;
+	for (size_t i = 0; i < m->cap; ++i) {
+		live += m->slots[i].val && m->slots[i].gen == m->gen;
+	}
+	// Shrink to fit the live results, but not below the initial size.
+	size_t cap = MEMO_MIN;
+	while (cap < 2 * live) {
+		cap *= 2;
+	}
+	// If failed, the stale results are kept along with the live ones.
+	if (m->cap) {
+		rehash(m, cap, true);
+	}
+	++m->gen;
+	m->hits = m->misses = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+/* Results kept from one run to the next by a 64-bit key, such as the
+ * structural hash of the AST they are computed from.
+ *
+ * Each result is a block of memory owned by the table. The table counts
+ * generations: `sweep_memo` frees the results not looked up or added since
+ * the last sweep, so that a table swept after each run holds only the results
+ * of the last one, however many versions of a program have been run.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct MemoSlot {
+	uint64_t key;
+	void *val; // `NULL` if the slot is free
+	unsigned gen;
+} MemoSlot;
+
+// Open-addressing table with linear probing, at most half full
+typedef struct Memo {
+	MemoSlot *slots;
+	size_t cap; // A power of 2, or 0
+	size_t len;
+	unsigned gen;
+	unsigned long hits, misses; // Since the last sweep
+} Memo;
+
+void new_memo(Memo *m);
+
+void free_memo(Memo *m);
+
+// The result of `key` in `m`, kept for this generation, or `NULL` if none.
+void *memo_get(Memo *m, uint64_t key);
+
+// Have `m` own the result `val`, allocated with `malloc`, as that of `key`,
+// replacing the result it had if any. Returns `false` if failed, in which
+// case `val` has been freed.
+bool memo_put(Memo *m, uint64_t key, void *val);
+
+// Free the results of `m` not looked up or put since the last sweep, and
+// start a new generation.
+void sweep_memo(Memo *m);
+
+#endif /* ifndef MEMO_H */
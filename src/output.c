@@ -0,0 +1,457 @@
+#include "output.h"
+#include "ryu_table.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size of the buffer of a `Writer`
+#define WRITER_CAP (1 << 20)
+// Longest number printed by "%lf": the sign, the 309 digits of `DBL_MAX`, and
+// 7 for the point and the decimals
+#define LF_MAX 317
+// Longest record any format writes for a point, with the terminating null of
+// `snprintf`, which the text format prints its rare numbers with
+#define RECORD_MAX (2 * LF_MAX + 8)
+
+__extension__ typedef unsigned __int128 uint128;
+
+// Forward declarations for static functions
+static uint32_t pow5bits(int32_t e);
+static uint32_t log10_pow2(int32_t e);
+static uint32_t log10_pow5(int32_t e);
+static uint32_t pow5_factor(uint64_t v);
+static bool multiple_of_pow5(uint64_t v, uint32_t p);
+static bool multiple_of_pow2(uint64_t v, uint32_t p);
+static uint64_t mul_shift(uint64_t m, const uint64_t *mul, int32_t j);
+static int decimal_length(uint64_t v);
+static void d2d(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+		uint64_t *digits, int32_t *exponent);
+static size_t put_digits(char *dst, uint64_t v, int len);
+static size_t put_lf(char *dst, double v);
+static size_t put_json(char *dst, double v);
+static void put_le(char *dst, double v);
+
+bool parse_format(const char *name, Format *fmt)
+{
+	static const char *const names[] = {"text", "csv", "ndjson", "bin"};
+	for (size_t i = 0; i < sizeof names / sizeof *names; ++i) {
+		if (!strcmp(name, names[i])) {
+			*fmt = (Format)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool new_writer(Writer *w, FILE *stream, Format fmt)
+{
+	*w = (Writer){stream, fmt, malloc(WRITER_CAP), 0, WRITER_CAP, false};
+	if (!w->buf) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	if (fmt == FMT_CSV) {
+		memcpy(w->buf, "x,y\n", 4);
+		w->len = 4;
+	}
+	return true;
+}
+
+bool write_point(Writer *w, double x, double y)
+{
+	if (w->cap - w->len < RECORD_MAX && !flush_writer(w)) {
+		return false;
+	}
+	char *p = w->buf + w->len;
+	switch (w->fmt) {
+	case FMT_TEXT:
+		*p++ = '(';
+		p += put_lf(p, x);
+		memcpy(p, ", ", 2);
+		p += 2;
+		p += put_lf(p, y);
+		memcpy(p, ")\n", 2);
+		p += 2;
+		break;
+	case FMT_CSV:
+		p += fmt_double(p, x);
+		*p++ = ',';
+		p += fmt_double(p, y);
+		*p++ = '\n';
+		break;
+	case FMT_NDJSON:
+		memcpy(p, "{\"x\":", 5);
+		p += 5;
+		p += put_json(p, x);
+		memcpy(p, ",\"y\":", 5);
+		p += 5;
+		p += put_json(p, y);
+		memcpy(p, "}\n", 2);
+		p += 2;
+		break;
+	case FMT_BIN:
+		put_le(p, x);
+		put_le(p + 8, y);
+		p += 16;
+		break;
+	}
+	w->len = p - w->buf;
+	return true;
+}
+
+bool flush_writer(Writer *w)
+{
+	if (w->err) {
+		return false;
+	}
+	if (w->len && fwrite(w->buf, 1, w->len, w->stream) != w->len) {
+		w->err = true;
+		return false;
+	}
+	w->len = 0;
+	return true;
+}
+
+bool free_writer(Writer *w)
+{
+	const bool success = flush_writer(w) && !fflush(w->stream);
+	free(w->buf);
+	w->buf = NULL;
+	return success;
+}
+
+// JSON has no representation of non-finite numbers.
+static size_t put_json(char *dst, double v)
+{
+	if (v - v != 0.) {
+		memcpy(dst, "null", 4);
+		return 4;
+	}
+	return fmt_double(dst, v);
+}
+
+static void put_le(char *dst, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof bits);
+	for (int i = 0; i < 8; ++i) {
+		dst[i] = (char)(bits >> 8 * i);
+	}
+}
+
+/* Shortest round-trip formatting after Ulf Adams, "Ryū: Fast Float-to-String
+ * Conversion" (PLDI 2018).
+ *
+ * A double m2 * 2^e2 is widened into the interval (mm, mp) of the reals that
+ * round to it. The interval is scaled by a power of 10 with 128-bit products
+ * from `ryu_table.h`, and digits are removed from the scaled bounds while they
+ * still differ, which yields the shortest digits in the interval. The digits of
+ * the scaled value itself decide the rounding of the last remaining digit.
+ */
+
+// ceil(log2(5^e)), or 1 if `e` is 0; valid for 0 <= `e` <= 3528.
+static uint32_t pow5bits(int32_t e)
+{
+	return (uint32_t)(((e * 1217359) >> 19) + 1);
+}
+
+// floor(log10(2^e)); valid for 0 <= `e` <= 1650.
+static uint32_t log10_pow2(int32_t e) { return (uint32_t)((e * 78913) >> 18); }
+
+// floor(log10(5^e)); valid for 0 <= `e` <= 2620.
+static uint32_t log10_pow5(int32_t e)
+{
+	return (uint32_t)((e * 732923) >> 20);
+}
+
+static uint32_t pow5_factor(uint64_t v)
+{
+	uint32_t count = 0;
+	for (; v % 5 == 0; v /= 5) {
+		++count;
+	}
+	return count;
+}
+
+static bool multiple_of_pow5(uint64_t v, uint32_t p)
+{
+	return pow5_factor(v) >= p;
+}
+
+static bool multiple_of_pow2(uint64_t v, uint32_t p)
+{
+	return !(v & ((1ull << p) - 1));
+}
+
+// (`m` * `mul`) >> `j`, where `mul` is a 128-bit {low, high} pair and `j` is
+// at least 64.
+static uint64_t mul_shift(uint64_t m, const uint64_t *mul, int32_t j)
+{
+	const uint128 b0 = (uint128)m * mul[0];
+	const uint128 b2 = (uint128)m * mul[1];
+	return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+static int decimal_length(uint64_t v)
+{
+	int len = 1;
+	for (; v >= 10; v /= 10) {
+		++len;
+	}
+	return len;
+}
+
+// Convert a finite nonzero double into the shortest `digits` * 10^`exponent`
+// that reads back to it.
+static void d2d(uint64_t ieee_mantissa, uint32_t ieee_exponent,
+		uint64_t *digits, int32_t *exponent)
+{
+	int32_t e2;
+	uint64_t m2;
+	if (ieee_exponent == 0) { // Subnormal
+		e2 = 1 - 1023 - 52 - 2;
+		m2 = ieee_mantissa;
+	} else {
+		e2 = (int32_t)ieee_exponent - 1023 - 52 - 2;
+		m2 = (1ull << 52) | ieee_mantissa;
+	}
+	// Round half to even when reading back, so the bounds are included
+	// only if `m2` is even.
+	const bool accept_bounds = !(m2 & 1);
+
+	// The interval is (4 `m2` - 1 - `mm_shift`, 4 `m2` + 2) * 2^`e2`; it
+	// is asymmetric at powers of 2.
+	const uint64_t mv = 4 * m2;
+	const uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+	uint64_t vr, vp, vm;
+	int32_t e10;
+	bool vm_trailing_zeros = false;
+	bool vr_trailing_zeros = false;
+	if (e2 >= 0) {
+		const uint32_t q = log10_pow2(e2) - (e2 > 3);
+		e10 = (int32_t)q;
+		const int32_t k = POW5_INV_BITCOUNT + pow5bits(q) - 1;
+		const int32_t i = -e2 + (int32_t)q + k;
+		vr = mul_shift(mv, POW5_INV_SPLIT[q], i);
+		vp = mul_shift(mv + 2, POW5_INV_SPLIT[q], i);
+		vm = mul_shift(mv - 1 - mm_shift, POW5_INV_SPLIT[q], i);
+		if (q <= 21) {
+			// Only one of `mp`, `mv`, and `mm` can be a multiple
+			// of 5, if any.
+			if (mv % 5 == 0) {
+				vr_trailing_zeros = multiple_of_pow5(mv, q);
+			} else if (accept_bounds) {
+				vm_trailing_zeros =
+				    multiple_of_pow5(mv - 1 - mm_shift, q);
+			} else {
+				vp -= multiple_of_pow5(mv + 2, q);
+			}
+		}
+	} else {
+		const uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+		e10 = (int32_t)q + e2;
+		const int32_t i = -e2 - (int32_t)q;
+		const int32_t k = (int32_t)pow5bits(i) - POW5_BITCOUNT;
+		const int32_t j = (int32_t)q - k;
+		vr = mul_shift(mv, POW5_SPLIT[i], j);
+		vp = mul_shift(mv + 2, POW5_SPLIT[i], j);
+		vm = mul_shift(mv - 1 - mm_shift, POW5_SPLIT[i], j);
+		if (q <= 1) {
+			// `mv` has at least `q` trailing zero bits.
+			vr_trailing_zeros = true;
+			if (accept_bounds) {
+				vm_trailing_zeros = mm_shift == 1;
+			} else {
+				--vp;
+			}
+		} else if (q < 63) {
+			vr_trailing_zeros = multiple_of_pow2(mv, q);
+		}
+	}
+
+	int32_t removed = 0;
+	uint32_t last_removed = 0;
+	uint64_t output;
+	if (vm_trailing_zeros || vr_trailing_zeros) {
+		for (; vp / 10 > vm / 10; ++removed) {
+			vm_trailing_zeros &= vm % 10 == 0;
+			vr_trailing_zeros &= last_removed == 0;
+			last_removed = (uint32_t)(vr % 10);
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+		}
+		if (vm_trailing_zeros) {
+			for (; vm % 10 == 0; ++removed) {
+				vr_trailing_zeros &= last_removed == 0;
+				last_removed = (uint32_t)(vr % 10);
+				vr /= 10;
+				vp /= 10;
+				vm /= 10;
+			}
+		}
+		if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+			// Exactly halfway; round to even.
+			last_removed = 4;
+		}
+		output = vr + ((vr == vm && (!accept_bounds ||
+					     !vm_trailing_zeros)) ||
+			       last_removed >= 5);
+	} else {
+		// Common case, where no bound is exactly representable.
+		bool round_up = false;
+		if (vp / 100 > vm / 100) {
+			round_up = vr % 100 >= 50;
+			vr /= 100;
+			vp /= 100;
+			vm /= 100;
+			removed += 2;
+		}
+		for (; vp / 10 > vm / 10; ++removed) {
+			round_up = vr % 10 >= 5;
+			vr /= 10;
+			vp /= 10;
+			vm /= 10;
+		}
+		output = vr + (vr == vm || round_up);
+	}
+	*digits = output;
+	*exponent = e10 + removed;
+}
+
+// Write the `len` decimal digits of `v` to `dst`.
+static size_t put_digits(char *dst, uint64_t v, int len)
+{
+	for (int i = len - 1; i >= 0; --i) {
+		dst[i] = (char)('0' + v % 10);
+		v /= 10;
+	}
+	return len;
+}
+
+// Write `v` to `dst` as "%lf" prints it, i.e., rounded to millionths half to
+// even, which must leave room for `LF_MAX` characters and a null. Returns the
+// number of characters written.
+static size_t put_lf(char *dst, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof bits);
+	const uint64_t ieee_mantissa = bits & ((1ull << 52) - 1);
+	const uint32_t ieee_exponent = (uint32_t)(bits >> 52) & 0x7ff;
+	if (ieee_exponent == 0x7ff || ieee_exponent >= 1023 + 64) {
+		// Non-finite, or at least 2^64; rare enough for `snprintf`.
+		const int len = snprintf(dst, LF_MAX + 1, "%lf", v);
+		return len < 0 ? 0 : (size_t)len;
+	}
+
+	// |`v`| is `m` * 2^-`s`.
+	const uint64_t m =
+	    ieee_exponent ? (1ull << 52) | ieee_mantissa : ieee_mantissa;
+	const int32_t e = ieee_exponent ? (int32_t)ieee_exponent : 1;
+	const int32_t s = 1023 + 52 - e;
+	uint64_t whole = 0;
+	uint64_t millionths = 0;
+	if (s <= 0) {
+		whole = m << -s;
+	} else if (s < 74) {
+		// Below 2^-74, |`v`| * 10^6 < 2^53 * 2^-74 * 2^20 < 1/2.
+		const uint64_t frac = s < 64 ? m & ((1ull << s) - 1) : m;
+		whole = s < 64 ? m >> s : 0;
+		const uint128 scaled = (uint128)frac * 1000000;
+		millionths = (uint64_t)(scaled >> s);
+		const uint128 rest = scaled - ((uint128)millionths << s);
+		const uint128 half = (uint128)1 << (s - 1);
+		millionths += rest > half || (rest == half && millionths & 1);
+		if (millionths == 1000000) {
+			++whole;
+			millionths = 0;
+		}
+	}
+
+	char *p = dst;
+	if (bits >> 63) {
+		*p++ = '-';
+	}
+	p += put_digits(p, whole, decimal_length(whole));
+	*p++ = '.';
+	p += put_digits(p, millionths, 6);
+	return p - dst;
+}
+
+int fmt_double(char *dst, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof bits);
+	const bool sign = bits >> 63;
+	const uint64_t ieee_mantissa = bits & ((1ull << 52) - 1);
+	const uint32_t ieee_exponent = (uint32_t)(bits >> 52) & 0x7ff;
+
+	char *p = dst;
+	if (ieee_exponent == 0x7ff) {
+		if (ieee_mantissa) {
+			memcpy(p, "nan", 3);
+			return 3;
+		}
+		if (sign) {
+			*p++ = '-';
+		}
+		memcpy(p, "inf", 3);
+		return (int)(p - dst) + 3;
+	}
+	if (sign) {
+		*p++ = '-';
+	}
+	if (!ieee_exponent && !ieee_mantissa) {
+		*p++ = '0';
+		return (int)(p - dst);
+	}
+
+	uint64_t digits;
+	int32_t exponent;
+	d2d(ieee_mantissa, ieee_exponent, &digits, &exponent);
+	const int len = decimal_length(digits);
+	// The decimal point goes after the `point`-th digit.
+	const int point = len + exponent;
+
+	if (exponent >= 0 && point <= 21) {
+		// Integer, e.g., 1200
+		p += put_digits(p, digits, len);
+		memset(p, '0', exponent);
+		p += exponent;
+	} else if (point > 0 && point <= 21) {
+		// e.g., 12.34
+		put_digits(p + 1, digits, len);
+		memmove(p, p + 1, point);
+		p[point] = '.';
+		p += len + 1;
+	} else if (point > -6 && point <= 0) {
+		// e.g., 0.001234
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -point);
+		p += -point;
+		p += put_digits(p, digits, len);
+	} else {
+		// e.g., 1.234e-7
+		put_digits(p + 1, digits, len);
+		p[0] = p[1];
+		if (len > 1) {
+			p[1] = '.';
+			p += len + 1;
+		} else {
+			p += 1;
+		}
+		*p++ = 'e';
+		int e = point - 1;
+		if (e < 0) {
+			*p++ = '-';
+			e = -e;
+		}
+		p += put_digits(p, (uint64_t)e, decimal_length((uint64_t)e));
+	}
+	return (int)(p - dst);
+}
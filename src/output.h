@@ -0,0 +1,54 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Maximum length of a number formatted by `fmt_double`, e.g.,
+// "-2.2250738585072014e-308".
+#define FMT_DOUBLE_MAX 25
+
+typedef enum Format {
+	FMT_TEXT,   // "(x, y)" per line, as printed by `printf("(%lf, %lf)")`
+	FMT_CSV,    // "x,y" header followed by "x,y" per line
+	FMT_NDJSON, // {"x":x,"y":y} per line
+	FMT_BIN     // Raw little-endian IEEE 754 doubles x and y
+} Format;
+
+// Buffered writer of sampled points. Points are formatted into a large buffer
+// which is handed to `stream` only when it fills up.
+typedef struct Writer {
+	FILE *stream;
+	Format fmt;
+	char *buf;
+	size_t len;
+	size_t cap;
+	bool err;
+} Writer;
+
+// Parse a format name, i.e., "text", "csv", "ndjson", or "bin". Returns
+// `false` if `name` is unknown.
+bool parse_format(const char *name, Format *fmt);
+
+// Initialize `w` to write to `stream`, and write the header of `fmt`.
+// Returns `false` if failed.
+bool new_writer(Writer *w, FILE *stream, Format fmt);
+
+// Write the point (`x`, `y`). Returns `false` if the writer has failed.
+bool write_point(Writer *w, double x, double y);
+
+// Write every buffered byte to the stream. Returns `false` if the writer has
+// failed.
+bool flush_writer(Writer *w);
+
+// Flush and release `w`. Returns `false` if the writer has failed.
+bool free_writer(Writer *w);
+
+// Write the shortest decimal representation of `v` which reads back to `v`
+// exactly into `dst`, which must have room for `FMT_DOUBLE_MAX` characters.
+// Returns the number of characters written; no terminating null is written.
+// Non-finite numbers are written as "nan", "inf", and "-inf".
+int fmt_double(char *dst, double v);
+
+#endif /* ifndef OUTPUT_H */
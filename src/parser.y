@@ -4,9 +4,28 @@
 
 %code requires {
 #include "ast.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+// State of a scanner: the name of its input in messages, and the line it is
+// on.
+typedef struct Scan {
+	const char *name;
+	int line;
+} Scan;
 }
 
 %code provides {
+// The reentrant scanner of lexer.l
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+int yylex_init_extra(Scan *extra, yyscan_t *scanner);
+void yyset_in(FILE *in, yyscan_t scanner);
+Scan *yyget_extra(yyscan_t scanner);
+int yylex_destroy(yyscan_t scanner);
+
 // `SS` must not have any side-effect. `SS` is intended to be substituted with
 // yacc's `$$`.
 #define CHK_NULL_NODE(SS, NODE)                                                \
@@ -17,7 +36,8 @@
 		}                                                              \
 	} while (0)
 
-int yyerror(ASTNode **nlist, ASTNode **ast, const char *msg);
+int yyerror(yyscan_t scanner, NodeList *nlist, ASTNode **ast,
+	    const char *msg);
 }
 
 %start	hook
@@ -28,17 +48,20 @@ int yyerror(ASTNode **nlist, ASTNode **ast, const char *msg);
 	ASTNode	*node;
 }
 
-%token		OR INIT ITER TRANSLATION ROTATION ERR
+%token		OR INIT ITER TRANSLATION ROTATION ASSERT REACH POLYGON LE GE AND
+		ERR
 %token	<num>	NUM
 %token	<var>	VAR
 
-%type	<node>	prgm init translation rotation sequence or iter
-		block region interval
+%type	<node>	prgm init translation rotation sequence or iter assert reach
+		block region box polygon vertices relations interval
 		poly mult neg expt atom
 
 %right	';'
 
-%parse-param { ASTNode **nlist } { ASTNode **ast }
+%define api.pure full
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { NodeList *nlist } { ASTNode **ast }
 
 %%
 hook:	  prgm	{ *ast = $1; }
@@ -49,6 +72,8 @@ prgm:	  init
 	| sequence
 	| or
 	| iter
+	| assert
+	| reach
 	;
 init:	  INIT '(' region ')'	{ CHK_NULL_NODE($$, init_node(nlist, $3)); }
 	;
@@ -66,12 +91,46 @@ or:	  block OR block	{ CHK_NULL_NODE($$, or_node(nlist, $1, $3)); }
 iter:	  ITER block	{ CHK_NULL_NODE($$, iter_node(nlist, $2)); }
 	;
 
+assert:	  ASSERT '(' region ')'	{
+		CHK_NULL_NODE($$, query_node(nlist, ASSERT_T, $3,
+					    yyget_extra(scanner)->line)); }
+	;
+reach:	  REACH '(' region ')'	{
+		CHK_NULL_NODE($$, query_node(nlist, REACH_T, $3,
+					    yyget_extra(scanner)->line)); }
+	;
+
 block:	  '{' prgm '}'	{ CHK_NULL_NODE($$, $2); }
 	;
-region:	  interval '*' interval	{
+region:	  box
+	| polygon
+	| relations	{ CHK_NULL_NODE($$, relations_node(nlist, $1)); }
+	;
+box:	  interval '*' interval	{
 		CHK_NULL_NODE($$, region_node(nlist, $1, $3)); }
-	/* | relations	{ */
-	/*         CHK_NULL_NODE($$, region_node(nlist, $1, $3)); } */
+	;
+polygon:	  POLYGON '(' vertices ')'	{
+			CHK_NULL_NODE($$, polygon_node(nlist, $3)); }
+		;
+vertices:	  '(' poly ',' poly ')'	{
+			CHK_NULL_NODE($$, vertex_node(nlist, $2, $4, NULL)); }
+		| '(' poly ',' poly ')' ',' vertices	{
+			CHK_NULL_NODE($$, vertex_node(nlist, $2, $4, $7)); }
+		;
+relations:	  poly le poly	{
+			CHK_NULL_NODE($$, relation_node(nlist, $1, $3, NULL)); }
+		| poly ge poly	{
+			CHK_NULL_NODE($$, relation_node(nlist, $3, $1, NULL)); }
+		| poly le poly AND relations	{
+			CHK_NULL_NODE($$, relation_node(nlist, $1, $3, $5)); }
+		| poly ge poly AND relations	{
+			CHK_NULL_NODE($$, relation_node(nlist, $3, $1, $5)); }
+		;
+le:	  LE
+	| '<'
+	;
+ge:	  GE
+	| '>'
 	;
 interval:	  '[' poly ',' poly ']'	{
 			CHK_NULL_NODE($$, interval_node(nlist, $2, $4)); }
@@ -95,16 +154,16 @@ expt:	  atom
 atom:	  NUM	{ CHK_NULL_NODE($$, num_node(nlist, $1)); }
 	| VAR	{ CHK_NULL_NODE($$, var_node(nlist, $1)); }
 	| '(' poly ')'	{ $$ = $2; }
-	| ERR	{ yyerror(nlist, ast, "syntax error"); YYABORT; }
+	| ERR	{ yyerror(scanner, nlist, ast, "syntax error"); YYABORT; }
 	;
 %%
 
-extern int lineno;
-extern char *progname;
-int yyerror(ASTNode **nlist, ASTNode **ast, const char *msg)
+int yyerror(yyscan_t scanner, NodeList *nlist, ASTNode **ast,
+	    const char *msg)
 {
 	(void)nlist;
 	(void)ast;
-	fprintf(stderr, "%s: %s near line %d\n", progname, msg, lineno);
+	const Scan *scan = yyget_extra(scanner);
+	fprintf(stderr, "%s: %s near line %d\n", scan->name, msg, scan->line);
 	return 0;
 }
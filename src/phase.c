@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "phase.h"
+#include "ast.h"
+#include "term.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *const phase_names[] = {"parse", "compile", "run",
+					  "output"};
+static const char *const counter_names[] = {"cycles", "instructions",
+					    "cache-misses", "branch-misses"};
+
+// Forward declarations for static functions
+static int open_counter(Counter c);
+static unsigned long long read_counter(int fd);
+static double clock_secs(clockid_t id);
+static void read_all(Phases *p, double *wall, double *cpu,
+		     unsigned long long *counts);
+
+// Open the hardware counter `c` of this process, including the threads it
+// starts later. Returns -1 if unavailable.
+static int open_counter(Counter c)
+{
+#ifdef __linux__
+	static const unsigned long long configs[] = {
+	    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+	    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+	struct perf_event_attr attr = {
+	    .type = PERF_TYPE_HARDWARE,
+	    .size = sizeof attr,
+	    .config = configs[c],
+	    .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING,
+	    .inherit = 1,
+	    .exclude_kernel = 1,
+	    .exclude_hv = 1};
+	const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+				PERF_FLAG_FD_CLOEXEC);
+	return fd < 0 ? -1 : (int)fd;
+#else
+	(void)c;
+	return -1;
+#endif
+}
+
+// Read the counter `fd`, scaled up for the time it was not counting while
+// others took its place.
+static unsigned long long read_counter(int fd)
+{
+	// Value, time enabled, and time running
+	unsigned long long v[3];
+	if (read(fd, v, sizeof v) != sizeof v || !v[2]) {
+		return 0;
+	}
+	if (v[2] >= v[1]) {
+		return v[0];
+	}
+	return (unsigned long long)((double)v[0] * v[1] / v[2]);
+}
+
+static double clock_secs(clockid_t id)
+{
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read the clocks and the counters of `p`.
+static void read_all(Phases *p, double *wall, double *cpu,
+		     unsigned long long *counts)
+{
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		counts[i] = p->fds[i] < 0 ? 0 : read_counter(p->fds[i]);
+	}
+	*cpu = clock_secs(CLOCK_PROCESS_CPUTIME_ID);
+	*wall = clock_secs(CLOCK_MONOTONIC);
+}
+
+void start_phases(Phases *p)
+{
+	memset(p, 0, sizeof *p);
+	p->cur = PHASE_PARSE;
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		p->fds[i] = open_counter((Counter)i);
+	}
+	read_all(p, &p->wall0, &p->cpu0, p->counts0);
+}
+
+void enter_phase(Phases *p, Phase ph)
+{
+	double wall, cpu;
+	unsigned long long counts[NCOUNTERS];
+	read_all(p, &wall, &cpu, counts);
+	p->wall[p->cur] += wall - p->wall0;
+	p->cpu[p->cur] += cpu - p->cpu0;
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		p->counts[p->cur][i] += counts[i] - p->counts0[i];
+	}
+	p->cur = ph;
+	p->wall0 = wall;
+	p->cpu0 = cpu;
+	memcpy(p->counts0, counts, sizeof counts);
+}
+
+void stop_phases(Phases *p)
+{
+	enter_phase(p, p->cur);
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		if (p->fds[i] >= 0) {
+			close(p->fds[i]);
+		}
+	}
+}
+
+void p_phases(FILE *stream, const Phases *p)
+{
+	fprintf(stream, "%-8s %11s %11s", "phase", "wall (s)", "cpu (s)");
+	bool any = false;
+	for (int i = 0; i < NCOUNTERS; ++i) {
+		fprintf(stream, " %14s", counter_names[i]);
+		any = any || p->fds[i] >= 0;
+	}
+	putc('\n', stream);
+	double wall = 0., cpu = 0.;
+	unsigned long long total[NCOUNTERS] = {0};
+	for (int ph = 0; ph <= NPHASES; ++ph) {
+		const bool sum = ph == NPHASES;
+		if (sum) {
+			fprintf(stream, "%-8s %11.6f %11.6f", "total", wall,
+				cpu);
+		} else {
+			fprintf(stream, "%-8s %11.6f %11.6f", phase_names[ph],
+				p->wall[ph], p->cpu[ph]);
+			wall += p->wall[ph];
+			cpu += p->cpu[ph];
+		}
+		for (int i = 0; i < NCOUNTERS; ++i) {
+			if (p->fds[i] < 0) {
+				fprintf(stream, " %14s", "-");
+				continue;
+			}
+			if (!sum) {
+				total[i] += p->counts[ph][i];
+			}
+			fprintf(stream, " %14llu",
+				sum ? total[i] : p->counts[ph][i]);
+		}
+		putc('\n', stream);
+	}
+	if (!any) {
+		fputs("Hardware counters are unavailable; timers only.\n",
+		      stream);
+	}
+	fprintf(stream,
+		"ast.c: %lu allocations, peak %zu bytes\n"
+		"term.c: %lu allocations, peak %zu bytes\n",
+		ast_tally.allocs, ast_tally.peak, term_tally.allocs,
+		term_tally.peak);
+}
@@ -0,0 +1,52 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdio.h>
+
+typedef enum Phase {
+	PHASE_PARSE,   // Lexing and parsing
+	PHASE_COMPILE, // Compiling the AST
+	PHASE_RUN,     // Sampling, propagating, or analyzing
+	PHASE_OUTPUT,  // Writing the results out
+	NPHASES
+} Phase;
+
+// Hardware counters read for each phase
+typedef enum Counter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	NCOUNTERS
+} Counter;
+
+// Wall-clock and CPU time of each phase of a run, and the hardware counters
+// of all its threads where the system lets them be read
+typedef struct Phases {
+	Phase cur;
+	// Counters, -1 where unavailable, closed once stopped
+	int fds[NCOUNTERS];
+	// Readings at the start of the current phase
+	double wall0;
+	double cpu0;
+	unsigned long long counts0[NCOUNTERS];
+	// Totals of each phase
+	double wall[NPHASES];
+	double cpu[NPHASES];
+	unsigned long long counts[NPHASES][NCOUNTERS];
+} Phases;
+
+// Open the counters, and start the parse phase.
+void start_phases(Phases *p);
+
+// End the current phase of `p`, and start `ph`.
+void enter_phase(Phases *p, Phase ph);
+
+// End the current phase of `p`, and close the counters.
+void stop_phases(Phases *p);
+
+// Print the times and counts of each phase of `p`, and the allocations of
+// the AST and the polynomials on the calling thread, to `stream`.
+void p_phases(FILE *stream, const Phases *p);
+
+#endif /* ifndef PHASE_H */
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+#include "profile.h"
+#include "ast.h"
+#include "compile.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Maximum length of the name of a node in a path
+#define LABEL_MAX 60
+
+// State of writing folded stacks: the path to the node being written
+typedef struct Folder {
+	FILE *stream;
+	const Profile *p;
+	const Prog *prog;
+	Metric m;
+	char *path;
+	size_t len;
+	size_t cap;
+	bool err;
+} Folder;
+
+// Forward declarations for static functions
+static bool push_label(Folder *f, const ASTNode *ast);
+static unsigned long long fold_below(Folder *f, int pc);
+static void fold(Folder *f, int pc);
+
+bool new_profile(Profile *p, const Prog *prog)
+{
+	const int n = prog->ninsns;
+	*p = (Profile){.ninsns = n};
+	p->visits = calloc(n, sizeof *p->visits);
+	p->ticks = calloc(n, sizeof *p->ticks);
+	if (!p->visits || !p->ticks) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_profile(p);
+		return false;
+	}
+	return true;
+}
+
+void free_profile(Profile *p)
+{
+	free(p->visits);
+	free(p->ticks);
+	p->visits = p->ticks = NULL;
+}
+
+void merge_profile(Profile *dest, const Profile *src)
+{
+	for (int i = 0; i < dest->ninsns; ++i) {
+		dest->visits[i] += src->visits[i];
+		dest->ticks[i] += src->ticks[i];
+	}
+}
+
+bool parse_metric(const char *name, Metric *m)
+{
+	static const char *const names[] = {"cycles", "visits", "allocs"};
+	for (size_t i = 0; i < sizeof names / sizeof *names; ++i) {
+		if (!strcmp(name, names[i])) {
+			*m = (Metric)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Append the S-expression of `ast` to the path of `f`, cut short if long.
+static bool push_label(Folder *f, const ASTNode *ast)
+{
+	char *sexp = NULL;
+	size_t len = 0;
+	FILE *mem = open_memstream(&sexp, &len);
+	if (!mem) {
+		goto mem_err;
+	}
+	p_sexp_ast(mem, ast);
+	if (fclose(mem)) {
+		free(sexp);
+		goto mem_err;
+	}
+	const size_t keep = len > LABEL_MAX ? LABEL_MAX : len;
+	if (f->len + keep + 5 > f->cap) {
+		const size_t cap = 2 * (f->len + keep + 5);
+		char *path = realloc(f->path, cap);
+		if (!path) {
+			free(sexp);
+			goto mem_err;
+		}
+		f->path = path;
+		f->cap = cap;
+	}
+	if (f->len) {
+		f->path[f->len++] = ';';
+	}
+	memcpy(f->path + f->len, sexp, keep);
+	f->len += keep;
+	if (keep < len) {
+		memcpy(f->path + f->len, "...", 3);
+		f->len += 3;
+	}
+	f->path[f->len] = '\0';
+	free(sexp);
+	return true;
+
+mem_err:
+	fputs("Failed to allocate memory.\n", stderr);
+	return false;
+}
+
+// Write the nodes at `pc`, looking through sequences, below the path of `f`.
+// Returns the ticks spent in them.
+static unsigned long long fold_below(Folder *f, int pc)
+{
+	const Insn *insn = f->prog->insns + pc;
+	if (insn->type == I_SEQUENCE) {
+		return fold_below(f, insn->u.branch.p1) +
+		       fold_below(f, insn->u.branch.p2);
+	}
+	fold(f, pc);
+	return f->p->ticks[pc];
+}
+
+// Write the node at `pc` and those below it.
+static void fold(Folder *f, int pc)
+{
+	if (f->err) {
+		return;
+	}
+	const size_t len = f->len;
+	if (!push_label(f, f->prog->nodes[pc])) {
+		f->err = true;
+		return;
+	}
+	const Insn *insn = f->prog->insns + pc;
+	unsigned long long below = 0;
+	if (insn->type == I_OR) {
+		below = fold_below(f, insn->u.branch.p1) +
+			fold_below(f, insn->u.branch.p2);
+	} else if (insn->type == I_ITER) {
+		below = fold_below(f, insn->u.iter_body);
+	}
+	unsigned long long count = 0;
+	switch (f->m) {
+	case METRIC_CYCLES:
+		// Ticks may go back across processors.
+		count = f->p->ticks[pc] > below ? f->p->ticks[pc] - below : 0;
+		break;
+	case METRIC_VISITS:
+		count = f->p->visits[pc];
+		break;
+	case METRIC_ALLOCS:
+		count = f->prog->nallocs[pc];
+		break;
+	}
+	if (count && !f->err &&
+	    fprintf(f->stream, "%s %llu\n", f->path, count) < 0) {
+		f->err = true;
+	}
+	f->len = len;
+	if (f->path) {
+		f->path[len] = '\0';
+	}
+}
+
+bool p_profile(FILE *stream, const Profile *p, const Prog *prog, Metric m)
+{
+	Folder f = {.stream = stream, .p = p, .prog = prog, .m = m};
+	fold_below(&f, prog->entry);
+	free(f.path);
+	return !f.err;
+}
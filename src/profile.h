@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+struct Prog;
+
+// Visits and clock ticks of each `Insn` of a program over the trajectories
+// sampled by a thread, or merged from threads.
+typedef struct Profile {
+	int ninsns;
+	unsigned long long *visits;
+	// Ticks spent in each `Insn`, including the `Insn`s it runs
+	unsigned long long *ticks;
+} Profile;
+
+// What the folded stacks of a profile count
+typedef enum Metric { METRIC_CYCLES, METRIC_VISITS, METRIC_ALLOCS } Metric;
+
+// Initialize `p` for the `Insn`s of `prog`. Returns `false` if failed.
+bool new_profile(Profile *p, const struct Prog *prog);
+
+void free_profile(Profile *p);
+
+// Add the counts of `src` to `dest`.
+void merge_profile(Profile *dest, const Profile *src);
+
+// Parse the name of a metric: cycles, visits, or allocs. Returns `false` if
+// unknown.
+bool parse_metric(const char *name, Metric *m);
+
+// Write `p` to `stream` as folded stacks, a line per path of AST nodes from
+// the top with its own count of `m`: the cycles spent in the node but not in
+// the nodes below it, the visits of the node, or the `TermNode`s allocated
+// evaluating its polynomials. Each node is named by its S-expression, cut
+// short if long; the sequences are left out of the paths. Returns `false` if
+// failed.
+bool p_profile(FILE *stream, const Profile *p, const struct Prog *prog,
+	       Metric m);
+
+// Read the time stamp counter, or a clock in nanoseconds where there is none.
+static inline unsigned long long prof_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+#endif /* ifndef PROFILE_H */
@@ -0,0 +1,115 @@
+#include "qmc.h"
+#include <stdint.h>
+
+// Direction numbers of the first 4 dimensions of the Sobol sequence, from the
+// primitive polynomials and initial numbers of Joe and Kuo.
+static const uint32_t directions[QMC_DIMS][32] = {
+	{0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000,
+	 0x04000000, 0x02000000, 0x01000000, 0x00800000, 0x00400000,
+	 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000,
+	 0x00010000, 0x00008000, 0x00004000, 0x00002000, 0x00001000,
+	 0x00000800, 0x00000400, 0x00000200, 0x00000100, 0x00000080,
+	 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004,
+	 0x00000002, 0x00000001},
+	{0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000,
+	 0xcc000000, 0xaa000000, 0xff000000, 0x80800000, 0xc0c00000,
+	 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000,
+	 0xffff0000, 0x80008000, 0xc000c000, 0xa000a000, 0xf000f000,
+	 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00, 0x80808080,
+	 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc,
+	 0xaaaaaaaa, 0xffffffff},
+	{0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000,
+	 0x5c000000, 0x8e000000, 0xc5000000, 0x68800000, 0x9cc00000,
+	 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000,
+	 0x90550000, 0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000,
+	 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500, 0x8000e880,
+	 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c,
+	 0x8e00eeee, 0xc5005555},
+	{0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000,
+	 0x74000000, 0xa2000000, 0x93000000, 0xd8800000, 0x25400000,
+	 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000,
+	 0xc3050000, 0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000,
+	 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00, 0x58800080,
+	 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074,
+	 0x200200a2, 0x50050093}};
+
+// Forward declarations for static functions
+static uint32_t sobol(uint32_t index, int dim);
+static uint32_t reverse_bits(uint32_t x);
+static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed);
+static uint32_t hash_combine(uint32_t seed, uint32_t v);
+static uint32_t hash(uint64_t x);
+
+static uint32_t sobol(uint32_t index, int dim)
+{
+	uint32_t x = 0;
+	for (int bit = 0; index; index >>= 1, ++bit) {
+		if (index & 1) {
+			x ^= directions[dim][bit];
+		}
+	}
+	return x;
+}
+
+static uint32_t reverse_bits(uint32_t x)
+{
+	x = (x << 16) | (x >> 16);
+	x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+	x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+	x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+	x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+	return x;
+}
+
+// Owen scrambling by the hash of Laine and Karras, which permutes a number
+// such that each bit depends only on the higher bits, applied to the
+// reversed bits.
+static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed)
+{
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47c;
+	x ^= x * 0xb82f1e52;
+	x ^= x * 0xc7afe638;
+	x ^= x * 0x8d22f6e6;
+	return reverse_bits(x);
+}
+
+static uint32_t hash_combine(uint32_t seed, uint32_t v)
+{
+	return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Finalizer of MurmurHash3, folded to 32 bits.
+static uint32_t hash(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccd;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53;
+	x ^= x >> 33;
+	return (uint32_t)x;
+}
+
+void seed_qmc(Qmc *q, uint64_t seed, uint64_t index)
+{
+	q->index = (uint32_t)index;
+	q->seed = hash(seed);
+	q->dim = 0;
+}
+
+double next_qmc(Qmc *q)
+{
+	const int k = q->dim % QMC_DIMS;
+	if (!k) {
+		const uint32_t seed =
+		    hash((uint64_t)q->seed << 32 | (uint32_t)(q->dim / QMC_DIMS));
+		const uint32_t index = nested_uniform_scramble(q->index, seed);
+		for (int i = 0; i < QMC_DIMS; ++i) {
+			q->point[i] = nested_uniform_scramble(
+			    sobol(index, i), hash_combine(seed, i));
+		}
+	}
+	++q->dim;
+	return q->point[k] * 0x1.0p-32;
+}
@@ -0,0 +1,29 @@
+#ifndef QMC_H
+#define QMC_H
+
+#include <stdint.h>
+
+// Number of dimensions of a Sobol point
+#define QMC_DIMS 4
+
+// Source of quasi-random numbers for a trajectory. The `d`-th number a
+// trajectory draws is coordinate `d % QMC_DIMS` of a 4-dimensional Sobol
+// point, which is Owen-scrambled and whose index is shuffled with a seed of
+// its own for each group `d / QMC_DIMS` (Burley, 2020). So the trajectory
+// `index` draws the same dimensions however it is scheduled, and every 4
+// consecutive draws are stratified over trajectories, as many dimensions as
+// the trajectory draws.
+typedef struct Qmc {
+	uint32_t index; // Index of the trajectory modulo 2^32
+	uint32_t seed;
+	int dim; // Number of numbers drawn so far
+	uint32_t point[QMC_DIMS];
+} Qmc;
+
+// Start the sequence of numbers of the trajectory `index` for `seed`.
+void seed_qmc(Qmc *q, uint64_t seed, uint64_t index);
+
+// Next quasi-random number in [0, 1) for the trajectory.
+double next_qmc(Qmc *q);
+
+#endif /* ifndef QMC_H */
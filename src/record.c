@@ -0,0 +1,182 @@
+#include "record.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Magic number at the head of a record file
+#define RECORD_MAGIC "GISAREC1"
+// Number of bytes of bits `write_record` hands to the stream at a time
+#define RECORD_CHUNK 512
+
+// Forward declarations for static functions
+static bool put_varint(FILE *stream, uint64_t v);
+static bool get_varint(FILE *stream, uint64_t *v);
+
+bool grow_record(Record *r)
+{
+	const size_t cap = r->cap ? 2 * r->cap : 16;
+	uint64_t *words = realloc(r->words, cap * sizeof *words);
+	if (!words) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	r->words = words;
+	r->cap = cap;
+	return true;
+}
+
+void free_record(Record *r)
+{
+	free(r->words);
+	*r = (Record){0};
+}
+
+void put_count(Record *r, uint32_t count)
+{
+	const uint64_t m = (uint64_t)count + 1;
+	int nbits = 0;
+	while (m >> (nbits + 1)) {
+		++nbits;
+	}
+	if (nbits) {
+		put_bits(r, 0, nbits);
+	}
+	put_bits(r, 1, 1);
+	if (nbits) {
+		put_bits(r, m, nbits);
+	}
+}
+
+uint32_t get_count(Record *r)
+{
+	int nbits = 0;
+	while (!get_bits(r, 1)) {
+		if (r->err || ++nbits > 32) {
+			r->err = true;
+			return 0;
+		}
+	}
+	const uint64_t m =
+	    (UINT64_C(1) << nbits) | (nbits ? get_bits(r, nbits) : 0);
+	return (uint32_t)(m - 1);
+}
+
+// Write `v` in LEB128: 7 bits a byte from the lowest, with the high bit set on
+// every byte but the last.
+static bool put_varint(FILE *stream, uint64_t v)
+{
+	while (v >= 0x80) {
+		if (putc((int)(v & 0x7f) | 0x80, stream) == EOF) {
+			return false;
+		}
+		v >>= 7;
+	}
+	return putc((int)v, stream) != EOF;
+}
+
+static bool get_varint(FILE *stream, uint64_t *v)
+{
+	*v = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int c = getc(stream);
+		if (c == EOF) {
+			return false;
+		}
+		*v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool write_record_header(FILE *stream)
+{
+	return fwrite(RECORD_MAGIC, 1, 8, stream) == 8;
+}
+
+bool write_record(FILE *stream, unsigned long index, const Record *r,
+		  size_t from, size_t to)
+{
+	if (!put_varint(stream, index) || !put_varint(stream, to - from)) {
+		return false;
+	}
+	// Realign the bits to a byte boundary, a chunk of bytes at a time.
+	unsigned char buf[RECORD_CHUNK];
+	size_t len = 0;
+	Record cursor = *r;
+	cursor.pos = from;
+	for (size_t left = to - from; left;) {
+		const int n = left < 64 ? (int)left : 64;
+		const uint64_t v = get_bits(&cursor, n);
+		for (int k = 0; k < n; k += 8) {
+			buf[len++] = (unsigned char)(v >> k);
+		}
+		left -= n;
+		if (len + 8 > sizeof buf || !left) {
+			if (fwrite(buf, 1, len, stream) != len) {
+				return false;
+			}
+			len = 0;
+		}
+	}
+	return true;
+}
+
+size_t record_size(unsigned long index, size_t nbits)
+{
+	size_t len = (nbits + 7) / 8;
+	for (uint64_t v = index; v >= 0x80; v >>= 7) {
+		++len;
+	}
+	for (uint64_t v = nbits; v >= 0x80; v >>= 7) {
+		++len;
+	}
+	return len + 2;
+}
+
+bool read_record_header(FILE *stream)
+{
+	char magic[8];
+	return fread(magic, 1, sizeof magic, stream) == sizeof magic &&
+	       !memcmp(magic, RECORD_MAGIC, sizeof magic);
+}
+
+bool read_record(FILE *stream, unsigned long *index, Record *r)
+{
+	uint64_t i, len;
+	r->len = r->pos = 0;
+	r->err = false;
+	const int c = getc(stream);
+	if (c == EOF) {
+		// The end of the file
+		r->err = ferror(stream);
+		return false;
+	}
+	ungetc(c, stream);
+	if (!get_varint(stream, &i) || !get_varint(stream, &len) ||
+	    len > SIZE_MAX - 63) {
+		r->err = true;
+		return false;
+	}
+	while (r->cap < (len + 63) / 64) {
+		if (!grow_record(r)) {
+			r->err = true;
+			return false;
+		}
+	}
+	memset(r->words, 0, (len + 63) / 64 * sizeof *r->words);
+	for (size_t k = 0; k < (len + 7) / 8; ++k) {
+		const int c = getc(stream);
+		if (c == EOF) {
+			r->err = true;
+			return false;
+		}
+		r->words[k / 8] |= (uint64_t)c << 8 * (k % 8);
+	}
+	*index = (unsigned long)i;
+	r->len = len;
+	return true;
+}
@@ -0,0 +1,90 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Bits of the choices of trajectories, packed from the least significant bit
+// of `words[0]` on: a bit per `or`, the Elias gamma code of 1 + the count per
+// `iter`, and 53 bits per uniform number drawn by an `init`. Replaying the
+// bits reproduces a trajectory exactly without its random numbers.
+typedef struct Record {
+	uint64_t *words;
+	size_t len; // Number of bits written
+	size_t cap; // Number of words allocated
+	size_t pos; // Number of bits read
+	// Out of memory while writing, or past the end while reading
+	bool err;
+} Record;
+
+// Make room for 64 more bits. Returns `false` if failed.
+bool grow_record(Record *r);
+
+void free_record(Record *r);
+
+// Append the `n` low bits of `v`, where 0 < `n` <= 64.
+static inline void put_bits(Record *r, uint64_t v, int n)
+{
+	if ((r->len + n + 63) / 64 > r->cap && !grow_record(r)) {
+		r->err = true;
+		return;
+	}
+	const size_t i = r->len / 64;
+	const int off = r->len % 64;
+	v = n < 64 ? v & ((UINT64_C(1) << n) - 1) : v;
+	r->words[i] = (off ? r->words[i] : 0) | v << off;
+	if (off + n > 64) {
+		r->words[i + 1] = v >> (64 - off);
+	}
+	r->len += n;
+}
+
+// Read the next `n` bits, where 0 < `n` <= 64.
+static inline uint64_t get_bits(Record *r, int n)
+{
+	if (r->pos + n > r->len) {
+		r->err = true;
+		return 0;
+	}
+	const size_t i = r->pos / 64;
+	const int off = r->pos % 64;
+	uint64_t v = r->words[i] >> off;
+	if (off + n > 64) {
+		v |= r->words[i + 1] << (64 - off);
+	}
+	r->pos += n;
+	return n < 64 ? v & ((UINT64_C(1) << n) - 1) : v;
+}
+
+// Append `count` in the Elias gamma code of `count` + 1: as many 0s as there
+// are bits below its leading 1, the 1, and then those bits.
+void put_count(Record *r, uint32_t count);
+
+// Read a count appended by `put_count`.
+uint32_t get_count(Record *r);
+
+// Write the header of a record file to `stream`. Returns `false` if failed.
+bool write_record_header(FILE *stream);
+
+// Write the bits `from`, ..., `to` - 1 of `r` as the record of the
+// trajectory `index` to `stream`: `index` and the number of bits in LEB128,
+// and then the bits packed into bytes. Returns `false` if failed.
+bool write_record(FILE *stream, unsigned long index, const Record *r,
+		  size_t from, size_t to);
+
+// Number of bytes `write_record` writes for the trajectory `index` of `nbits`
+// bits.
+size_t record_size(unsigned long index, size_t nbits);
+
+// Check the header of a record file read from `stream`. Returns `false` if
+// it is not one.
+bool read_record_header(FILE *stream);
+
+// Read the next record of `stream` into `r`, ready to be replayed, and the
+// index of its trajectory into `*index`. Returns `false` at the end of the
+// file or if failed, in which case `r->err` is set.
+bool read_record(FILE *stream, unsigned long *index, Record *r);
+
+#endif /* ifndef RECORD_H */
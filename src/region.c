@@ -0,0 +1,319 @@
+#include "region.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Forward declarations for static functions
+static int double_cmp(const void *a, const void *b);
+static bool segment_meets(double x0, double y0, double x1, double y1,
+			  double xl, double xu, double yl, double yu);
+static int clip(const double *in, int n, const double *abc, double *out);
+
+// Relative slack of a constraint when testing the intersections of two of
+// them against the rest
+#define HALFPLANE_TOL 1e-9
+
+void new_rect(Region *r, double xl, double xu, double yl, double yu)
+{
+	*r = (Region){.type = REGION_RECT, .xl = xl, .xu = xu, .yl = yl,
+		      .yu = yu};
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+bool new_polygon(Region *r, const double *xy, int n)
+{
+	*r = (Region){.type = REGION_POLYGON, .nvertices = n};
+	r->vertices = malloc(2 * n * sizeof *r->vertices);
+	r->slab_y = malloc(n * sizeof *r->slab_y);
+	r->slab_off = malloc(n * sizeof *r->slab_off);
+	if (!r->vertices || !r->slab_y || !r->slab_off) {
+		goto mem_err;
+	}
+	memcpy(r->vertices, xy, 2 * n * sizeof *xy);
+	r->xl = r->xu = xy[0];
+	r->yl = r->yu = xy[1];
+	for (int i = 0; i < n; ++i) {
+		r->xl = xy[2 * i] < r->xl ? xy[2 * i] : r->xl;
+		r->xu = xy[2 * i] > r->xu ? xy[2 * i] : r->xu;
+		r->yl = xy[2 * i + 1] < r->yl ? xy[2 * i + 1] : r->yl;
+		r->yu = xy[2 * i + 1] > r->yu ? xy[2 * i + 1] : r->yu;
+		r->slab_y[i] = xy[2 * i + 1];
+	}
+
+	// Distinct ordinates of the vertices bound the slabs.
+	qsort(r->slab_y, n, sizeof *r->slab_y, double_cmp);
+	int m = 0;
+	for (int i = 0; i < n; ++i) {
+		if (!m || r->slab_y[i] != r->slab_y[m - 1]) {
+			r->slab_y[m++] = r->slab_y[i];
+		}
+	}
+	r->nslabs = m - 1;
+
+	// Count the edges crossing each slab, and then fill them in.
+	for (int pass = 0; pass < 2; ++pass) {
+		int len = 0;
+		for (int k = 0; k < r->nslabs; ++k) {
+			r->slab_off[k] = len;
+			for (int i = 0; i < n; ++i) {
+				const int j = (i + 1) % n;
+				double x0 = xy[2 * i], y0 = xy[2 * i + 1];
+				double x1 = xy[2 * j], y1 = xy[2 * j + 1];
+				if (y0 > y1) {
+					const double tx = x0, ty = y0;
+					x0 = x1, y0 = y1;
+					x1 = tx, y1 = ty;
+				}
+				if (y0 == y1 || y0 > r->slab_y[k] ||
+				    y1 < r->slab_y[k + 1]) {
+					continue;
+				}
+				if (pass) {
+					r->edges[len] = (Edge){
+					    x0, y0, (x1 - x0) / (y1 - y0)};
+				}
+				++len;
+			}
+		}
+		r->slab_off[r->nslabs > 0 ? r->nslabs : 0] = len;
+		if (!pass && !(r->edges = malloc((len ? len : 1) *
+						 sizeof *r->edges))) {
+			goto mem_err;
+		}
+	}
+	return true;
+
+mem_err:
+	fputs("Failed to allocate memory.\n", stderr);
+	free_region(r);
+	return false;
+}
+
+void free_region(Region *r)
+{
+	if (r->type == REGION_POLYGON) {
+		free(r->vertices);
+		free(r->slab_y);
+		free(r->slab_off);
+		free(r->edges);
+	}
+	r->type = REGION_RECT;
+}
+
+// Clip the polygon of the `n` vertices `in` by the half-plane `abc` into `out`,
+// which has room for `n` + 1 vertices, by the method of Sutherland and
+// Hodgman. Returns the number of vertices left.
+static int clip(const double *in, int n, const double *abc, double *out)
+{
+	int len = 0;
+	for (int i = 0; i < n; ++i) {
+		const double *p = in + 2 * i;
+		const double *q = in + 2 * ((i + 1) % n);
+		const double dp = abc[0] * p[0] + abc[1] * p[1] - abc[2];
+		const double dq = abc[0] * q[0] + abc[1] * q[1] - abc[2];
+		if (dp <= 0.) {
+			out[2 * len] = p[0];
+			out[2 * len + 1] = p[1];
+			++len;
+		}
+		if ((dp < 0. && dq > 0.) || (dp > 0. && dq < 0.)) {
+			const double f = dp / (dp - dq);
+			out[2 * len] = p[0] + f * (q[0] - p[0]);
+			out[2 * len + 1] = p[1] + f * (q[1] - p[1]);
+			++len;
+		}
+	}
+	return len;
+}
+
+bool halfplanes_polygon(const double *abc, int m, double **xy, int *n)
+{
+	// Every vertex of a bounded polygon is where two of the lines meet, so
+	// a square around those within all the constraints holds the polygon,
+	// and clipping the square by the constraints leaves it.
+	double reach = 0.;
+	bool any = false;
+	for (int i = 0; i < m; ++i) {
+		for (int j = i + 1; j < m; ++j) {
+			const double *e = abc + 3 * i;
+			const double *f = abc + 3 * j;
+			const double det = e[0] * f[1] - f[0] * e[1];
+			if (det == 0.) {
+				continue;
+			}
+			const double x = (e[2] * f[1] - f[2] * e[1]) / det;
+			const double y = (e[0] * f[2] - f[0] * e[2]) / det;
+			bool in = isfinite(x) && isfinite(y);
+			for (int k = 0; in && k < m; ++k) {
+				const double *g = abc + 3 * k;
+				const double slack =
+				    HALFPLANE_TOL * (fabs(g[0] * x) +
+						     fabs(g[1] * y) +
+						     fabs(g[2]));
+				in = g[0] * x + g[1] * y <= g[2] + slack;
+			}
+			if (in) {
+				any = true;
+				reach = fmax(reach, fmax(fabs(x), fabs(y)));
+			}
+		}
+	}
+	const double side = 2. * reach + 1.;
+	double *buf = malloc(4 * (m + 5) * sizeof *buf);
+	if (!buf) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	double *cur = buf;
+	double *next = buf + 2 * (m + 5);
+	const double square[] = {-side, -side, side, -side,
+				 side,	side,  -side, side};
+	memcpy(cur, square, sizeof square);
+	int len = 4;
+	for (int k = 0; any && k < m && len; ++k) {
+		len = clip(cur, len, abc + 3 * k, next);
+		double *tmp = cur;
+		cur = next;
+		next = tmp;
+	}
+	double area = 0.;
+	bool bounded = true;
+	for (int i = 0; i < len; ++i) {
+		const int j = (i + 1) % len;
+		area += cur[2 * i] * cur[2 * j + 1] -
+			cur[2 * j] * cur[2 * i + 1];
+		bounded = bounded && fabs(cur[2 * i]) < side * .75 &&
+			  fabs(cur[2 * i + 1]) < side * .75;
+	}
+	if (!any || len < 3 || !bounded || !(area > 0.)) {
+		fputs("The constraints must bound a polygon with an area.\n",
+		      stderr);
+		free(buf);
+		return false;
+	}
+	// Move the result to the front, and let it be the caller's.
+	memmove(buf, cur, 2 * len * sizeof *buf);
+	*xy = buf;
+	*n = len;
+	return true;
+}
+
+bool region_contains(const Region *r, double x, double y)
+{
+	if (!(x >= r->xl && x <= r->xu && y >= r->yl && y <= r->yu)) {
+		return false;
+	}
+	if (r->type == REGION_RECT) {
+		return true;
+	}
+	if (r->nslabs < 1) {
+		return false;
+	}
+	// The last slab `k` with `slab_y[k]` <= `y`
+	int lo = 0;
+	int hi = r->nslabs;
+	while (hi - lo > 1) {
+		const int mid = (lo + hi) / 2;
+		if (r->slab_y[mid] <= y) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	bool in = false;
+	for (int e = r->slab_off[lo]; e < r->slab_off[lo + 1]; ++e) {
+		const Edge *edge = r->edges + e;
+		in ^= edge->x + (y - edge->y) * edge->slope > x;
+	}
+	return in;
+}
+
+// Whether the segment from (`x0`, `y0`) to (`x1`, `y1`) meets the closed box
+// by the clipping of Liang and Barsky.
+static bool segment_meets(double x0, double y0, double x1, double y1,
+			  double xl, double xu, double yl, double yu)
+{
+	const double p[] = {x0 - x1, x1 - x0, y0 - y1, y1 - y0};
+	const double q[] = {x0 - xl, xu - x0, y0 - yl, yu - y0};
+	double t0 = 0.;
+	double t1 = 1.;
+	for (int i = 0; i < 4; ++i) {
+		if (p[i] == 0.) {
+			if (q[i] < 0.) {
+				return false;
+			}
+			continue;
+		}
+		const double t = q[i] / p[i];
+		if (p[i] < 0.) {
+			if (t > t1) {
+				return false;
+			}
+			t0 = t > t0 ? t : t0;
+		} else {
+			if (t < t0) {
+				return false;
+			}
+			t1 = t < t1 ? t : t1;
+		}
+	}
+	return true;
+}
+
+bool region_covers(const Region *r, double xl, double xu, double yl,
+		   double yu)
+{
+	if (!(xl >= r->xl && xu <= r->xu && yl >= r->yl && yu <= r->yu)) {
+		return false;
+	}
+	if (r->type == REGION_RECT) {
+		return true;
+	}
+	if (!region_contains(r, xl, yl) || !region_contains(r, xl, yu) ||
+	    !region_contains(r, xu, yl) || !region_contains(r, xu, yu)) {
+		return false;
+	}
+	// With the corners inside, the box is inside unless the boundary
+	// cuts in.
+	const double *v = r->vertices;
+	for (int i = 0; i < r->nvertices; ++i) {
+		const int j = (i + 1) % r->nvertices;
+		if (segment_meets(v[2 * i], v[2 * i + 1], v[2 * j],
+				  v[2 * j + 1], xl, xu, yl, yu)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool region_meets(const Region *r, double xl, double xu, double yl,
+		  double yu)
+{
+	if (!(xl <= r->xu && xu >= r->xl && yl <= r->yu && yu >= r->yl)) {
+		return false;
+	}
+	if (r->type == REGION_RECT) {
+		return true;
+	}
+	// Either the box is inside, or the boundary meets the box.
+	if (region_contains(r, xl, yl)) {
+		return true;
+	}
+	const double *v = r->vertices;
+	for (int i = 0; i < r->nvertices; ++i) {
+		const int j = (i + 1) % r->nvertices;
+		if (segment_meets(v[2 * i], v[2 * i + 1], v[2 * j],
+				  v[2 * j + 1], xl, xu, yl, yu)) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,58 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdbool.h>
+
+// An edge of a polygon crossing a slab, at `x` + (y - `y`) * `slope`.
+typedef struct Edge {
+	double x;
+	double y;
+	double slope;
+} Edge;
+
+// A region to test points and boxes against, compiled once. A polygon is
+// cut at the ordinates of its vertices into horizontal slabs, each listing
+// the edges crossing it, so that a point is located by a binary search for
+// its slab and a count of the few edges of the slab to its right (even-odd
+// rule).
+typedef struct Region {
+	enum RegionType { REGION_RECT, REGION_POLYGON } type;
+	// Bounding box, which is the region itself for `REGION_RECT`
+	double xl, xu, yl, yu;
+	// REGION_POLYGON
+	int nvertices;
+	double *vertices; // x and y of each vertex
+	int nslabs;
+	double *slab_y; // `nslabs` + 1 ordinates bounding the slabs
+	int *slab_off;	// `nslabs` + 1 offsets of the edges of the slabs
+	Edge *edges;
+} Region;
+
+void new_rect(Region *r, double xl, double xu, double yl, double yu);
+
+// Compile the polygon of the `n` vertices (`xy[2 * i]`, `xy[2 * i + 1]`) into
+// `r`. Returns `false` if failed.
+bool new_polygon(Region *r, const double *xy, int n);
+
+void free_region(Region *r);
+
+// Convert the `m` constraints `abc[3 * k]` x + `abc[3 * k + 1]` y <=
+// `abc[3 * k + 2]` into the vertices of the convex polygon they bound, stored
+// counterclockwise in `*xy`, which is to be freed, and counted in `*n`.
+// Returns `false` if failed, including when the polygon is empty, has no area,
+// or is unbounded.
+bool halfplanes_polygon(const double *abc, int m, double **xy, int *n);
+
+// Whether (`x`, `y`) is in `r`.
+bool region_contains(const Region *r, double x, double y);
+
+// Whether the box [`xl`, `xu`] x [`yl`, `yu`] is certainly inside `r`.
+bool region_covers(const Region *r, double xl, double xu, double yl,
+		   double yu);
+
+// Whether the box [`xl`, `xu`] x [`yl`, `yu`] may meet `r`. Returns `false`
+// only if they are certainly disjoint.
+bool region_meets(const Region *r, double xl, double xu, double yl,
+		  double yu);
+
+#endif /* ifndef REGION_H */
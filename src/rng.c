@@ -0,0 +1,22 @@
+#include "rng.h"
+#include <stdint.h>
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+// Seed `rng` with the `stream`-th stream of `seed`.
+// The state is expanded from a hash of both by SplitMix64, as recommended by
+// the authors of xoshiro.
+void seed_rng(Rng *rng, uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed;
+	x = splitmix64(&x) ^ stream;
+	for (int i = 0; i < 4; ++i) {
+		rng->s[i] = splitmix64(&x);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** by David Blackman and Sebastiano Vigna. Every trajectory draws
+// from a stream of its own, so the samples do not depend on how trajectories
+// are distributed over threads.
+typedef struct Rng {
+	uint64_t s[4];
+} Rng;
+
+// Seed `rng` with the `stream`-th stream of `seed`.
+void seed_rng(Rng *rng, uint64_t seed, uint64_t stream);
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t next_rng(Rng *rng)
+{
+	uint64_t *s = rng->s;
+	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+// Uniform double in [0, 1).
+static inline double unit_rng(Rng *rng)
+{
+	return (next_rng(rng) >> 11) * 0x1.0p-53;
+}
+
+#endif /* ifndef RNG_H */
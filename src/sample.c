@@ -0,0 +1,473 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sample.h"
+#include "compile.h"
+#include "eval.h"
+#include "check.h"
+#include "hist.h"
+#include "hull.h"
+#include "output.h"
+#include "profile.h"
+#include "record.h"
+#include "stats.h"
+#include "store.h"
+#include "trace.h"
+#include <pthread.h>
+#include <limits.h>
+#include <math.h>
+#include <sched.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Number of trajectories in a batch
+#define BATCH_LEN 1024
+// Number of batches in a ring
+#define RING_LEN 8
+// Size of a cache line, to keep the indices of a ring from false sharing
+#define CACHE_LINE 64
+// Number of trajectories in the first round of adaptive sampling, per thread
+#define ROUND_MIN (4 * BATCH_LEN)
+
+// Final states of the trajectories `first`, ..., `first` + `len` - 1.
+// If `ret` is nonzero, trajectory `first` + `len` has failed with `ret`.
+// If recording, the choices of trajectory `first` + `i` are the bits up to
+// `ends[i]` of `rec` after those of the trajectory before.
+typedef struct Batch {
+	unsigned long first;
+	int len;
+	int ret;
+	double x[BATCH_LEN];
+	double y[BATCH_LEN];
+	Record rec;
+	size_t ends[BATCH_LEN];
+} Batch;
+
+// Single-producer single-consumer ring of batches. Only the producer stores
+// `tail` and only the consumer stores `head`, so neither needs a lock.
+typedef struct Ring {
+	alignas(CACHE_LINE) atomic_ulong head;
+	alignas(CACHE_LINE) atomic_ulong tail;
+	Batch slots[RING_LEN];
+} Ring;
+
+typedef struct Worker {
+	alignas(CACHE_LINE) pthread_t thread;
+	int id;
+	const Prog *prog;
+	const SampleOpts *opts;
+	atomic_bool *stop;
+	// Streaming: the ring to push batches into
+	Ring *ring;
+	// Aggregating: a batch to sample into, and the aggregates of the thread
+	Batch *batch;
+	Hist hist;
+	Stats stats;
+	Hull hull;
+	Check check;
+	// Profiling: the counts of the thread
+	Profile prof;
+	// Index of the first failed trajectory and its error, if any
+	unsigned long failed;
+	int ret;
+} Worker;
+
+// Forward declarations for static functions
+static void run_batch(Sampler *s, const SampleOpts *opts, unsigned long b,
+		      Batch *batch);
+static Batch *next_slot(Worker *wk, unsigned long tail);
+static void *work(void *arg);
+static void drain(Ring *rings, int nthreads, unsigned long nbatches,
+		  Writer *w, FILE *record, StoreWriter *store, int *ret);
+static unsigned long needed(const Moments *m, double z, double tol);
+static bool box_moved(const Moments *before, const Moments *after,
+		      double tol);
+
+// Sample the `b`-th batch of trajectories into `batch`.
+static void run_batch(Sampler *s, const SampleOpts *opts, unsigned long b,
+		      Batch *batch)
+{
+	batch->first = opts->first + b * BATCH_LEN;
+	batch->len = 0;
+	batch->ret = 0;
+	batch->rec.len = 0;
+	s->rec = opts->record ? &batch->rec : NULL;
+	const unsigned long last = opts->first + opts->n;
+	const unsigned long end =
+	    batch->first + BATCH_LEN < last ? batch->first + BATCH_LEN : last;
+	for (unsigned long i = batch->first; i < end; ++i) {
+		Env env = {.init = false, .x = 0., .y = 0.};
+		if (s->qmc) {
+			seed_qmc(&s->q, opts->seed, i);
+		} else {
+			seed_rng(&s->rng, opts->seed, i);
+		}
+		if (s->check) {
+			start_check(s->check, s->prog);
+		}
+		if (s->tracer) {
+			trace_event(s->tracer,
+				    &(Event){.type = EV_START, .u.traj = i});
+		}
+		batch->ret = eval(s, s->prog->entry, &env);
+		if (batch->ret == EVAL_DECIDED) {
+			batch->ret = 0;
+		}
+		if (batch->ret) {
+			break;
+		}
+		if (s->check) {
+			end_check(s->check, i);
+		}
+		if (s->rec && s->rec->err) {
+			batch->ret = 2;
+			break;
+		}
+		if (s->rec) {
+			batch->ends[batch->len] = s->rec->len;
+		}
+		batch->x[batch->len] = env.x;
+		batch->y[batch->len] = env.y;
+		++batch->len;
+	}
+}
+
+// Wait for the slot of the ring of `wk` at `tail` to be free. Returns `NULL`
+// if sampling has stopped meanwhile.
+static Batch *next_slot(Worker *wk, unsigned long tail)
+{
+	Ring *ring = wk->ring;
+	while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >=
+	       RING_LEN) {
+		if (atomic_load_explicit(wk->stop, memory_order_relaxed)) {
+			return NULL;
+		}
+		sched_yield();
+	}
+	return ring->slots + tail % RING_LEN;
+}
+
+// Batch `b` is sampled by thread `b % nthreads`, so that the consumer finds
+// the batches in order by visiting the rings round-robin.
+static void *work(void *arg)
+{
+	Worker *wk = arg;
+	const SampleOpts *opts = wk->opts;
+	const unsigned long nbatches = (opts->n + BATCH_LEN - 1) / BATCH_LEN;
+	Sampler s = {.prog = wk->prog,
+		     .iter_max = opts->iter_max,
+		     .verbose = opts->verbose,
+		     .qmc = opts->qmc,
+		     .check = opts->check ? &wk->check : NULL,
+		     .tracer = opts->trace ? opts->trace->tracers + wk->id
+					   : NULL,
+		     .prof = opts->profile ? &wk->prof : NULL};
+
+	unsigned long tail = 0;
+	for (unsigned long b = wk->id; b < nbatches; b += opts->nthreads) {
+		if (atomic_load_explicit(wk->stop, memory_order_relaxed)) {
+			break;
+		}
+		Batch *batch = wk->ring ? next_slot(wk, tail) : wk->batch;
+		if (!batch) {
+			break;
+		}
+		run_batch(&s, opts, b, batch);
+		if (wk->ring) {
+			atomic_store_explicit(&wk->ring->tail, ++tail,
+					      memory_order_release);
+		} else {
+			for (int i = 0; opts->hist && i < batch->len; ++i) {
+				hist_add(&wk->hist, batch->x[i],
+					 batch->y[i]);
+			}
+			for (int i = 0; opts->stats && i < batch->len; ++i) {
+				stats_add(&wk->stats, batch->x[i],
+					  batch->y[i]);
+			}
+			for (int i = 0; opts->hull && i < batch->len; ++i) {
+				hull_add(&wk->hull, batch->x[i], batch->y[i]);
+			}
+		}
+		if (batch->ret) {
+			wk->failed = batch->first + batch->len;
+			wk->ret = batch->ret;
+			break;
+		}
+	}
+	return NULL;
+}
+
+// Hand the batches in the rings to `w`, their choices to `record` if set, and
+// both to `store` if set, in order, until the first failed trajectory, whose
+// error is stored in `*ret`.
+static void drain(Ring *rings, int nthreads, unsigned long nbatches,
+		  Writer *w, FILE *record, StoreWriter *store, int *ret)
+{
+	for (unsigned long b = 0; b < nbatches; ++b) {
+		Ring *ring = rings + b % nthreads;
+		const unsigned long head =
+		    atomic_load_explicit(&ring->head, memory_order_relaxed);
+		while (atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+		       head) {
+			sched_yield();
+		}
+
+		const Batch *batch = ring->slots + head % RING_LEN;
+		for (int i = 0; i < batch->len; ++i) {
+			if (!write_point(w, batch->x[i], batch->y[i])) {
+				break;
+			}
+		}
+		for (int i = 0; record && i < batch->len; ++i) {
+			write_record(record, batch->first + i, &batch->rec,
+				     i ? batch->ends[i - 1] : 0,
+				     batch->ends[i]);
+		}
+		for (int i = 0; store && i < batch->len; ++i) {
+			const size_t bits =
+			    record ? batch->ends[i] - (i ? batch->ends[i - 1] : 0)
+				   : 0;
+			store_point(store, batch->first + i, batch->x[i],
+				    batch->y[i],
+				    record ? record_size(batch->first + i, bits)
+					   : 0);
+		}
+		*ret = batch->ret;
+		atomic_store_explicit(&ring->head, head + 1,
+				      memory_order_release);
+		if (*ret || w->err) {
+			return;
+		}
+	}
+}
+
+// Sample trajectories of `prog` on `opts->nthreads` threads.
+int sample(const Prog *prog, const SampleOpts *opts, Writer *w)
+{
+	const int nthreads = opts->nthreads;
+	const bool aggregate =
+	    opts->hist || opts->stats || opts->hull || opts->check;
+	Ring *rings = NULL;
+	Worker *workers = aligned_alloc(CACHE_LINE, nthreads * sizeof *workers);
+	if (!aggregate) {
+		rings = aligned_alloc(CACHE_LINE, nthreads * sizeof *rings);
+	}
+	if (!workers || (!aggregate && !rings)) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(rings);
+		free(workers);
+		return -1;
+	}
+
+	atomic_bool stop = false;
+	int ret = 0;
+	int started;
+	for (started = 0; started < nthreads; ++started) {
+		Worker *wk = workers + started;
+		*wk = (Worker){.id = started,
+			       .prog = prog,
+			       .opts = opts,
+			       .stop = &stop};
+		if (opts->profile && !new_profile(&wk->prof, prog)) {
+			ret = -1;
+			break;
+		}
+		if (aggregate) {
+			wk->batch = malloc(sizeof *wk->batch);
+			if (!wk->batch || (opts->hist &&
+					   !new_hist_like(&wk->hist, opts->hist))) {
+				free(wk->batch);
+				free_profile(&wk->prof);
+				ret = -1;
+				break;
+			}
+			wk->batch->rec = (Record){0};
+			if (opts->check && !new_check(&wk->check, prog)) {
+				free(wk->batch);
+				free_hist(&wk->hist);
+				free_profile(&wk->prof);
+				ret = -1;
+				break;
+			}
+			if (opts->stats) {
+				new_stats(&wk->stats);
+			}
+			if (opts->hull) {
+				new_hull(&wk->hull);
+			}
+		} else {
+			wk->ring = rings + started;
+			atomic_init(&wk->ring->head, 0);
+			atomic_init(&wk->ring->tail, 0);
+			for (int k = 0; k < RING_LEN; ++k) {
+				wk->ring->slots[k].rec = (Record){0};
+			}
+		}
+		if (pthread_create(&wk->thread, NULL, work, wk)) {
+			fputs("Failed to create a thread.\n", stderr);
+			free(wk->batch);
+			free_hist(&wk->hist);
+			free_stats(&wk->stats);
+			free_hull(&wk->hull);
+			free_check(&wk->check);
+			free_profile(&wk->prof);
+			ret = -1;
+			break;
+		}
+	}
+
+	if (!ret && !aggregate) {
+		drain(rings, nthreads, (opts->n + BATCH_LEN - 1) / BATCH_LEN,
+		      w, opts->record, opts->store, &ret);
+	}
+	if (ret || !aggregate) {
+		// Release the samplers waiting for a slot, if any.
+		atomic_store(&stop, true);
+	}
+	unsigned long failed = ULONG_MAX;
+	for (int i = 0; i < started; ++i) {
+		Worker *wk = workers + i;
+		pthread_join(wk->thread, NULL);
+		if (opts->profile) {
+			merge_profile(opts->profile, &wk->prof);
+			free_profile(&wk->prof);
+		}
+		if (!aggregate) {
+			for (int k = 0; k < RING_LEN; ++k) {
+				free_record(&wk->ring->slots[k].rec);
+			}
+			continue;
+		}
+		// Report the error of the first failed trajectory.
+		if (wk->ret && wk->failed < failed && ret != -1) {
+			failed = wk->failed;
+			ret = wk->ret;
+		}
+		if (opts->hist) {
+			merge_hist(opts->hist, &wk->hist);
+			free_hist(&wk->hist);
+		}
+		if (opts->stats) {
+			merge_stats(opts->stats, &wk->stats);
+			free_stats(&wk->stats);
+		}
+		if (opts->hull) {
+			merge_hull(opts->hull, &wk->hull);
+			free_hull(&wk->hull);
+		}
+		if (opts->check) {
+			merge_check(opts->check, &wk->check);
+			free_check(&wk->check);
+		}
+		free_record(&wk->batch->rec);
+		free(wk->batch);
+	}
+	free(rings);
+	free(workers);
+	return ret;
+}
+
+int replay(const Prog *prog, FILE *in, const unsigned long *index,
+	   bool verbose, Writer *w)
+{
+	if (!read_record_header(in)) {
+		fputs("Not a record file.\n", stderr);
+		return -2;
+	}
+	Record rec = {0};
+	Sampler s = {.prog = prog,
+		     .iter_max = 0,
+		     .verbose = verbose,
+		     .rec = &rec,
+		     .replay = true};
+	int ret = 0;
+	bool found = false;
+	unsigned long i;
+	while (!ret && read_record(in, &i, &rec)) {
+		if (index && i != *index) {
+			continue;
+		}
+		found = true;
+		if (verbose) {
+			fprintf(stderr, "Replay trajectory #%lu\n", i);
+		}
+		Env env = {.init = false, .x = 0., .y = 0.};
+		ret = eval(&s, prog->entry, &env);
+		if (!ret && (rec.err || rec.pos != rec.len)) {
+			fprintf(stderr,
+				"The record of trajectory #%lu does not match "
+				"the program.\n",
+				i);
+			ret = -2;
+		} else if (!ret && !write_point(w, env.x, env.y)) {
+			break;
+		}
+	}
+	if (!ret && rec.err) {
+		fputs("The record file is truncated.\n", stderr);
+		ret = -2;
+	} else if (!ret && index && !found) {
+		fprintf(stderr, "No record of trajectory #%lu.\n", *index);
+		ret = -2;
+	}
+	free_record(&rec);
+	return ret;
+}
+
+// Number of samples for the `z`-sigma confidence interval on the mean of `m`
+// to be narrower than 2 * `tol`.
+static unsigned long needed(const Moments *m, double z, double tol)
+{
+	const double n = pow(z * moments_stddev(m) / tol, 2.);
+	return n < (double)ULONG_MAX ? (unsigned long)ceil(n) : ULONG_MAX;
+}
+
+// Whether an extremum of a coordinate has moved by more than `tol`.
+static bool box_moved(const Moments *before, const Moments *after,
+		      double tol)
+{
+	return before->min - after->min > tol ||
+	       after->max - before->max > tol;
+}
+
+int sample_adaptive(const Prog *prog, const SampleOpts *opts, double tol,
+		    double conf, unsigned long *n, bool *converged)
+{
+	const double z = normal_quantile(.5 + conf / 2.);
+	const unsigned long round_min = (unsigned long)opts->nthreads * ROUND_MIN;
+	SampleOpts round = *opts;
+	*n = 0;
+	*converged = false;
+	while (*n < opts->n) {
+		unsigned long len = round_min;
+		if (*n) {
+			unsigned long want = needed(&opts->stats->x, z, tol);
+			const unsigned long want_y =
+			    needed(&opts->stats->y, z, tol);
+			want = want_y > want ? want_y : want;
+			len = want > *n ? want - *n : 0;
+			len = len < round_min ? round_min : len;
+			len = len > *n ? *n : len;
+		}
+		round.n = len < opts->n - *n ? len : opts->n - *n;
+
+		const Moments before_x = opts->stats->x;
+		const Moments before_y = opts->stats->y;
+		const int ret = sample(prog, &round, NULL);
+		*n += round.n;
+		round.first += round.n;
+		if (ret) {
+			return ret;
+		}
+		if (!box_moved(&before_x, &opts->stats->x, tol) &&
+		    !box_moved(&before_y, &opts->stats->y, tol) &&
+		    needed(&opts->stats->x, z, tol) <= *n &&
+		    needed(&opts->stats->y, z, tol) <= *n) {
+			*converged = true;
+			break;
+		}
+	}
+	return 0;
+}
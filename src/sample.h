@@ -0,0 +1,89 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct Prog;
+struct Writer;
+struct Hist;
+struct Stats;
+struct Hull;
+struct Check;
+struct Trace;
+struct Profile;
+struct StoreWriter;
+
+typedef struct SampleOpts {
+	unsigned long first; // Index of the first trajectory
+	unsigned long n;     // Number of trajectories
+	uint64_t seed;
+	int iter_max;
+	bool verbose;
+	// Draw from scrambled Sobol points rather than pseudo-random numbers.
+	bool qmc;
+	int nthreads; // Number of sampling threads
+	// If set, the final states are binned into `hist` instead of written.
+	struct Hist *hist;
+	// If set, the final states are summarized into `stats` instead of
+	// written.
+	struct Stats *stats;
+	// If set, the final states are added to the convex hull `hull` instead
+	// of written.
+	struct Hull *hull;
+	// If set, the queries of the program are checked into `check`, and each
+	// trajectory stops as soon as its queries are decided.
+	struct Check *check;
+	// If set, the choices of the trajectories are recorded and written to
+	// `record` in the order of trajectories. Not for aggregates.
+	FILE *record;
+	// If set, the final states are also added to `store`, with the
+	// offsets of their records if recording. Not for aggregates.
+	struct StoreWriter *store;
+	// If set, the steps of the trajectories are traced into `trace`, which
+	// has a tracer for each thread.
+	struct Trace *trace;
+	// If set, each thread profiles the `Insn`s it runs, and the profiles
+	// are added to `profile`.
+	struct Profile *profile;
+} SampleOpts;
+
+// Sample trajectories `opts->first`, ..., `opts->first` + `opts->n` - 1 of
+// `prog` on `opts->nthreads` threads, and write their final states to `w` in
+// the order of trajectories.
+// Each thread pushes batches of final states into a lock-free
+// single-producer single-consumer ring of its own, which the calling thread
+// drains in order and hands to `w`. A thread waits while its ring is full, so
+// that a slow writer holds back the samplers rather than buffering without a
+// bound.
+// Returns 0 if successful, or the error `eval` returns for the first failed
+// trajectory; -1 if failed to start threads. The states of the trajectories
+// before the failed one are written.
+// If `opts->hist`, `opts->stats`, or `opts->hull` is set, each thread bins,
+// summarizes, or hulls the final states into a histogram, statistics, or a
+// hull of its own instead, and these are merged into `opts->hist`,
+// `opts->stats`, and `opts->hull` at the end; `w` is not used.
+// `opts->check` is likewise checked per thread and merged.
+int sample(const struct Prog *prog, const SampleOpts *opts,
+	   struct Writer *w);
+
+// Sample trajectories of `prog` in rounds into `opts->stats`, which must be
+// set, until the `conf` confidence intervals on the means of both coordinates
+// are narrower than 2 * `tol` and a round has moved no bound of the bounding
+// box by more than `tol`, or `opts->n` trajectories have been sampled.
+// Each round is sized by the number of trajectories the intervals so far
+// call for, at most doubling the total. Stores the number of trajectories
+// sampled in `*n` and whether the estimates converged in `*converged`.
+// Returns as `sample` does.
+int sample_adaptive(const struct Prog *prog, const SampleOpts *opts,
+		    double tol, double conf, unsigned long *n, bool *converged);
+
+// Replay the trajectories of `prog` recorded in `in`, or only the trajectory
+// `*index` if `index` is set, and write their final states to `w`.
+// Returns as `eval` does, or -2 if the records do not match `prog` or cannot
+// be read, which has been reported.
+int replay(const struct Prog *prog, FILE *in, const unsigned long *index,
+	   bool verbose, struct Writer *w);
+
+#endif /* ifndef SAMPLE_H */
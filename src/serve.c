@@ -0,0 +1,611 @@
+#define _POSIX_C_SOURCE 200809L
+#include "serve.h"
+#include "gisa.h"
+#include "job.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Maximum length of a request, so that a bad length cannot exhaust memory
+#define REQUEST_MAX (64 << 20)
+// Maximum number of samples of a request, whose states are all buffered
+#define SAMPLES_MAX 10000000
+// Maximum number of compiled programs cached
+#define CACHE_CAP 256
+// Number of buckets of the cache
+#define CACHE_BUCKETS 1024
+// Maximum number of connections open at once. Those beyond are closed as
+// accepted, so that the descriptors of all fit in an `fd_set`.
+#define CONN_MAX 256
+// Seconds a request may take to arrive once begun, and its response to be
+// taken, after which the connection is closed, so that a slow client cannot
+// hold a thread
+#define IO_TIMEOUT 30
+
+// A compiled program in the cache. Each request using it holds a reference,
+// and so does the cache while the entry is in it.
+typedef struct Entry {
+	uint64_t hash;
+	char *text; // Source
+	size_t len;
+	Gisa g;
+	int refs;
+	unsigned long used; // Tick of the last use
+	struct Entry *next; // In the bucket
+} Entry;
+
+// Compiled programs by the FNV-1a hash of their source. Parsing and compiling
+// happen outside the lock, so that a slow program holds up no other request.
+typedef struct Cache {
+	pthread_mutex_t lock;
+	Entry *buckets[CACHE_BUCKETS];
+	int len;
+	unsigned long tick;
+} Cache;
+
+// A request, pointing into its frame
+typedef struct Request {
+	Job job;
+	const char *text;
+	size_t len;
+} Request;
+
+// Connections with a request waiting for a thread of the pool, and the one
+// each thread is serving, -1 if none. A thread serves one request, and hands
+// its connection back through `wake` to wait for the next, so that an open
+// connection holds no thread between requests. Each connection is counted in
+// `conns` until closed, and is either waiting for a request, in `queue`, or
+// served, so that `queue` cannot fill up.
+typedef struct Pool {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int queue[CONN_MAX];
+	unsigned long head, tail;
+	int *active;
+	int conns;
+	int wake[2]; // Pipe of the connections handed back
+	bool stop;
+	const ServeOpts *o;
+	Cache cache;
+} Pool;
+
+// A thread of the pool
+typedef struct Worker {
+	Pool *pool;
+	int id;
+} Worker;
+
+static volatile sig_atomic_t stopping;
+
+// Forward declarations for static functions
+static void on_stop(int sig);
+static void unref(Cache *c, Entry *e);
+static Entry *lookup(Cache *c, const char *name, const char *text,
+		     size_t len);
+static void clear_cache(Cache *c);
+static struct timespec io_deadline(void);
+static bool await_fd(int fd, short events, const struct timespec *deadline);
+static bool read_full(int fd, void *buf, size_t len,
+		      const struct timespec *deadline);
+static bool write_full(int fd, const void *buf, size_t len,
+		       const struct timespec *deadline);
+static const char *parse_request(char *frame, size_t len, Request *req);
+static bool respond(Pool *pool, char *frame, size_t len, int fd);
+static bool serve_request(Pool *pool, int fd);
+static void *work(void *arg);
+
+static void on_stop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+// Drop a reference to `e`, which is freed with the last one.
+static void unref(Cache *c, Entry *e)
+{
+	pthread_mutex_lock(&c->lock);
+	const bool last = !--e->refs;
+	pthread_mutex_unlock(&c->lock);
+	if (last) {
+		free_gisa(&e->g);
+		free(e->text);
+		free(e);
+	}
+}
+
+// Find the program of the `len` bytes of `text` in `c`, or parse, compile,
+// and add it, evicting the least recently used program if `c` is full.
+// Returns the entry with a reference held, or `NULL` if failed, which has
+// been reported.
+static Entry *lookup(Cache *c, const char *name, const char *text,
+		     size_t len)
+{
+	const uint64_t hash = fnv1a(text, len);
+	Entry **bucket = c->buckets + hash % CACHE_BUCKETS;
+	pthread_mutex_lock(&c->lock);
+	for (Entry *e = *bucket; e; e = e->next) {
+		if (e->hash == hash && e->len == len &&
+		    !memcmp(e->text, text, len)) {
+			++e->refs;
+			e->used = ++c->tick;
+			pthread_mutex_unlock(&c->lock);
+			return e;
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	Entry *e = malloc(sizeof *e);
+	char *copy = malloc(len ? len : 1);
+	if (!e || !copy) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(e);
+		free(copy);
+		return NULL;
+	}
+	memcpy(copy, text, len);
+	*e = (Entry){.hash = hash, .text = copy, .len = len, .refs = 2};
+	new_gisa(&e->g, name);
+	if (!parse_text(&e->g, text, len) || !compile_gisa(&e->g)) {
+		e->refs = 1;
+		unref(c, e);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	// Another thread may have added the program meanwhile.
+	for (Entry *f = *bucket; f; f = f->next) {
+		if (f->hash == hash && f->len == len &&
+		    !memcmp(f->text, text, len)) {
+			++f->refs;
+			f->used = ++c->tick;
+			pthread_mutex_unlock(&c->lock);
+			e->refs = 1;
+			unref(c, e);
+			return f;
+		}
+	}
+	e->used = ++c->tick;
+	e->next = *bucket;
+	*bucket = e;
+	Entry **victim = NULL;
+	if (++c->len > CACHE_CAP) {
+		for (int i = 0; i < CACHE_BUCKETS; ++i) {
+			for (Entry **p = c->buckets + i; *p; p = &(*p)->next) {
+				if (!victim || (*p)->used < (*victim)->used) {
+					victim = p;
+				}
+			}
+		}
+	}
+	Entry *evicted = NULL;
+	if (victim) {
+		evicted = *victim;
+		*victim = evicted->next;
+		--c->len;
+	}
+	pthread_mutex_unlock(&c->lock);
+	if (evicted) {
+		unref(c, evicted);
+	}
+	return e;
+}
+
+static void clear_cache(Cache *c)
+{
+	for (int i = 0; i < CACHE_BUCKETS; ++i) {
+		while (c->buckets[i]) {
+			Entry *e = c->buckets[i];
+			c->buckets[i] = e->next;
+			unref(c, e);
+		}
+	}
+	c->len = 0;
+}
+
+// The time `IO_TIMEOUT` seconds from now, on the monotonic clock
+static struct timespec io_deadline(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	t.tv_sec += IO_TIMEOUT;
+	return t;
+}
+
+// Wait until `fd` is ready for `events`. Returns `false` if `deadline` has
+// passed first, or if failed.
+static bool await_fd(int fd, short events, const struct timespec *deadline)
+{
+	for (;;) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const long long ms =
+		    (deadline->tv_sec - now.tv_sec) * 1000LL +
+		    (deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if (ms <= 0) {
+			return false;
+		}
+		struct pollfd p = {.fd = fd, .events = events};
+		const int n = poll(&p, 1, (int)ms);
+		if (n > 0) {
+			return true;
+		}
+		if (n < 0 && errno != EINTR) {
+			return false;
+		}
+	}
+}
+
+// Read `len` bytes from `fd` by `deadline`. Returns `false` at the end of the
+// stream, if late, or if failed.
+static bool read_full(int fd, void *buf, size_t len,
+		      const struct timespec *deadline)
+{
+	for (size_t off = 0; off < len;) {
+		if (!await_fd(fd, POLLIN, deadline)) {
+			return false;
+		}
+		const ssize_t n = read(fd, (char *)buf + off, len - off);
+		if (n <= 0 && !(n < 0 && (errno == EINTR || errno == EAGAIN))) {
+			return false;
+		}
+		off += n > 0 ? (size_t)n : 0;
+	}
+	return true;
+}
+
+// Write `len` bytes to `fd` by `deadline`. Returns `false` if late or failed.
+static bool write_full(int fd, const void *buf, size_t len,
+		       const struct timespec *deadline)
+{
+	for (size_t off = 0; off < len;) {
+		if (!await_fd(fd, POLLOUT, deadline)) {
+			return false;
+		}
+		// Not to block past `deadline` once part is sent
+		const ssize_t n = send(fd, (const char *)buf + off, len - off,
+				       MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0 && errno != EINTR && errno != EAGAIN &&
+		    errno != EWOULDBLOCK) {
+			return false;
+		}
+		off += n > 0 ? (size_t)n : 0;
+	}
+	return true;
+}
+
+// Parse the header line of the request in `frame` of `len` bytes into `req`.
+// Returns `NULL` if successful, or what is wrong.
+static const char *parse_request(char *frame, size_t len, Request *req)
+{
+	char *eol = memchr(frame, '\n', len);
+	if (!eol) {
+		return "no header line";
+	}
+	*eol = '\0';
+	*req = (Request){.job = {.n = 1, .iter_max = 300, .fmt = FMT_TEXT},
+			 .text = eol + 1,
+			 .len = len - (eol + 1 - frame)};
+	char *save;
+	const char *mode = strtok_r(frame, " \t\r", &save);
+	if (!mode || !parse_job_mode(mode, &req->job.mode)) {
+		return "unknown mode";
+	}
+	for (char *tok; (tok = strtok_r(NULL, " \t\r", &save));) {
+		char *val = strchr(tok, '=');
+		if (!val) {
+			return "invalid option";
+		}
+		*val++ = '\0';
+		char *end;
+		errno = 0;
+		const unsigned long long v = strtoull(val, &end, 0);
+		const bool num = *val && *val != '-' && !*end && !errno;
+		if (!strcmp(tok, "format")) {
+			if (!parse_format(val, &req->job.fmt)) {
+				return "unknown format";
+			}
+		} else if (!strcmp(tok, "n") && num && v <= SAMPLES_MAX) {
+			req->job.n = v;
+		} else if (!strcmp(tok, "seed") && num) {
+			req->job.seed = v;
+		} else if (!strcmp(tok, "iter") && num && v <= 1000000) {
+			req->job.iter_max = (int)v;
+		} else {
+			return "invalid option";
+		}
+	}
+	return NULL;
+}
+
+// Serve the request in `frame` of `len` bytes, and write the response to
+// `fd`. Returns `false` if the connection has failed.
+static bool respond(Pool *pool, char *frame, size_t len, int fd)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *out = open_memstream(&buf, &size);
+	if (!out) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	fputs("ok\n", out);
+
+	Request req;
+	const char *err = parse_request(frame, len, &req);
+	Entry *e = NULL;
+	if (!err && !(e = lookup(&pool->cache, pool->o->name, req.text,
+				 req.len))) {
+		err = "cannot parse or compile the program";
+	}
+	if (!err) {
+		err = job_error(run_job(&req.job, &e->g.prog, out));
+		unref(&pool->cache, e);
+	}
+	if (err) {
+		rewind(out);
+		fprintf(out, "error: %s\n", err);
+	}
+	const long end = ftell(out);
+	bool ok = !fflush(out) && end >= 0;
+	if (ok) {
+		const uint32_t n = (uint32_t)end;
+		const unsigned char head[4] = {n >> 24, n >> 16, n >> 8, n};
+		const struct timespec deadline = io_deadline();
+		ok = write_full(fd, head, 4, &deadline) &&
+		     write_full(fd, buf, n, &deadline);
+	} else {
+		fputs("Failed to allocate memory.\n", stderr);
+	}
+	fclose(out);
+	free(buf);
+	return ok;
+}
+
+// Serve the next request on the connection `fd`, which has begun to arrive.
+// Returns `false` if the connection is closed or has failed.
+static bool serve_request(Pool *pool, int fd)
+{
+	const struct timespec deadline = io_deadline();
+	unsigned char head[4];
+	if (!read_full(fd, head, 4, &deadline)) {
+		return false;
+	}
+	const uint32_t len = (uint32_t)head[0] << 24 | (uint32_t)head[1] << 16 |
+			     (uint32_t)head[2] << 8 | head[3];
+	if (len > REQUEST_MAX) {
+		fprintf(stderr, "%s: request of %lu bytes refused\n",
+			pool->o->name, (unsigned long)len);
+		return false;
+	}
+	char *frame = malloc(len ? len : 1);
+	if (!frame) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	const bool ok = read_full(fd, frame, len, &deadline) &&
+			respond(pool, frame, len, fd);
+	free(frame);
+	return ok;
+}
+
+static void *work(void *arg)
+{
+	Worker *wk = arg;
+	Pool *pool = wk->pool;
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stop && pool->head == pool->tail) {
+			pthread_cond_wait(&pool->ready, &pool->lock);
+		}
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		const int fd = pool->queue[pool->head++ % CONN_MAX];
+		pool->active[wk->id] = fd;
+		pthread_mutex_unlock(&pool->lock);
+
+		const bool open = serve_request(pool, fd);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->active[wk->id] = -1;
+		pthread_mutex_unlock(&pool->lock);
+		// The pipe holds far more than `CONN_MAX` descriptors, so this
+		// never blocks.
+		if (!open ||
+		    write(pool->wake[1], &fd, sizeof fd) != sizeof fd) {
+			close(fd);
+			pthread_mutex_lock(&pool->lock);
+			--pool->conns;
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	return NULL;
+}
+
+bool serve(const ServeOpts *o)
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(o->path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "%s: socket path too long -- '%s'\n", o->name,
+			o->path);
+		return false;
+	}
+	strcpy(addr.sun_path, o->path);
+	const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof addr) ||
+	    listen(sock, CONN_MAX) ||
+	    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK)) {
+		fprintf(stderr, "%s: cannot listen on '%s': %s\n", o->name,
+			o->path, strerror(errno));
+		if (sock >= 0) {
+			close(sock);
+		}
+		return false;
+	}
+
+	Pool pool = {.lock = PTHREAD_MUTEX_INITIALIZER,
+		     .ready = PTHREAD_COND_INITIALIZER,
+		     .wake = {-1, -1},
+		     .o = o,
+		     .cache = {.lock = PTHREAD_MUTEX_INITIALIZER}};
+	Worker *workers = malloc(o->nthreads * sizeof *workers);
+	pthread_t *threads = malloc(o->nthreads * sizeof *threads);
+	pool.active = malloc(o->nthreads * sizeof *pool.active);
+	bool ok = workers && threads && pool.active;
+	if (!ok) {
+		fputs("Failed to allocate memory.\n", stderr);
+		goto cleanup;
+	}
+	if (pipe(pool.wake) || fcntl(pool.wake[0], F_SETFL, O_NONBLOCK)) {
+		fprintf(stderr, "%s: cannot create a pipe: %s\n", o->name,
+			strerror(errno));
+		ok = false;
+		goto cleanup;
+	}
+
+	// The signals are blocked but while this thread waits for connections,
+	// so that they wake it up rather than a thread of the pool, and cannot
+	// slip in between checking `stopping` and waiting.
+	struct sigaction sa = {.sa_handler = on_stop};
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigset_t set, old;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	int started = 0;
+	for (; started < o->nthreads; ++started) {
+		workers[started] = (Worker){&pool, started};
+		pool.active[started] = -1;
+		if (pthread_create(threads + started, NULL, work,
+				   workers + started)) {
+			fprintf(stderr, "%s: failed to start threads\n",
+				o->name);
+			ok = false;
+			break;
+		}
+	}
+	fprintf(stderr, "%s: listening on '%s' with %d threads\n", o->name,
+		o->path, started);
+
+	// Connections waiting for their next request
+	int idle[CONN_MAX];
+	int nidle = 0;
+	while (ok && !stopping) {
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(sock, &fds);
+		FD_SET(pool.wake[0], &fds);
+		int top = sock > pool.wake[0] ? sock : pool.wake[0];
+		for (int i = 0; i < nidle; ++i) {
+			FD_SET(idle[i], &fds);
+			top = idle[i] > top ? idle[i] : top;
+		}
+		if (pselect(top + 1, &fds, NULL, NULL, NULL, &old) < 0) {
+			if (errno != EINTR) {
+				fprintf(stderr, "%s: select failed: %s\n",
+					o->name, strerror(errno));
+				ok = false;
+			}
+			continue;
+		}
+
+		// A connection with a request, or closed, goes to the pool.
+		pthread_mutex_lock(&pool.lock);
+		for (int i = 0; i < nidle;) {
+			if (FD_ISSET(idle[i], &fds)) {
+				pool.queue[pool.tail++ % CONN_MAX] = idle[i];
+				pthread_cond_signal(&pool.ready);
+				idle[i] = idle[--nidle];
+			} else {
+				++i;
+			}
+		}
+		pthread_mutex_unlock(&pool.lock);
+		if (FD_ISSET(pool.wake[0], &fds)) {
+			for (int fd; read(pool.wake[0], &fd, sizeof fd) ==
+				     sizeof fd;) {
+				idle[nidle++] = fd;
+			}
+		}
+		if (!FD_ISSET(sock, &fds)) {
+			continue;
+		}
+
+		const int fd = accept(sock, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR && errno != EAGAIN &&
+			    errno != EWOULDBLOCK && errno != ECONNABORTED) {
+				fprintf(stderr, "%s: accept failed: %s\n",
+					o->name, strerror(errno));
+				ok = false;
+			}
+			continue;
+		}
+		pthread_mutex_lock(&pool.lock);
+		const bool room = pool.conns < CONN_MAX && fd < FD_SETSIZE;
+		pool.conns += room;
+		pthread_mutex_unlock(&pool.lock);
+		if (!room) {
+			close(fd);
+			continue;
+		}
+		idle[nidle++] = fd;
+	}
+
+	// Cut off the requests still arriving, so that no client holds up
+	// stopping, but answer those already read, and close all connections.
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = true;
+	for (int i = 0; i < started; ++i) {
+		if (pool.active[i] >= 0) {
+			shutdown(pool.active[i], SHUT_RD);
+		}
+	}
+	pthread_cond_broadcast(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 0; i < started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	for (; pool.head != pool.tail; ++pool.head) {
+		close(pool.queue[pool.head % CONN_MAX]);
+	}
+	for (int fd; read(pool.wake[0], &fd, sizeof fd) == sizeof fd;) {
+		idle[nidle++] = fd;
+	}
+	while (nidle) {
+		close(idle[--nidle]);
+	}
+	clear_cache(&pool.cache);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	fprintf(stderr, "%s: stopped\n", o->name);
+
+cleanup:
+	for (int i = 0; i < 2; ++i) {
+		if (pool.wake[i] >= 0) {
+			close(pool.wake[i]);
+		}
+	}
+	close(sock);
+	unlink(o->path);
+	free(workers);
+	free(threads);
+	free(pool.active);
+	return ok;
+}
@@ -0,0 +1,41 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+/* Server mode: requests to sample or analyze programs, served over a Unix
+ * domain socket by a pool of threads.
+ *
+ * A client sends requests over a connection, one after another, and reads a
+ * response to each. Every request and response is a frame: its length as a
+ * 32-bit big-endian number, followed by as many bytes. A request is a line
+ *
+ *   MODE [n=SAMPLES] [seed=SEED] [iter=ITERMAX] [format=FORMAT]
+ *
+ * where MODE is `sample`, `stats`, `check`, or `analyze`, followed by the
+ * source of the program. A response is a line `ok` followed by what
+ * `gisa` would print in that mode, or a line `error: MESSAGE`.
+ *
+ * Each request is served by whichever thread of the pool is free, and a
+ * connection holds none while it waits for its next request, so that clients
+ * keeping connections open cannot starve others. At most 256 connections are
+ * open at once; one beyond is closed as soon as accepted. A connection is
+ * closed if a request takes more than 30 seconds to arrive once begun, or its
+ * response more than 30 seconds to be read, however steadily it trickles.
+ *
+ * Compiled programs are cached by the hash of their source, so that a program
+ * sent again is neither parsed nor compiled again.
+ */
+
+#include <stdbool.h>
+
+// Options of the server
+typedef struct ServeOpts {
+	const char *path;  // Of the socket, which is created and removed
+	int nthreads;	   // Size of the pool
+	const char *name;  // Prefix of messages to `stderr`
+} ServeOpts;
+
+// Serve requests on the socket at `o->path` until SIGINT or SIGTERM. Returns
+// `true` if stopped so; `false` if failed, which has been reported.
+bool serve(const ServeOpts *o);
+
+#endif /* ifndef SERVE_H */
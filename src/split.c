@@ -0,0 +1,402 @@
+#include "split.h"
+#include "compile.h"
+#include "eval.h"
+#include "rng.h"
+#include <math.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of trajectories of the pilot run placing the levels
+#define PILOT_LEN 1024
+// Number of root trajectories summed up together, so that the sum does not
+// depend on the number of threads
+#define CHUNK_LEN 64
+// Stream of the seed the pilot run draws from
+#define PILOT_STREAM 0x9e3779b97f4a7c15
+
+// Continuation of a composite `Insn` of a trajectory in progress. `k` is -1
+// for an `Insn` just entered; after that, 0 for a `I_SEQUENCE` running `p1`
+// and the number of iterations left for a `I_ITER`.
+typedef struct Frame {
+	int pc;
+	int k;
+} Frame;
+
+// A trajectory in progress with its own stream and weight. `level` is the
+// number of levels it stands above.
+typedef struct Particle {
+	Env env;
+	Rng rng;
+	double w;
+	int level;
+	int depth;
+	Frame frames[];
+} Particle;
+
+// State of a thread running trajectories. Clones wait on `stack`.
+typedef struct Runner {
+	const Prog *prog;
+	const SplitOpts *opts;
+	Sampler s;
+	const double *levels; // Distances to the target of the levels
+	int nlevels;
+	size_t stride; // Size of a `Particle` with its frames
+	char *stack;
+	int len;
+	int cap;
+	Particle *cur;
+	unsigned long steps;
+	double closest; // Closest approach to the target
+} Runner;
+
+// Forward declarations for static functions
+static int max_depth(const Prog *prog, int pc);
+static double distance(const double *target, const Env *env);
+static int level_of(const Runner *r, double d);
+static bool new_runner(Runner *r, const Prog *prog, const SplitOpts *opts,
+		       const double *levels, int nlevels);
+static void free_runner(Runner *r);
+static bool push_clone(Runner *r, int c);
+static int step(Runner *r, Particle *p, bool *moved);
+static int run_root(Runner *r, uint64_t seed, unsigned long i, double *w);
+static int double_cmp(const void *a, const void *b);
+static int place_levels(const Prog *prog, const SplitOpts *opts,
+			double *levels, SplitResult *res);
+
+// Number of `Frame`s a trajectory of the `Insn` at `pc` needs at most. The
+// last part of a `I_SEQUENCE` and the branch of a `I_OR` take over the frame
+// of their parent.
+static int max_depth(const Prog *prog, int pc)
+{
+	const Insn *insn = prog->insns + pc;
+	switch (insn->type) {
+	case I_SEQUENCE: {
+		const int d1 = 1 + max_depth(prog, insn->u.branch.p1);
+		const int d2 = max_depth(prog, insn->u.branch.p2);
+		return d1 > d2 ? d1 : d2;
+	}
+	case I_OR: {
+		const int d1 = max_depth(prog, insn->u.branch.p1);
+		const int d2 = max_depth(prog, insn->u.branch.p2);
+		return d1 > d2 ? d1 : d2;
+	}
+	case I_ITER:
+		return 1 + max_depth(prog, insn->u.iter_body);
+	default:
+		return 1;
+	}
+}
+
+static double distance(const double *target, const Env *env)
+{
+	if (!env->init) {
+		return INFINITY;
+	}
+	const double dx = env->x < target[0]   ? target[0] - env->x
+			  : env->x > target[1] ? env->x - target[1]
+					       : 0.;
+	const double dy = env->y < target[2]   ? target[2] - env->y
+			  : env->y > target[3] ? env->y - target[3]
+					       : 0.;
+	return hypot(dx, dy);
+}
+
+// Number of levels at distance `d` or closer.
+static int level_of(const Runner *r, double d)
+{
+	int l = 0;
+	while (l < r->nlevels && d <= r->levels[l]) {
+		++l;
+	}
+	return l;
+}
+
+static bool new_runner(Runner *r, const Prog *prog, const SplitOpts *opts,
+		       const double *levels, int nlevels)
+{
+	*r = (Runner){.prog = prog,
+		      .opts = opts,
+		      .s = {.prog = prog, .iter_max = opts->iter_max},
+		      .levels = levels,
+		      .nlevels = nlevels};
+	const size_t align = alignof(Particle);
+	r->stride = sizeof(Particle) +
+		    max_depth(prog, prog->entry) * sizeof(Frame);
+	r->stride = (r->stride + align - 1) / align * align;
+	r->cap = 16;
+	r->stack = malloc(r->cap * r->stride);
+	r->cur = malloc(r->stride);
+	if (!r->stack || !r->cur) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free_runner(r);
+		return false;
+	}
+	return true;
+}
+
+static void free_runner(Runner *r)
+{
+	free(r->stack);
+	free(r->cur);
+}
+
+// Push a copy of the current trajectory with a fresh stream `c` derived from
+// its own.
+static bool push_clone(Runner *r, int c)
+{
+	if (r->len == r->cap) {
+		char *stack = realloc(r->stack, 2 * r->cap * r->stride);
+		if (!stack) {
+			fputs("Failed to allocate memory.\n", stderr);
+			return false;
+		}
+		r->stack = stack;
+		r->cap *= 2;
+	}
+	Particle *clone = (Particle *)(r->stack + r->len++ * r->stride);
+	memcpy(clone, r->cur,
+	       sizeof *clone + r->cur->depth * sizeof *clone->frames);
+	seed_rng(&clone->rng, next_rng(&r->cur->rng), c);
+	return true;
+}
+
+// Advance `p` by a step. Leaves are evaluated by `eval`, which sets `*moved`;
+// composites push or replace frames, drawing in the same order as `eval`.
+// Returns 0 if successful; 1 if uninitialized.
+static int step(Runner *r, Particle *p, bool *moved)
+{
+	const Prog *prog = r->prog;
+	Frame *f = p->frames + p->depth - 1;
+	const Insn *insn = prog->insns + f->pc;
+	*moved = false;
+	switch (insn->type) {
+	case I_INIT:
+	case I_TRANSLATION:
+	case I_ROTATION: {
+		r->s.rng = p->rng;
+		const int ret = eval(&r->s, f->pc, &p->env);
+		p->rng = r->s.rng;
+		--p->depth;
+		*moved = true;
+		++r->steps;
+		return ret;
+	}
+	case I_SEQUENCE:
+		if (f->k < 0) {
+			f->k = 0;
+			p->frames[p->depth++] = (Frame){insn->u.branch.p1, -1};
+		} else {
+			*f = (Frame){insn->u.branch.p2, -1};
+		}
+		return 0;
+	case I_OR:
+		if (!p->env.init) {
+			return 1;
+		}
+		*f = (Frame){unit_rng(&p->rng) * 2 < 1. ? insn->u.branch.p1
+							: insn->u.branch.p2,
+			     -1};
+		return 0;
+	case I_ASSERT:
+	case I_REACH:
+		// Queries are not checked while splitting.
+		if (!p->env.init) {
+			return 1;
+		}
+		--p->depth;
+		return 0;
+	case I_ITER:
+		if (f->k < 0) {
+			if (!p->env.init) {
+				return 1;
+			}
+			f->k = (int)(unit_rng(&p->rng) * (r->s.iter_max + 1));
+		}
+		if (!f->k) {
+			--p->depth;
+		} else {
+			--f->k;
+			p->frames[p->depth++] = (Frame){insn->u.iter_body, -1};
+		}
+		return 0;
+	}
+	return 0;
+}
+
+// Run the root trajectory `i` of `seed` and all its clones, and add up the
+// weights of those ending in the target into `*w`.
+// Returns 0 if successful; 1 if uninitialized, 2 if out of memory.
+static int run_root(Runner *r, uint64_t seed, unsigned long i, double *w)
+{
+	const double *target = r->opts->target;
+	Particle *p = r->cur;
+	*w = 0.;
+	*p = (Particle){.env = {.init = false, .x = 0., .y = 0.},
+			.w = 1.,
+			.level = 0,
+			.depth = 1};
+	p->frames[0] = (Frame){r->prog->entry, -1};
+	seed_rng(&p->rng, seed, i);
+	r->len = 0;
+	for (;;) {
+		bool alive = true;
+		while (alive && p->depth) {
+			bool moved;
+			const int ret = step(r, p, &moved);
+			if (ret) {
+				return ret;
+			}
+			if (!moved) {
+				continue;
+			}
+			const double d = distance(target, &p->env);
+			r->closest = d < r->closest ? d : r->closest;
+			const int level = level_of(r, d);
+			while (p->level < level) {
+				++p->level;
+				p->w /= 2.;
+				if (!push_clone(r, p->level)) {
+					return 2;
+				}
+			}
+			while (alive && p->level > level) {
+				--p->level;
+				p->w *= 2.;
+				alive = unit_rng(&p->rng) < .5;
+			}
+		}
+		if (alive && !distance(target, &p->env)) {
+			*w += p->w;
+		}
+		if (!r->len) {
+			return 0;
+		}
+		--r->len;
+		memcpy(p, r->stack + r->len * r->stride, r->stride);
+	}
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Place `opts->nlevels` levels evenly from the median closest approach of a
+// pilot run, stored in `res->scale`, down to the target. The steps of the
+// pilot run are counted in `res->steps`.
+// Returns 0 if successful; 1 if uninitialized, 2 if out of memory.
+static int place_levels(const Prog *prog, const SplitOpts *opts,
+			double *levels, SplitResult *res)
+{
+	Runner r;
+	if (!new_runner(&r, prog, opts, NULL, 0)) {
+		return 2;
+	}
+	double closest[PILOT_LEN];
+	int ret = 0;
+	for (int i = 0; i < PILOT_LEN; ++i) {
+		double w;
+		r.closest = INFINITY;
+		ret = run_root(&r, opts->seed ^ PILOT_STREAM, i, &w);
+		if (ret) {
+			goto place_levels_cleanup;
+		}
+		closest[i] = r.closest;
+	}
+	qsort(closest, PILOT_LEN, sizeof *closest, double_cmp);
+	res->scale = closest[PILOT_LEN / 2];
+	if (!isfinite(res->scale)) {
+		res->scale = 0.;
+	}
+	for (int l = 0; l < opts->nlevels; ++l) {
+		levels[l] = res->scale * (opts->nlevels - 1 - l) / opts->nlevels;
+	}
+
+place_levels_cleanup:
+	res->steps = r.steps;
+	free_runner(&r);
+	return ret;
+}
+
+int split(const Prog *prog, const SplitOpts *opts, SplitResult *res)
+{
+	*res = (SplitResult){0};
+	double *levels = malloc((opts->nlevels + 1) * sizeof *levels);
+	const unsigned long nchunks = (opts->n + CHUNK_LEN - 1) / CHUNK_LEN;
+	// Sums of the weights and of their squares, and the error of each chunk
+	double *sums = calloc(2 * nchunks + 1, sizeof *sums);
+	int *rets = calloc(nchunks + 1, sizeof *rets);
+	if (!levels || !sums || !rets) {
+		fputs("Failed to allocate memory.\n", stderr);
+		free(levels);
+		free(sums);
+		free(rets);
+		return 2;
+	}
+
+	int ret = place_levels(prog, opts, levels, res);
+	// Without a pilot trajectory away from the target, splitting is moot.
+	const int nlevels = res->scale > 0. ? opts->nlevels : 0;
+	unsigned long steps = 0;
+	if (ret) {
+		goto split_cleanup;
+	}
+
+#pragma omp parallel num_threads(opts->nthreads) reduction(+ : steps)
+	{
+		Runner r;
+		const bool ok = new_runner(&r, prog, opts, levels, nlevels);
+#pragma omp for schedule(dynamic, 1)
+		for (unsigned long c = 0; c < nchunks; ++c) {
+			if (!ok) {
+				rets[c] = 2;
+				continue;
+			}
+			const unsigned long end = (c + 1) * CHUNK_LEN < opts->n
+						      ? (c + 1) * CHUNK_LEN
+						      : opts->n;
+			for (unsigned long i = c * CHUNK_LEN; i < end; ++i) {
+				double w;
+				rets[c] = run_root(&r, opts->seed, i, &w);
+				if (rets[c]) {
+					break;
+				}
+				sums[2 * c] += w;
+				sums[2 * c + 1] += w * w;
+			}
+		}
+		if (ok) {
+			steps += r.steps;
+			free_runner(&r);
+		}
+	}
+
+	double sum = 0.;
+	double sum2 = 0.;
+	for (unsigned long c = 0; c < nchunks && !ret; ++c) {
+		ret = rets[c];
+		sum += sums[2 * c];
+		sum2 += sums[2 * c + 1];
+	}
+	if (!ret && opts->n) {
+		const double n = opts->n;
+		res->p = sum / n;
+		const double var =
+		    n > 1. ? (sum2 - n * res->p * res->p) / (n - 1.) : 0.;
+		res->halfwidth = 1.96 * sqrt(fmax(var, 0.) / n);
+	}
+	res->steps += steps;
+
+split_cleanup:
+	free(levels);
+	free(sums);
+	free(rets);
+	return ret;
+}
@@ -0,0 +1,36 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <stdint.h>
+
+struct Prog;
+
+typedef struct SplitOpts {
+	unsigned long n; // Number of root trajectories
+	uint64_t seed;
+	int iter_max;
+	int nthreads;
+	double target[4]; // x-min, x-max, y-min, and y-max of the target
+	int nlevels;      // Number of importance levels
+} SplitOpts;
+
+typedef struct SplitResult {
+	double p;         // Estimated probability to end in the target
+	double halfwidth; // Half width of the 95% confidence interval on `p`
+	unsigned long steps; // Number of `init`, `translation`, and `rotation`
+			     // evaluated
+	double scale; // Distance to the target at which the first level lies
+} SplitResult;
+
+// Estimate the probability that a trajectory of `prog` ends in the target
+// rectangle by multilevel splitting. The importance of a state is its
+// distance to the target, and the levels split the median closest approach
+// of a pilot run evenly down to the target. A trajectory is cloned into two
+// of half the weight whenever it crosses a level towards the target, even in
+// the middle of an `iter`, and is killed with probability 1/2, or else
+// doubled in weight, whenever it falls back below a level. Both keep the
+// estimate unbiased while spending the evaluations near the target.
+// Returns 0 if successful; 1 if uninitialized, 2 if out of memory.
+int split(const struct Prog *prog, const SplitOpts *opts, SplitResult *res);
+
+#endif /* ifndef SPLIT_H */
@@ -0,0 +1,275 @@
+#include "stats.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Capacity of level `h` shrinks by `KLL_C` per level below the top.
+#define KLL_C (2. / 3.)
+// Length of the buffer of a level. A sketch holds fewer items than its total
+// capacity, which is less than 3 * `KLL_K` + 2 * `KLL_LEVELS`, except while
+// merging two sketches.
+#define KLL_LEN (8 * KLL_K)
+
+// An item of a sketch with its weight, for answering queries.
+typedef struct Weighted {
+	double v;
+	uint64_t w;
+} Weighted;
+
+// Forward declarations for static functions
+static void new_moments(Moments *m);
+static void merge_moments(Moments *dest, const Moments *src);
+static void new_sketch(Sketch *sk);
+static void free_sketch(Sketch *sk);
+static int capacity(const Sketch *sk, int h);
+static bool add_level(Sketch *sk);
+static void compact(Sketch *sk, int h);
+static void compress(Sketch *sk);
+static void merge_sketch(Sketch *dest, const Sketch *src);
+static int double_cmp(const void *a, const void *b);
+static int weighted_cmp(const void *a, const void *b);
+
+static void new_moments(Moments *m)
+{
+	*m = (Moments){0, 0., 0., INFINITY, -INFINITY};
+}
+
+// Chan et al.'s pairwise update of Welford's moments.
+static void merge_moments(Moments *dest, const Moments *src)
+{
+	if (!src->n) {
+		return;
+	}
+	const unsigned long n = dest->n + src->n;
+	const double delta = src->mean - dest->mean;
+	dest->mean += delta * src->n / n;
+	dest->m2 += src->m2 + delta * delta * dest->n / n * src->n;
+	dest->n = n;
+	dest->min = src->min < dest->min ? src->min : dest->min;
+	dest->max = src->max > dest->max ? src->max : dest->max;
+}
+
+double moments_stddev(const Moments *m)
+{
+	return m->n > 1 ? sqrt(m->m2 / (m->n - 1)) : 0.;
+}
+
+// Bisect the cumulative distribution function to within rounding.
+double normal_quantile(double p)
+{
+	double lo = -40.;
+	double hi = 40.;
+	for (int i = 0; i < 100; ++i) {
+		const double mid = (lo + hi) / 2.;
+		if (.5 * erfc(-mid / sqrt(2.)) < p) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo + hi) / 2.;
+}
+
+static void new_sketch(Sketch *sk)
+{
+	memset(sk, 0, sizeof *sk);
+	sk->coin = 0x9e3779b97f4a7c15;
+	add_level(sk);
+}
+
+static void free_sketch(Sketch *sk)
+{
+	for (int h = 0; h < sk->nlevels; ++h) {
+		free(sk->levels[h]);
+	}
+	sk->nlevels = 0;
+}
+
+void new_stats(Stats *st)
+{
+	new_moments(&st->x);
+	new_moments(&st->y);
+	new_sketch(&st->qx);
+	new_sketch(&st->qy);
+}
+
+void free_stats(Stats *st)
+{
+	free_sketch(&st->qx);
+	free_sketch(&st->qy);
+}
+
+static int capacity(const Sketch *sk, int h)
+{
+	const int cap = (int)(KLL_K * pow(KLL_C, sk->nlevels - 1 - h));
+	return cap < 2 ? 2 : cap;
+}
+
+static bool add_level(Sketch *sk)
+{
+	if (sk->nlevels == KLL_LEVELS) {
+		sk->err = true;
+		return false;
+	}
+	double *items = malloc(KLL_LEN * sizeof *items);
+	if (!items) {
+		sk->err = true;
+		return false;
+	}
+	sk->levels[sk->nlevels] = items;
+	sk->lens[sk->nlevels++] = 0;
+	sk->cap = 0;
+	for (int h = 0; h < sk->nlevels; ++h) {
+		sk->cap += capacity(sk, h);
+	}
+	return true;
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Promote every other item of level `h` to level `h` + 1, starting from the
+// first or the second item at random. An odd item out stays.
+static void compact(Sketch *sk, int h)
+{
+	if (h + 1 == sk->nlevels && !add_level(sk)) {
+		return;
+	}
+	double *items = sk->levels[h];
+	const int len = sk->lens[h];
+	qsort(items, len, sizeof *items, double_cmp);
+
+	// xorshift64
+	sk->coin ^= sk->coin << 13;
+	sk->coin ^= sk->coin >> 7;
+	sk->coin ^= sk->coin << 17;
+	const int offset = sk->coin & 1;
+
+	double *up = sk->levels[h + 1];
+	int *up_len = sk->lens + h + 1;
+	const int even = len & ~1;
+	for (int i = offset; i < even; i += 2) {
+		up[(*up_len)++] = items[i];
+	}
+	if (len & 1) {
+		items[0] = items[len - 1];
+	}
+	sk->lens[h] = len & 1;
+	sk->len -= even / 2;
+}
+
+// Compact the lowest level over its capacity until `sk` holds fewer items
+// than its total capacity. Compacting lazily lets the lower levels grow past
+// their small capacities meanwhile, so that the sorts are few and long.
+static void compress(Sketch *sk)
+{
+	while (!sk->err && sk->len >= sk->cap) {
+		int h = 0;
+		while (h < sk->nlevels - 1 && sk->lens[h] < capacity(sk, h)) {
+			++h;
+		}
+		compact(sk, h);
+	}
+}
+
+void sketch_add(Sketch *sk, double v)
+{
+	if (sk->err) {
+		return;
+	}
+	sk->levels[0][sk->lens[0]++] = v;
+	if (++sk->len >= sk->cap) {
+		compress(sk);
+	}
+}
+
+static void merge_sketch(Sketch *dest, const Sketch *src)
+{
+	if (src->err) {
+		dest->err = true;
+	}
+	while (!dest->err && dest->nlevels < src->nlevels) {
+		add_level(dest);
+	}
+	if (dest->err) {
+		return;
+	}
+	for (int h = 0; h < src->nlevels; ++h) {
+		memcpy(dest->levels[h] + dest->lens[h], src->levels[h],
+		       src->lens[h] * sizeof *src->levels[h]);
+		dest->lens[h] += src->lens[h];
+	}
+	dest->len += src->len;
+	compress(dest);
+}
+
+void merge_stats(Stats *dest, const Stats *src)
+{
+	merge_moments(&dest->x, &src->x);
+	merge_moments(&dest->y, &src->y);
+	merge_sketch(&dest->qx, &src->qx);
+	merge_sketch(&dest->qy, &src->qy);
+}
+
+static int weighted_cmp(const void *a, const void *b)
+{
+	return double_cmp(&((const Weighted *)a)->v, &((const Weighted *)b)->v);
+}
+
+double sketch_quantile(const Sketch *sk, double q)
+{
+	if (sk->err || !sk->len) {
+		return NAN;
+	}
+	Weighted *items = malloc(sk->len * sizeof *items);
+	if (!items) {
+		return NAN;
+	}
+	uint64_t total = 0;
+	int k = 0;
+	for (int h = 0; h < sk->nlevels; ++h) {
+		for (int i = 0; i < sk->lens[h]; ++i) {
+			items[k++] = (Weighted){sk->levels[h][i], 1ull << h};
+		}
+		total += (uint64_t)sk->lens[h] << h;
+	}
+	qsort(items, k, sizeof *items, weighted_cmp);
+
+	const double rank = q * total;
+	uint64_t acc = 0;
+	double v = items[k - 1].v;
+	for (int i = 0; i < k; ++i) {
+		acc += items[i].w;
+		if (acc >= rank) {
+			v = items[i].v;
+			break;
+		}
+	}
+	free(items);
+	return v;
+}
+
+bool p_stats(FILE *stream, const Stats *st)
+{
+	fprintf(stream, "%-4s %12s %12s %12s %12s %12s %12s %12s %12s\n", "",
+		"n", "min", "max", "mean", "stddev", "p1", "p50", "p99");
+	const Moments *ms[] = {&st->x, &st->y};
+	const Sketch *sks[] = {&st->qx, &st->qy};
+	const char *names[] = {"x", "y"};
+	for (int i = 0; i < 2; ++i) {
+		const Moments *m = ms[i];
+		fprintf(stream, "%-4s %12lu %12g %12g %12g %12g %12g %12g %12g\n",
+			names[i], m->n, m->min, m->max, m->mean,
+			moments_stddev(m), sketch_quantile(sks[i], .01),
+			sketch_quantile(sks[i], .5),
+			sketch_quantile(sks[i], .99));
+	}
+	return !st->qx.err && !st->qy.err;
+}
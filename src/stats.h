@@ -0,0 +1,85 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Accuracy parameter of `Sketch`s; the rank error is about 1.7 / `KLL_K`.
+#define KLL_K 256
+// Maximum number of levels of a `Sketch`, enough for 2^48 * `KLL_K` points.
+#define KLL_LEVELS 48
+
+// Count, mean, sum of squared deviations, and extrema of a stream of numbers
+// updated with Welford's algorithm.
+typedef struct Moments {
+	unsigned long n;
+	double mean;
+	double m2;
+	double min;
+	double max;
+} Moments;
+
+// KLL quantile sketch (Karnin, Lang, and Liberty, 2016). Level `h` holds
+// items of weight 2^h; when the sketch exceeds its total capacity, the lowest
+// level over its capacity is sorted and every other item is promoted to the
+// next level. Capacities shrink geometrically towards the lower levels, so the
+// memory grows only with the logarithm of the number of items.
+typedef struct Sketch {
+	double *levels[KLL_LEVELS];
+	int lens[KLL_LEVELS];
+	int nlevels;
+	int len; // Total number of items in the levels
+	int cap; // Total capacity of the levels
+	uint64_t coin; // State of the coin deciding which items are promoted
+	bool err;      // Failed to allocate a level
+} Sketch;
+
+// Summary of a stream of points.
+typedef struct Stats {
+	Moments x, y;
+	Sketch qx, qy;
+} Stats;
+
+void new_stats(Stats *st);
+
+void free_stats(Stats *st);
+
+static inline void moments_add(Moments *m, double v)
+{
+	++m->n;
+	const double delta = v - m->mean;
+	m->mean += delta / m->n;
+	m->m2 += delta * (v - m->mean);
+	m->min = v < m->min ? v : m->min;
+	m->max = v > m->max ? v : m->max;
+}
+
+void sketch_add(Sketch *sk, double v);
+
+static inline void stats_add(Stats *st, double x, double y)
+{
+	moments_add(&st->x, x);
+	moments_add(&st->y, y);
+	sketch_add(&st->qx, x);
+	sketch_add(&st->qy, y);
+}
+
+// Add the points summarized in `src` to `dest`.
+void merge_stats(Stats *dest, const Stats *src);
+
+// Approximate `q`-quantile of the items in `sk`, for 0 <= `q` <= 1. Returns NaN
+// if `sk` is empty or failed.
+double sketch_quantile(const Sketch *sk, double q);
+
+double moments_stddev(const Moments *m);
+
+// Quantile of the standard normal distribution at 0 < `p` < 1.
+double normal_quantile(double p);
+
+// Print the count, extrema, mean, standard deviation, and the 1st, 50th, and
+// 99th percentiles of each axis to `stream`. Returns `false` if a sketch has
+// failed.
+bool p_stats(FILE *stream, const Stats *st);
+
+#endif /* ifndef STATS_H */
@@ -0,0 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
+#include "store.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Version of the layout, to be bumped whenever it changes
+#define STORE_VERSION 1
+// Written in the byte order of the build
+#define STORE_ORDER 0x01020304
+// Alignment of the sections
+#define STORE_PAGE 4096
+// Maximum number of cells of the grid along an axis
+#define STORE_GRID_MAX 1024
+
+// The start of a store. Offsets are from the start, and multiples of
+// `STORE_PAGE`.
+typedef struct Header {
+	char magic[8]; // "GISASTO"
+	uint32_t version;
+	uint32_t order;
+	uint64_t n;
+	uint32_t nx, ny;
+	uint32_t has_rec, pad;
+	double xl, xu, yl, yu;
+	// `nx` * `ny` + 2 offsets of the cells, the last one for the states
+	// which are not finite
+	uint64_t cells_off;
+	uint64_t x_off, y_off, id_off, rec_off;
+	uint64_t size; // Of the whole store
+} Header;
+
+// A row spilled while sampling
+typedef struct Row {
+	uint64_t id;
+	double x, y;
+	uint64_t rec;
+} Row;
+
+// Forward declarations for static functions
+static uint64_t page_up(uint64_t off);
+static int cell_of(double v, double lo, double hi, int n);
+static uint64_t row_cell(const Header *h, double x, double y);
+static void p_row(FILE *stream, Format fmt, uint64_t id, double x, double y,
+		  const uint64_t *rec);
+
+static uint64_t page_up(uint64_t off)
+{
+	return (off + STORE_PAGE - 1) / STORE_PAGE * STORE_PAGE;
+}
+
+// The cell of `v` along an axis cut into `n` cells over [`lo`, `hi`], the
+// first or the last if outside. Never decreases as `v` increases, so that the
+// cells of a range are those between the cells of its bounds.
+static int cell_of(double v, double lo, double hi, int n)
+{
+	if (!(hi > lo)) {
+		return 0;
+	}
+	const double c = (v - lo) / (hi - lo) * n;
+	return c < 1. ? 0 : c >= n ? n - 1 : (int)c;
+}
+
+// The cell of the state (`x`, `y`) in the grid of `h`
+static uint64_t row_cell(const Header *h, double x, double y)
+{
+	if (!isfinite(x) || !isfinite(y)) {
+		return (uint64_t)h->nx * h->ny;
+	}
+	return (uint64_t)cell_of(y, h->yl, h->yu, h->ny) * h->nx +
+	       cell_of(x, h->xl, h->xu, h->nx);
+}
+
+bool new_store(StoreWriter *s, long rec_off)
+{
+	*s = (StoreWriter){.xl = INFINITY,
+			   .xu = -INFINITY,
+			   .yl = INFINITY,
+			   .yu = -INFINITY,
+			   .has_rec = rec_off >= 0,
+			   .rec_off = rec_off >= 0 ? (uint64_t)rec_off : 0};
+	s->spill = tmpfile();
+	return s->spill;
+}
+
+bool store_point(StoreWriter *s, uint64_t id, double x, double y,
+		 size_t rec_len)
+{
+	const Row row = {.id = id, .x = x, .y = y, .rec = s->rec_off};
+	s->rec_off += rec_len;
+	if (isfinite(x) && isfinite(y)) {
+		s->xl = x < s->xl ? x : s->xl;
+		s->xu = x > s->xu ? x : s->xu;
+		s->yl = y < s->yl ? y : s->yl;
+		s->yu = y > s->yu ? y : s->yu;
+	}
+	s->err = s->err || fwrite(&row, sizeof row, 1, s->spill) != 1;
+	++s->n;
+	return !s->err;
+}
+
+bool finish_store(StoreWriter *s, const char *path)
+{
+	Header h = {.magic = "GISASTO",
+		    .version = STORE_VERSION,
+		    .order = STORE_ORDER,
+		    .n = s->n,
+		    .nx = 1,
+		    .ny = 1,
+		    .has_rec = s->has_rec};
+	if (s->xl <= s->xu) {
+		// About `STORE_CELL` rows per cell
+		const double side = fmin(
+		    fmax(ceil(sqrt((double)s->n / STORE_CELL)), 1.),
+		    STORE_GRID_MAX);
+		h.xl = s->xl;
+		h.xu = s->xu;
+		h.yl = s->yl;
+		h.yu = s->yu;
+		h.nx = h.xu > h.xl ? (uint32_t)side : 1;
+		h.ny = h.yu > h.yl ? (uint32_t)side : 1;
+	}
+	const uint64_t ncells = (uint64_t)h.nx * h.ny + 1;
+	h.cells_off = page_up(sizeof h);
+	h.x_off = page_up(h.cells_off + (ncells + 1) * sizeof(uint64_t));
+	h.y_off = page_up(h.x_off + h.n * sizeof(double));
+	h.id_off = page_up(h.y_off + h.n * sizeof(double));
+	h.rec_off = page_up(h.id_off + h.n * sizeof(uint64_t));
+	h.size = h.rec_off + (h.has_rec ? h.n * sizeof(uint64_t) : 0);
+
+	bool ok = false;
+	const size_t spill_len = h.n * sizeof(Row);
+	const Row *rows = MAP_FAILED;
+	char *out = MAP_FAILED;
+	int fd = -1;
+	uint64_t *next = calloc(ncells + 1, sizeof *next);
+	if (!next) {
+		errno = ENOMEM;
+		goto cleanup;
+	}
+	if (s->err || fflush(s->spill)) {
+		errno = errno ? errno : EIO;
+		goto cleanup;
+	}
+	if (spill_len) {
+		rows = mmap(NULL, spill_len, PROT_READ, MAP_SHARED,
+			    fileno(s->spill), 0);
+		if (rows == MAP_FAILED) {
+			goto cleanup;
+		}
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0 || ftruncate(fd, h.size)) {
+		goto cleanup;
+	}
+	out = mmap(NULL, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (out == MAP_FAILED) {
+		goto cleanup;
+	}
+
+	// Count the rows of each cell, and turn the counts into the first row
+	// of each cell.
+	for (uint64_t i = 0; i < h.n; ++i) {
+		++next[row_cell(&h, rows[i].x, rows[i].y) + 1];
+	}
+	for (uint64_t c = 0; c < ncells; ++c) {
+		next[c + 1] += next[c];
+	}
+	memcpy(out, &h, sizeof h);
+	memcpy(out + h.cells_off, next, (ncells + 1) * sizeof *next);
+	double *x = (double *)(out + h.x_off);
+	double *y = (double *)(out + h.y_off);
+	uint64_t *id = (uint64_t *)(out + h.id_off);
+	uint64_t *rec = (uint64_t *)(out + h.rec_off);
+	for (uint64_t i = 0; i < h.n; ++i) {
+		const Row *r = rows + i;
+		const uint64_t at = next[row_cell(&h, r->x, r->y)]++;
+		x[at] = r->x;
+		y[at] = r->y;
+		id[at] = r->id;
+		if (h.has_rec) {
+			rec[at] = r->rec;
+		}
+	}
+	ok = true;
+
+cleanup:
+	if (out != MAP_FAILED) {
+		munmap(out, h.size);
+	}
+	if (fd >= 0 && close(fd)) {
+		ok = false;
+	}
+	if (rows != MAP_FAILED) {
+		munmap((void *)rows, spill_len);
+	}
+	free(next);
+	free_store_writer(s);
+	return ok;
+}
+
+void free_store_writer(StoreWriter *s)
+{
+	if (s->spill) {
+		fclose(s->spill);
+	}
+	s->spill = NULL;
+}
+
+bool open_store(Store *s, const char *path)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(Header)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	// A query reads a few runs of rows; reading ahead would bring in the
+	// rows of cells it does not meet.
+	posix_madvise(map, st.st_size, POSIX_MADV_RANDOM);
+
+	const Header *h = map;
+	const char *base = map;
+	const uint64_t len = st.st_size;
+	const uint64_t ncells = (uint64_t)h->nx * h->ny + 1;
+	const uint64_t col = h->n * sizeof(double);
+	if (memcmp(h->magic, "GISASTO", 8) || h->version != STORE_VERSION ||
+	    h->order != STORE_ORDER || h->size != len || h->nx < 1 ||
+	    h->nx > STORE_GRID_MAX || h->ny < 1 || h->ny > STORE_GRID_MAX ||
+	    h->n > len / sizeof(double) || h->cells_off % STORE_PAGE ||
+	    h->x_off % STORE_PAGE || h->y_off % STORE_PAGE ||
+	    h->id_off % STORE_PAGE || h->rec_off % STORE_PAGE ||
+	    h->cells_off > len ||
+	    (len - h->cells_off) / sizeof(uint64_t) < ncells + 1 ||
+	    h->x_off > len || len - h->x_off < col || h->y_off > len ||
+	    len - h->y_off < col || h->id_off > len || len - h->id_off < col ||
+	    (h->has_rec && (h->rec_off > len || len - h->rec_off < col))) {
+		munmap(map, st.st_size);
+		return false;
+	}
+	*s = (Store){.map = map,
+		     .len = st.st_size,
+		     .n = h->n,
+		     .nx = h->nx,
+		     .ny = h->ny,
+		     .xl = h->xl,
+		     .xu = h->xu,
+		     .yl = h->yl,
+		     .yu = h->yu,
+		     .cells = (const uint64_t *)(base + h->cells_off),
+		     .x = (const double *)(base + h->x_off),
+		     .y = (const double *)(base + h->y_off),
+		     .id = (const uint64_t *)(base + h->id_off),
+		     .rec = h->has_rec ? (const uint64_t *)(base + h->rec_off)
+				       : NULL};
+	return true;
+}
+
+void close_store(Store *s)
+{
+	munmap(s->map, s->len);
+	s->map = NULL;
+}
+
+// Print the row of the trajectory `id`, which ended at (`x`, `y`) and whose
+// record is at `*rec` if set.
+static void p_row(FILE *stream, Format fmt, uint64_t id, double x, double y,
+		  const uint64_t *rec)
+{
+	char xs[FMT_DOUBLE_MAX + 1], ys[FMT_DOUBLE_MAX + 1];
+	const bool json = fmt == FMT_NDJSON;
+	if (json && !isfinite(x)) {
+		strcpy(xs, "null");
+	} else {
+		xs[fmt_double(xs, x)] = '\0';
+	}
+	if (json && !isfinite(y)) {
+		strcpy(ys, "null");
+	} else {
+		ys[fmt_double(ys, y)] = '\0';
+	}
+	const unsigned long long i = id;
+	switch (fmt) {
+	case FMT_TEXT:
+		fprintf(stream, "#%llu (%lf, %lf)", i, x, y);
+		if (rec) {
+			fprintf(stream, " @%llu", (unsigned long long)*rec);
+		}
+		break;
+	case FMT_CSV:
+		fprintf(stream, "%llu,%s,%s", i, xs, ys);
+		if (rec) {
+			fprintf(stream, ",%llu", (unsigned long long)*rec);
+		}
+		break;
+	case FMT_NDJSON:
+		fprintf(stream, "{\"id\":%llu,\"x\":%s,\"y\":%s", i, xs, ys);
+		if (rec) {
+			fprintf(stream, ",\"record\":%llu",
+				(unsigned long long)*rec);
+		}
+		putc('}', stream);
+		break;
+	case FMT_BIN:
+		break;
+	}
+	putc('\n', stream);
+}
+
+uint64_t query_store(FILE *stream, const Store *s, Format fmt, double xl,
+		     double xu, double yl, double yu)
+{
+	if (fmt == FMT_CSV) {
+		fputs(s->rec ? "id,x,y,record\n" : "id,x,y\n", stream);
+	}
+	// Runs of rows to scan: those of the cells the box meets in each row
+	// of the grid, and those of the states which are not finite, which
+	// meet only an unbounded box.
+	const int cx0 = cell_of(xl, s->xl, s->xu, s->nx);
+	const int cx1 = cell_of(xu, s->xl, s->xu, s->nx);
+	const int cy0 = cell_of(yl, s->yl, s->yu, s->ny);
+	const int cy1 = cell_of(yu, s->yl, s->yu, s->ny);
+	const bool meets =
+	    xl <= s->xu && xu >= s->xl && yl <= s->yu && yu >= s->yl;
+	uint64_t count = 0;
+	for (int cy = meets ? cy0 : s->ny; cy <= s->ny; ++cy) {
+		const uint64_t *c = s->cells + (uint64_t)cy * s->nx;
+		const uint64_t from = cy < s->ny ? c[cx0] : c[0];
+		uint64_t to = cy < s->ny ? c[cx1 + 1] : c[1];
+		// A damaged index reads no row outside the store.
+		to = to > s->n ? s->n : to;
+		for (uint64_t i = from; i < to; ++i) {
+			const double x = s->x[i], y = s->y[i];
+			if (x >= xl && x <= xu && y >= yl && y <= yu) {
+				p_row(stream, fmt, s->id[i], x, y,
+				      s->rec ? s->rec + i : NULL);
+				++count;
+			}
+		}
+		if (cy == cy1 && cy < s->ny) {
+			cy = s->ny - 1;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,81 @@
+#ifndef STORE_H
+#define STORE_H
+
+/* Stores of final states, to be queried by region without sampling again.
+ *
+ * A store lays out the final states in columns: `x`, `y`, the index of the
+ * trajectory, and, if its choices were recorded, the offset of its record in
+ * the record file. The rows are sorted by the cell of a uniform grid over the
+ * bounding box of the states, about `STORE_CELL` rows per cell, with the
+ * states which are not finite in a last cell of their own, and a table of the
+ * first row of each cell indexes them. The columns are aligned to pages, so a
+ * query of a box reads only the pages of the rows of the cells it meets:
+ * a run of cells per row of the grid, each a run of rows.
+ *
+ * A store is written in two passes: the rows are spilled to a temporary file
+ * as they are sampled, and once the bounding box is known, counted by cell and
+ * scattered into the columns of the store, mapped.
+ */
+
+#include "output.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Number of rows per cell of the grid aimed at
+#define STORE_CELL 64
+
+// A store being written
+typedef struct StoreWriter {
+	FILE *spill; // Rows so far
+	uint64_t n;
+	double xl, xu, yl, yu; // Bounding box of the finite states
+	bool has_rec;
+	uint64_t rec_off; // Offset of the next record
+	bool err;
+} StoreWriter;
+
+// A store mapped to be queried
+typedef struct Store {
+	void *map;
+	size_t len;
+	uint64_t n;
+	int nx, ny;
+	double xl, xu, yl, yu;
+	const uint64_t *cells; // First row of each cell, and the row count
+	const double *x;
+	const double *y;
+	const uint64_t *id;
+	const uint64_t *rec; // `NULL` if no choices were recorded
+} Store;
+
+// Initialize `s`, whose rows have records from the offset `rec_off` of the
+// record file on, or no records if `rec_off` is negative. Returns `false` if
+// failed.
+bool new_store(StoreWriter *s, long rec_off);
+
+// Add the final state (`x`, `y`) of the trajectory `id`, whose record is of
+// `rec_len` bytes, to `s`. Returns `false` if `s` has failed.
+bool store_point(StoreWriter *s, uint64_t id, double x, double y,
+		 size_t rec_len);
+
+// Index the rows of `s` and write them to the store at `path`, and release
+// `s`. Returns `false` if failed, in which case `errno` tells why.
+bool finish_store(StoreWriter *s, const char *path);
+
+void free_store_writer(StoreWriter *s);
+
+// Map the store at `path` into `s`. Returns `false` if failed, in which case
+// `errno` tells why, or if it is not a store.
+bool open_store(Store *s, const char *path);
+
+void close_store(Store *s);
+
+// Print the rows of `s` whose states lie in the box [`xl`, `xu`] x [`yl`,
+// `yu`] to `stream` in `fmt`, which is not `FMT_BIN`, by cell: the index of
+// each trajectory, its final state, and the offset of its record if any.
+// Returns the number of rows printed.
+uint64_t query_store(FILE *stream, const Store *s, Format fmt, double xl,
+		     double xu, double yl, double yu);
+
+#endif /* ifndef STORE_H */
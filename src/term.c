@@ -33,12 +33,15 @@ static bool ipow_poly(TermNode **dest, long long exp);
 static void free_term(TermNode *t);
 static void print_var(const TermNode *v);
 
+_Thread_local Tally term_tally = {0};
+
 TermNode *coeff_term(double val)
 {
 	TermNode *term = malloc(sizeof *term);
 	if (!term) {
 		return NULL;
 	}
+	tally_alloc(&term_tally, sizeof *term);
 	*term = (TermNode){COEFF_TERM, .hd.val = val, .u.vars = NULL, NULL};
 	return term;
 }
@@ -49,6 +52,7 @@ TermNode *var_term(char name, long pow)
 	if (!term) {
 		return NULL;
 	}
+	tally_alloc(&term_tally, sizeof *term);
 	*term = (TermNode){VAR_TERM, .hd.name = name, .u.pow = pow, NULL};
 	return term;
 }
@@ -281,6 +285,7 @@ static void mul_var(TermNode **dest, TermNode *src)
 			TermNode *tmp = src;
 			src = src->next;
 			// No dedicated function to free a single `VAR_TERM`.
+			tally_free(&term_tally, sizeof *tmp);
 			free(tmp);
 		}
 	}
@@ -311,6 +316,7 @@ bool mul_poly(TermNode **dest, TermNode *src)
 				free_poly(tmp);
 				goto dup_fail;
 			}
+			tally_alloc(&term_tally, sizeof *dup);
 			*dup = tmp;
 		}
 		TermNode *svars = src->u.vars;
@@ -322,6 +328,8 @@ bool mul_poly(TermNode **dest, TermNode *src)
 				if (!vdup) {
 					if (p != dest) {
 						free_poly(*p);
+						tally_free(&term_tally,
+							   sizeof *p);
 						free(p);
 					}
 					goto dup_fail;
@@ -331,6 +339,7 @@ bool mul_poly(TermNode **dest, TermNode *src)
 		}
 		if (p != dest) {
 			bool success = add_poly(dest, *p);
+			tally_free(&term_tally, sizeof *p);
 			free(p); // Allocated by `dup`.
 			if (!success) {
 				goto dup_fail;
@@ -481,6 +490,7 @@ static void free_term(TermNode *t)
 	default:
 		assert(false && "Unexpected node type\n");
 	}
+	tally_free(&term_tally, sizeof *t);
 	free(t);
 }
 
@@ -1,6 +1,7 @@
 #ifndef TERM_H
 #define TERM_H
 
+#include "util.h"
 #include <stdbool.h>
 
 /* Diagram of the representation for 2xy^2 + 5y + 9 using `TermNode`s
@@ -31,6 +32,10 @@ typedef struct TermNode {
 	struct TermNode *next;
 } TermNode;
 
+// Allocations of this module so far on the calling thread, nearly all of them
+// `TermNode`s, for profiling
+extern _Thread_local Tally term_tally;
+
 TermNode *coeff_term(double val);
 
 TermNode *var_term(char name, long pow);
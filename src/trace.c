@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Magic number at the head of a trace
+#define TRACE_MAGIC "GISATRC1"
+// Number of events a thread buffers in streaming mode
+#define TRACE_BUF 1024
+
+_Static_assert(sizeof(Event) == 64, "An event should fill a cache line.");
+
+// Forward declarations for static functions
+static bool flush_tracer(Tracer *tr);
+static bool write_all(int fd, const void *buf, size_t len);
+
+bool new_trace(Trace *t, FILE *stream, int nthreads, size_t keep)
+{
+	*t = (Trace){.stream = stream,
+		     .fd = fileno(stream),
+		     .flight = keep > 0,
+		     .ntracers = nthreads};
+	if (fwrite(TRACE_MAGIC, 1, 8, stream) != 8 || fflush(stream)) {
+		return false;
+	}
+	if (pthread_mutex_init(&t->lock, NULL)) {
+		fputs("Failed to create a lock.\n", stderr);
+		return false;
+	}
+	t->tracers = calloc(nthreads, sizeof *t->tracers);
+	if (!t->tracers) {
+		goto mem_err;
+	}
+	for (int i = 0; i < nthreads; ++i) {
+		Tracer *tr = t->tracers + i;
+		// The spare slot is for the event being written.
+		tr->cap = keep ? keep + 1 : TRACE_BUF;
+		tr->id = i;
+		tr->trace = t;
+		atomic_init(&tr->head, 0);
+		if (!(tr->buf = malloc(tr->cap * sizeof *tr->buf))) {
+			goto mem_err;
+		}
+	}
+	return true;
+
+mem_err:
+	fputs("Failed to allocate memory.\n", stderr);
+	free_trace(t);
+	return false;
+}
+
+// Write the pending events of `tr` in streaming mode.
+static bool flush_tracer(Tracer *tr)
+{
+	Trace *t = tr->trace;
+	pthread_mutex_lock(&t->lock);
+	if (tr->len && fwrite(tr->buf, sizeof *tr->buf, tr->len, t->stream) !=
+			   tr->len) {
+		t->err = true;
+	}
+	pthread_mutex_unlock(&t->lock);
+	tr->len = 0;
+	return !t->err;
+}
+
+bool free_trace(Trace *t)
+{
+	for (int i = 0; t->tracers && i < t->ntracers; ++i) {
+		if (!t->flight && t->tracers[i].buf) {
+			flush_tracer(t->tracers + i);
+		}
+		free(t->tracers[i].buf);
+	}
+	free(t->tracers);
+	t->tracers = NULL;
+	pthread_mutex_destroy(&t->lock);
+	return !t->err && !fflush(t->stream);
+}
+
+void trace_event(Tracer *tr, Event *ev)
+{
+	const unsigned long h =
+	    atomic_load_explicit(&tr->head, memory_order_relaxed);
+	ev->thread = (uint16_t)tr->id;
+	ev->seq = h;
+	if (!tr->trace->flight) {
+		tr->buf[tr->len++] = *ev;
+		atomic_store_explicit(&tr->head, h + 1, memory_order_relaxed);
+		if (tr->len == tr->cap) {
+			flush_tracer(tr);
+		}
+		return;
+	}
+	tr->buf[h % tr->cap] = *ev;
+	// Publish the event only once it is whole.
+	atomic_store_explicit(&tr->head, h + 1, memory_order_release);
+}
+
+// `write` all of `buf`, going on after interruptions.
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len) {
+		const ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+bool dump_trace(Trace *t)
+{
+	const int saved = errno;
+	bool ok = true;
+	for (int i = 0; ok && i < t->ntracers; ++i) {
+		const Tracer *tr = t->tracers + i;
+		const unsigned long h =
+		    atomic_load_explicit(&tr->head, memory_order_acquire);
+		// The oldest slot may be being overwritten by the next event.
+		const unsigned long n = h < tr->cap - 1 ? h : tr->cap - 1;
+		const Event head = {.type = EV_DUMP,
+				    .thread = (uint16_t)i,
+				    .n = (uint32_t)n,
+				    .seq = h};
+		const size_t from = (h - n) % tr->cap;
+		const size_t first = from + n <= tr->cap ? n : tr->cap - from;
+		const size_t size = sizeof *tr->buf;
+		ok = write_all(t->fd, &head, sizeof head) &&
+		     write_all(t->fd, tr->buf + from, first * size) &&
+		     write_all(t->fd, tr->buf, (n - first) * size);
+	}
+	errno = saved;
+	return ok;
+}
+
+void p_event(FILE *stream, const Event *ev)
+{
+	const double *v = ev->u.v;
+	switch ((EventType)ev->type) {
+	case EV_START:
+		fprintf(stream, "Trajectory #%llu\n",
+			(unsigned long long)ev->u.traj);
+		break;
+	case EV_INIT:
+		fprintf(stream,
+			"Initialize in region [%lf, %lf] x [%lf, %lf]: "
+			"(%lf, %lf)\n",
+			v[0], v[1], v[2], v[3], v[4], v[5]);
+		break;
+	case EV_POLYGON:
+		fprintf(stream, "Initialize in polygon #%d: (%lf, %lf)\n",
+			(int)ev->n + 1, v[0], v[1]);
+		break;
+	case EV_TRANSLATE:
+		fprintf(stream, "Translate +(%lf, %lf) -> (%lf, %lf)\n", v[0],
+			v[1], v[2], v[3]);
+		break;
+	case EV_ROTATE:
+		fprintf(stream, "Rotate @(%lf, %lf, %lfdeg) -> (%lf, %lf)\n",
+			v[0], v[1], v[2], v[3], v[4]);
+		break;
+	case EV_OR:
+		fprintf(stream, "OR selected %s\n",
+			ev->flag ? "right" : "left");
+		break;
+	case EV_ITER:
+		fprintf(stream, "Iterate %d times\n", (int)ev->n);
+		break;
+	case EV_QUERY:
+		fprintf(stream, "%s #%d: (%lf, %lf) is %s\n",
+			ev->flag & EV_ASSERT ? "Assert" : "Reach",
+			(int)ev->n + 1, v[0], v[1],
+			ev->flag & EV_IN ? "in" : "out");
+		break;
+	case EV_DUMP:
+		fprintf(stream, "Last %u events of thread %u:\n",
+			(unsigned)ev->n, (unsigned)ev->thread);
+		break;
+	default:
+		fprintf(stream, "Unknown event %u\n", (unsigned)ev->type);
+		break;
+	}
+}
+
+bool decode_trace(FILE *in, FILE *out)
+{
+	char magic[8];
+	if (fread(magic, 1, sizeof magic, in) != sizeof magic ||
+	    memcmp(magic, TRACE_MAGIC, sizeof magic)) {
+		fputs("Not a trace.\n", stderr);
+		return false;
+	}
+	Event ev;
+	size_t len;
+	while ((len = fread(&ev, 1, sizeof ev, in)) == sizeof ev) {
+		p_event(out, &ev);
+		if (ev.type != EV_DUMP) {
+			continue;
+		}
+		// Skip the events overwritten while they were dumped.
+		const uint64_t end = ev.seq;
+		const uint32_t n = ev.n;
+		for (uint32_t k = 0; k < n; ++k) {
+			if (fread(&ev, sizeof ev, 1, in) != 1) {
+				fputs("The trace is truncated.\n", stderr);
+				return false;
+			}
+			if (ev.seq == end - n + k) {
+				p_event(out, &ev);
+			}
+		}
+	}
+	if (len || ferror(in)) {
+		fputs("The trace is truncated.\n", stderr);
+		return false;
+	}
+	return true;
+}
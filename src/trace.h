@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum EventType {
+	EV_START,     // A trajectory starts: `u.traj`
+	EV_INIT,      // x-start, x-end, y-start, y-end, x, y
+	EV_POLYGON,   // Polygon `n`: x, y
+	EV_TRANSLATE, // u, v, x, y
+	EV_ROTATE,    // u, v, degrees, x, y
+	EV_OR,	      // `flag`: the right branch
+	EV_ITER,      // `n` iterations
+	EV_QUERY,     // Query `n` at x, y; `flag`: `EV_ASSERT` | `EV_IN`
+	EV_DUMP	      // `n` events of thread `thread` up to `seq` follow.
+} EventType;
+
+#define EV_ASSERT 1
+#define EV_IN 2
+
+// A fixed-size record of a step of a trajectory, as written to a trace in
+// host byte order. `seq` counts the events of each thread.
+typedef struct Event {
+	uint8_t type;
+	uint8_t flag;
+	uint16_t thread;
+	uint32_t n;
+	uint64_t seq;
+	union {
+		double v[6];
+		uint64_t traj;
+	} u;
+} Event;
+
+struct Trace;
+
+// Events of a thread: in streaming mode, those yet to be written; in flight
+// mode, a ring of the last `cap` of them, with `head` counting all events,
+// stored only by the thread and read by `dump_trace` at any time.
+typedef struct Tracer {
+	Event *buf;
+	size_t cap;
+	size_t len;
+	atomic_ulong head;
+	int id;
+	struct Trace *trace;
+} Tracer;
+
+// Trace of a run, written to `stream`: every event as it comes (streaming
+// mode), or the last events of each thread on demand (flight mode).
+typedef struct Trace {
+	FILE *stream;
+	int fd; // Of `stream`, for `dump_trace`
+	bool flight;
+	pthread_mutex_t lock; // Serializes writes in streaming mode
+	int ntracers;
+	Tracer *tracers; // One per thread
+	bool err;
+} Trace;
+
+// Initialize `t` to trace `nthreads` threads into `stream`, and write the
+// header. In flight mode, if `keep` > 0, each thread keeps only its last
+// `keep` events. Returns `false` if failed.
+bool new_trace(Trace *t, FILE *stream, int nthreads, size_t keep);
+
+// Write the pending events in streaming mode, and release `t`. Returns
+// `false` if a write has failed.
+bool free_trace(Trace *t);
+
+// Record `ev` for the thread of `tr`.
+void trace_event(Tracer *tr, Event *ev);
+
+// Write the rings of the threads in flight mode to `t->stream`, each after an
+// `EV_DUMP` event, with `write` only, so that it is safe in a signal handler.
+// Returns `false` if failed.
+bool dump_trace(Trace *t);
+
+// Print `ev` to `stream` as verbose mode does.
+void p_event(FILE *stream, const Event *ev);
+
+// Render the trace read from `in` as text to `out`. Returns `false` if `in`
+// is not a trace or is truncated.
+bool decode_trace(FILE *in, FILE *out);
+
+#endif /* ifndef TRACE_H */
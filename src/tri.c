@@ -0,0 +1,224 @@
+#include "tri.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Relative mismatch of the areas of the triangles and the polygon tolerated
+#define AREA_TOL 1e-9
+
+// Forward declarations for static functions
+static double cross(const double *a, const double *b, const double *c);
+static bool inside(const double *a, const double *b, const double *c,
+		   const double *p);
+static bool clip_ears(Tris *t, const double *xy, int n);
+static bool build_alias(Tris *t);
+
+// Twice the signed area of the triangle `a`, `b`, `c`; positive if
+// counterclockwise.
+static double cross(const double *a, const double *b, const double *c)
+{
+	return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+// Whether `p` is in the counterclockwise triangle `a`, `b`, `c` or on its
+// boundary.
+static bool inside(const double *a, const double *b, const double *c,
+		   const double *p)
+{
+	return cross(a, b, p) >= 0. && cross(b, c, p) >= 0. &&
+	       cross(c, a, p) >= 0.;
+}
+
+// Cut the counterclockwise polygon `xy` into `t->v`, one ear at a time.
+// Collinear vertices are dropped without a triangle.
+static bool clip_ears(Tris *t, const double *xy, int n)
+{
+	int *idx = malloc(n * sizeof *idx);
+	if (!idx) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	for (int i = 0; i < n; ++i) {
+		idx[i] = i;
+	}
+	int m = n;
+	while (m >= 3) {
+		bool clipped = false;
+		for (int i = 0; i < m && !clipped; ++i) {
+			const double *a = xy + 2 * idx[(i + m - 1) % m];
+			const double *b = xy + 2 * idx[i];
+			const double *c = xy + 2 * idx[(i + 1) % m];
+			const double area = cross(a, b, c);
+			if (area < 0.) {
+				continue; // Reflex
+			}
+			bool ear = true;
+			for (int k = 0; ear && area > 0. && k < m; ++k) {
+				const double *p = xy + 2 * idx[k];
+				ear = p == a || p == b || p == c ||
+				      !inside(a, b, c, p);
+			}
+			if (!ear) {
+				continue;
+			}
+			if (area > 0.) {
+				double *v = t->v + 6 * t->n++;
+				memcpy(v, a, 2 * sizeof *v);
+				memcpy(v + 2, b, 2 * sizeof *v);
+				memcpy(v + 4, c, 2 * sizeof *v);
+			}
+			memmove(idx + i, idx + i + 1,
+				(m - i - 1) * sizeof *idx);
+			--m;
+			clipped = true;
+		}
+		if (!clipped) {
+			break;
+		}
+	}
+	free(idx);
+	if (m >= 3) {
+		fputs("The polygon is not simple.\n", stderr);
+		return false;
+	}
+	return true;
+}
+
+// Build the alias table of the triangles by their areas with the method of
+// Vose: underfull picks are topped up by overfull ones.
+static bool build_alias(Tris *t)
+{
+	const int n = t->n;
+	int *small = malloc(2 * n * sizeof *small);
+	if (!small) {
+		fputs("Failed to allocate memory.\n", stderr);
+		return false;
+	}
+	int *large = small + n;
+	int ns = 0;
+	int nl = 0;
+	for (int i = 0; i < n; ++i) {
+		const double *v = t->v + 6 * i;
+		t->prob[i] = cross(v, v + 2, v + 4) / 2. / t->area * n;
+		t->alias[i] = i;
+		if (t->prob[i] < 1.) {
+			small[ns++] = i;
+		} else {
+			large[nl++] = i;
+		}
+	}
+	while (ns && nl) {
+		const int s = small[--ns];
+		const int l = large[nl - 1];
+		t->alias[s] = l;
+		t->prob[l] -= 1. - t->prob[s];
+		if (t->prob[l] < 1.) {
+			--nl;
+			small[ns++] = l;
+		}
+	}
+	// Left over from rounding
+	while (nl) {
+		t->prob[large[--nl]] = 1.;
+	}
+	while (ns) {
+		t->prob[small[--ns]] = 1.;
+	}
+	free(small);
+	return true;
+}
+
+bool new_tris(Tris *t, const double *xy, int n)
+{
+	*t = (Tris){0};
+	double *ccw = malloc(2 * n * sizeof *ccw);
+	t->v = malloc(6 * (n > 2 ? n - 2 : 1) * sizeof *t->v);
+	t->prob = malloc(n * sizeof *t->prob);
+	t->alias = malloc(n * sizeof *t->alias);
+	if (!ccw || !t->v || !t->prob || !t->alias) {
+		fputs("Failed to allocate memory.\n", stderr);
+		goto err;
+	}
+
+	// Shoelace formula, and the vertices turned counterclockwise
+	double area = 0.;
+	for (int i = 0; i < n; ++i) {
+		const int j = (i + 1) % n;
+		area += xy[2 * i] * xy[2 * j + 1] - xy[2 * j] * xy[2 * i + 1];
+	}
+	area /= 2.;
+	for (int i = 0; i < n; ++i) {
+		const int k = area >= 0. ? i : n - 1 - i;
+		ccw[2 * i] = xy[2 * k];
+		ccw[2 * i + 1] = xy[2 * k + 1];
+	}
+	t->area = fabs(area);
+	if (!(t->area > 0.)) {
+		fputs("The polygon has no area.\n", stderr);
+		goto err;
+	}
+	if (!clip_ears(t, ccw, n)) {
+		goto err;
+	}
+	// A self-intersecting polygon may still be cut, but not into its
+	// area.
+	double sum = 0.;
+	for (int i = 0; i < t->n; ++i) {
+		const double *v = t->v + 6 * i;
+		sum += cross(v, v + 2, v + 4) / 2.;
+	}
+	if (fabs(sum - t->area) > AREA_TOL * t->area) {
+		fputs("The polygon is not simple.\n", stderr);
+		goto err;
+	}
+	if (!build_alias(t)) {
+		goto err;
+	}
+
+	t->xl = t->xu = xy[0];
+	t->yl = t->yu = xy[1];
+	for (int i = 1; i < n; ++i) {
+		t->xl = fmin(t->xl, xy[2 * i]);
+		t->xu = fmax(t->xu, xy[2 * i]);
+		t->yl = fmin(t->yl, xy[2 * i + 1]);
+		t->yu = fmax(t->yu, xy[2 * i + 1]);
+	}
+	free(ccw);
+	return true;
+
+err:
+	free(ccw);
+	free_tris(t);
+	return false;
+}
+
+void free_tris(Tris *t)
+{
+	free(t->v);
+	free(t->prob);
+	free(t->alias);
+	*t = (Tris){0};
+}
+
+void tris_point(const Tris *t, double u, double v, double w, double *x,
+		double *y)
+{
+	// The integer part of `u` * n picks a triangle, and the fraction
+	// decides between it and its alias.
+	const double f = u * t->n;
+	int k = (int)f;
+	k = k < t->n ? k : t->n - 1;
+	if (f - k >= t->prob[k]) {
+		k = t->alias[k];
+	}
+	// Fold the unit square onto the triangle.
+	if (v + w > 1.) {
+		v = 1. - v;
+		w = 1. - w;
+	}
+	const double *c = t->v + 6 * k;
+	*x = c[0] + v * (c[2] - c[0]) + w * (c[4] - c[0]);
+	*y = c[1] + v * (c[3] - c[1]) + w * (c[5] - c[1]);
+}
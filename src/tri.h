@@ -0,0 +1,29 @@
+#ifndef TRI_H
+#define TRI_H
+
+#include <stdbool.h>
+
+// A simple polygon cut into triangles to draw uniform points from in O(1):
+// a triangle is picked from an alias table weighted by area, and then a
+// point within it, so no point is ever rejected however thin the polygon.
+typedef struct Tris {
+	int n;
+	double *v;     // x and y of the 3 corners of each triangle
+	double *prob;  // Probability to keep each pick rather than its alias
+	int *alias;
+	double area;
+	double xl, xu, yl, yu; // Bounding box
+} Tris;
+
+// Triangulate the simple polygon of the `n` vertices (`xy[2 * i]`,
+// `xy[2 * i + 1]`) into `t` by ear clipping. Returns `false` if failed,
+// including when the polygon is not simple or has no area.
+bool new_tris(Tris *t, const double *xy, int n);
+
+void free_tris(Tris *t);
+
+// The point of `t` for the uniform numbers `u`, `v`, and `w` in [0, 1).
+void tris_point(const Tris *t, double u, double v, double w, double *x,
+		double *y);
+
+#endif /* ifndef TRI_H */
@@ -51,3 +51,13 @@ long gcd(long a, long b)
 	}
 	return a;
 }
+
+uint64_t fnv1a(const void *s, size_t len)
+{
+	const unsigned char *p = s;
+	uint64_t h = 0xcbf29ce484222325;
+	for (size_t i = 0; i < len; ++i) {
+		h = (h ^ p[i]) * 0x100000001b3;
+	}
+	return h;
+}
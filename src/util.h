@@ -2,6 +2,8 @@
 #define UTIL_H
 
 #include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 #define DBL_LONG_MAX_P1 ((LONG_MAX / 2 + 1) * 2.0)
 
 #define ncmp(x, y)                                                             \
@@ -19,7 +21,27 @@ int cmp_double(double x, double y);
 int cmp_long_double(long x, double y);
 int cmp_double_long(double x, long y);
 
+// Allocations of a module: their count, and the bytes live and at the peak.
+// Not synchronized; each thread keeps tallies of its own.
+typedef struct Tally {
+	unsigned long allocs;
+	size_t bytes;
+	size_t peak;
+} Tally;
+
+static inline void tally_alloc(Tally *t, size_t size)
+{
+	++t->allocs;
+	t->bytes += size;
+	t->peak = t->bytes > t->peak ? t->bytes : t->peak;
+}
+
+static inline void tally_free(Tally *t, size_t size) { t->bytes -= size; }
+
 void swap(long *a, long *b);
 long gcd(long a, long b);
 
+// The 64-bit FNV-1a hash of the `len` bytes of `s`
+uint64_t fnv1a(const void *s, size_t len);
+
 #endif /* ifndef UTIL_H */